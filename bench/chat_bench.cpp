@@ -0,0 +1,366 @@
+/*
+    chat_bench.cpp
+
+    End-to-end latency benchmark for OllamaInterface. Starts a MockOllamaServer on its own thread and sends prompts
+    to it through OllamaInterface, the same way the app does, under a handful of scenarios:
+
+      - steady:      100 tokens at 100 tokens/s
+      - jitter:      the same with the gaps between tokens varying by up to 50%
+      - fragmented:  lines arriving in pieces of 1 to 7 bytes
+      - flood:       2000 tokens as fast as the server can write them, which makes the client the bottleneck
+      - errors:      30% of requests failing (HTTP 500, error line, or dropped connection)
+
+    For each scenario it reports time to first token, inter-token latency, tokens per second, and CPU time: for the
+    whole process, and for the client alone (the process minus the server thread). The results are written as JSON.
+
+    Usage: chat_bench [--runs N] [--scenario name] [--output file] [--baseline file] [--tolerance fraction]
+
+    With --baseline, the run fails (exit code 2) if any scenario's client CPU time per token, or its time to first
+    token beyond what the server was told to wait, is worse than the baseline's by more than the tolerance.
+*/
+
+#include "mockollamaserver.h"
+#include "ollamainterface.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+namespace
+{
+
+struct Scenario
+{
+    const char *name;
+    MockOllamaServer::Options options;
+    int runs;
+};
+
+QList<Scenario> scenarios()
+{
+    MockOllamaServer::Options steady;
+    steady.tokens = 100;
+    steady.tokensPerSecond = 100;
+    steady.firstTokenDelay = 50;
+
+    MockOllamaServer::Options jitter = steady;
+    jitter.jitter = 0.5;
+
+    MockOllamaServer::Options fragmented = steady;
+    fragmented.maxFragment = 7;
+
+    MockOllamaServer::Options flood;
+    flood.tokens = 2000;
+    flood.tokensPerSecond = 0;
+    flood.firstTokenDelay = 0;
+
+    MockOllamaServer::Options errors = steady;
+    errors.tokens = 50;
+    errors.errorRate = 0.3;
+
+    return {
+        { "steady", steady, 10 },
+        { "jitter", jitter, 10 },
+        { "fragmented", fragmented, 10 },
+        { "flood", flood, 10 },
+        { "errors", errors, 20 },
+    };
+}
+
+// CPU time of the calling thread, in microseconds
+qint64 threadCpuTime()
+{
+#if defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return qint64(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+#else
+    return 0;
+#endif
+}
+
+qint64 processCpuTime()
+{
+    return qint64(std::clock()) * 1000000 / CLOCKS_PER_SEC;
+}
+
+double percentile(QList<double> samples, double p)
+{
+    if (samples.isEmpty())
+        return 0;
+    std::sort(samples.begin(), samples.end());
+    return samples[qsizetype(p * (samples.size() - 1))];
+}
+
+QJsonObject distribution(const QList<double> &samples)
+{
+    QJsonObject result;
+    result["p50"] = percentile(samples, 0.5);
+    result["p95"] = percentile(samples, 0.95);
+    result["p99"] = percentile(samples, 0.99);
+    result["max"] = percentile(samples, 1);
+    return result;
+}
+
+struct RunResult
+{
+    bool completed = false;
+    double firstToken = -1;    // ms after the prompt was sent, -1 if nothing arrived
+    QList<double> gaps;        // ms between consecutive pieces of text reaching the client, one per received chunk
+    int deltas = 0;
+    int tokens = 0;            // as counted by the server, or the number of deltas if it didn't say
+    double streamSeconds = 0;  // first token to last
+};
+
+// sends one prompt and waits until it has been answered, failed, or given up on
+RunResult runPrompt(OllamaInterface &ollama, int session, int timeoutMs)
+{
+    RunResult result;
+    QElapsedTimer clock;
+    qint64 lastToken = 0;
+
+    QEventLoop loop;
+    QObject scope;
+    QObject::connect(&ollama, &OllamaInterface::responseReceived, &scope, [&](int, const QString &)
+    {
+        const qint64 now = clock.nsecsElapsed();
+        if (result.deltas == 0)
+            result.firstToken = now / 1e6;
+        else
+            result.gaps.append((now - lastToken) / 1e6);
+        lastToken = now;
+        ++result.deltas;
+    });
+    QObject::connect(&ollama, &OllamaInterface::requestMeasured, &scope, [&](const RequestTimings &timings)
+    {
+        result.tokens = int(timings.evalCount);
+    });
+    QObject::connect(&ollama, &OllamaInterface::responseFinished, &scope, [&](int)
+    {
+        result.completed = true;
+        loop.quit();
+    });
+    QObject::connect(&ollama, &OllamaInterface::requestError, &scope, [&]() { loop.quit(); });
+    QObject::connect(&ollama, &OllamaInterface::responseStopped, &scope, [&]() { loop.quit(); });
+    QTimer::singleShot(timeoutMs, &scope, [&]()
+    {
+        ollama.cancel(session);
+        loop.quit();
+    });
+
+    clock.start();
+    ollama.sendPrompt(session, "You are a benchmark.", "Where is room 147?");
+    loop.exec();
+
+    if (result.tokens == 0)
+        result.tokens = result.deltas;
+    if (result.deltas > 1)
+        result.streamSeconds = (lastToken / 1e6 - result.firstToken) / 1000;
+    return result;
+}
+
+QJsonObject runScenario(const Scenario &scenario, int runs)
+{
+    QThread serverThread;
+    serverThread.start();
+
+    MockOllamaServer *server = new MockOllamaServer(scenario.options);
+    server->moveToThread(&serverThread);
+
+    quint16 port = 0;
+    QMetaObject::invokeMethod(server, [server, &port]() { port = server->listen(); }, Qt::BlockingQueuedConnection);
+
+    QJsonObject result;
+    result["name"] = scenario.name;
+    if (port == 0)
+    {
+        result["error"] = "could not start the mock server";
+        serverThread.quit();
+        serverThread.wait();
+        delete server;
+        return result;
+    }
+
+    // the history is kept short so every prompt costs about the same to send
+    OllamaInterface ollama("http://127.0.0.1:" + std::to_string(port), "mock", 2048, 0);
+    const int session = ollama.openSession();
+    const int timeoutMs = scenario.options.firstTokenDelay + 30000;
+
+    // one unmeasured prompt to open the connection
+    runPrompt(ollama, session, timeoutMs);
+
+    qint64 serverCpuBefore = 0;
+    QMetaObject::invokeMethod(server, [&serverCpuBefore]() { serverCpuBefore = threadCpuTime(); },
+                              Qt::BlockingQueuedConnection);
+    const qint64 processCpuBefore = processCpuTime();
+    const qint64 mainCpuBefore = threadCpuTime();
+
+    QList<double> firstTokens;
+    QList<double> gaps;
+    QList<double> rates;
+    int tokens = 0;
+    int completed = 0;
+    for (int run = 0; run < runs; ++run)
+    {
+        const RunResult prompt = runPrompt(ollama, session, timeoutMs);
+        if (prompt.completed)
+            ++completed;
+        if (prompt.firstToken >= 0)
+            firstTokens.append(prompt.firstToken);
+        if (prompt.streamSeconds > 0)
+            rates.append((prompt.tokens - 1) / prompt.streamSeconds);
+        gaps.append(prompt.gaps);
+        tokens += prompt.tokens;
+    }
+
+    const qint64 processCpu = processCpuTime() - processCpuBefore;
+    const qint64 mainCpu = threadCpuTime() - mainCpuBefore;
+    qint64 serverCpu = 0;
+    QMetaObject::invokeMethod(
+        server, [&serverCpu, serverCpuBefore]() { serverCpu = threadCpuTime() - serverCpuBefore; },
+        Qt::BlockingQueuedConnection);
+    const qint64 clientCpu = qMax<qint64>(0, processCpu - serverCpu);
+
+    QList<double> firstTokenOverhead;
+    for (double firstToken : firstTokens)
+        firstTokenOverhead.append(firstToken - scenario.options.firstTokenDelay);
+
+    result["runs"] = runs;
+    result["completed"] = completed;
+    result["failed"] = runs - completed;
+    result["tokens"] = tokens;
+    result["ttft_ms"] = distribution(firstTokens);
+    result["ttft_overhead_ms"] = distribution(firstTokenOverhead);
+    result["inter_token_ms"] = distribution(gaps);
+    result["tokens_per_second"] = percentile(rates, 0.5);
+
+    QJsonObject cpu;
+    cpu["process_ms"] = processCpu / 1000.0;
+    cpu["client_ms"] = clientCpu / 1000.0;
+    cpu["client_main_thread_ms"] = mainCpu / 1000.0;
+    cpu["server_ms"] = serverCpu / 1000.0;
+    cpu["client_us_per_token"] = tokens > 0 ? double(clientCpu) / tokens : 0.0;
+    result["cpu"] = cpu;
+
+    QMetaObject::invokeMethod(server, [server]() { delete server; }, Qt::BlockingQueuedConnection);
+    serverThread.quit();
+    serverThread.wait();
+    return result;
+}
+
+// returns the scenarios that got worse than the baseline by more than the tolerance
+QStringList regressions(const QJsonArray &results, const QJsonArray &baseline, double tolerance)
+{
+    QStringList worse;
+    for (const QJsonValue &value : results)
+    {
+        const QJsonObject current = value.toObject();
+        for (const QJsonValue &baseValue : baseline)
+        {
+            const QJsonObject base = baseValue.toObject();
+            if (base["name"].toString() != current["name"].toString())
+                continue;
+
+            const double cpu = current["cpu"].toObject()["client_us_per_token"].toDouble();
+            const double baseCpu = base["cpu"].toObject()["client_us_per_token"].toDouble();
+            if (baseCpu > 0 && cpu > baseCpu * (1 + tolerance))
+                worse.append(current["name"].toString()
+                             + QString(": client CPU per token %1 us, baseline %2 us")
+                                   .arg(cpu, 0, 'f', 2)
+                                   .arg(baseCpu, 0, 'f', 2));
+
+            // a millisecond of slack, or scheduling noise alone would fail fast scenarios
+            const double overhead = current["ttft_overhead_ms"].toObject()["p50"].toDouble();
+            const double baseOverhead = base["ttft_overhead_ms"].toObject()["p50"].toDouble();
+            if (overhead > baseOverhead * (1 + tolerance) + 1)
+                worse.append(current["name"].toString()
+                             + QString(": time to first token overhead %1 ms, baseline %2 ms")
+                                   .arg(overhead, 0, 'f', 2)
+                                   .arg(baseOverhead, 0, 'f', 2));
+        }
+    }
+    return worse;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Streaming latency benchmark against a mock Ollama server.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "runs", "Prompts per scenario (default: per scenario).", "count" },
+        { "scenario", "Only run this scenario.", "name" },
+        { "output", "Write the JSON results to this file instead of stdout.", "file" },
+        { "baseline", "Compare against earlier results and fail on regressions.", "file" },
+        { "tolerance", "Allowed slowdown against the baseline, as a fraction.", "fraction", "0.15" },
+    });
+    parser.process(app);
+
+    QJsonArray results;
+    for (const Scenario &scenario : scenarios())
+    {
+        if (parser.isSet("scenario") && parser.value("scenario") != scenario.name)
+            continue;
+
+        const int runs = parser.isSet("runs") ? parser.value("runs").toInt() : scenario.runs;
+        const QJsonObject result = runScenario(scenario, runs);
+        results.append(result);
+
+        std::fprintf(stderr,
+                     "%-12s ttft p50 %7.2f ms  itl p99 %7.2f ms  %8.1f tok/s  client %6.2f us/token  (%d/%d ok)\n",
+                     scenario.name, result["ttft_ms"].toObject()["p50"].toDouble(),
+                     result["inter_token_ms"].toObject()["p99"].toDouble(), result["tokens_per_second"].toDouble(),
+                     result["cpu"].toObject()["client_us_per_token"].toDouble(), result["completed"].toInt(), runs);
+    }
+
+    QJsonObject report;
+    report["benchmark"] = "chat_bench";
+    report["qt"] = qVersion();
+    report["scenarios"] = results;
+    const QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet("output"))
+    {
+        QFile output(parser.value("output"));
+        if (!output.open(QIODevice::WriteOnly) || output.write(json) != json.size())
+        {
+            std::fprintf(stderr, "could not write %s\n", qPrintable(parser.value("output")));
+            return 1;
+        }
+    }
+    else
+    {
+        std::fwrite(json.constData(), 1, size_t(json.size()), stdout);
+    }
+
+    if (parser.isSet("baseline"))
+    {
+        QFile baselineFile(parser.value("baseline"));
+        if (!baselineFile.open(QIODevice::ReadOnly))
+        {
+            std::fprintf(stderr, "could not read %s\n", qPrintable(parser.value("baseline")));
+            return 1;
+        }
+
+        const QJsonArray baseline = QJsonDocument::fromJson(baselineFile.readAll()).object()["scenarios"].toArray();
+        const QStringList worse = regressions(results, baseline, parser.value("tolerance").toDouble());
+        for (const QString &line : worse)
+            std::fprintf(stderr, "regression: %s\n", qPrintable(line));
+        if (!worse.isEmpty())
+            return 2;
+    }
+    return 0;
+}
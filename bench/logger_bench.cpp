@@ -0,0 +1,94 @@
+/*
+    logger_bench.cpp
+
+    Cost of a log call on the calling thread: one below the level set at runtime, one that is written, and, for
+    comparison, the same line written the way diagnostics used to be, through an ostream flushed with std::endl. The
+    calls come in bursts that fit in a thread's ring, with a pause after each for the writer thread to drain it, as on
+    a kiosk where a reply logs a few lines at a time.
+*/
+
+#include "logger.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+
+constexpr int burst = 256; // calls, half a ring
+constexpr int bursts = 20;
+
+const QString url = "http://127.0.0.1:11434";
+
+double median(QList<double> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2];
+}
+
+// nanoseconds per call, over bursts of calls with a pause after each
+template <typename Call>
+double measure(Call call)
+{
+    QList<double> samples;
+    QElapsedTimer timer;
+    for (int i = 0; i < bursts; ++i)
+    {
+        timer.start();
+        for (int n = 0; n < burst; ++n)
+            call(n);
+        samples.append(double(timer.nsecsElapsed()) / burst);
+        QThread::msleep(150);
+    }
+    return median(samples);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QTemporaryDir directory;
+    if (!directory.isValid())
+        return 1;
+
+    QSettings settings(directory.filePath("bench.ini"), QSettings::IniFormat);
+    settings.setValue("Log/Level", "info");
+    settings.setValue("Log/Console", "off");
+    settings.setValue("Log/Path", directory.filePath("bench.log"));
+
+    double disabled = 0;
+    double written = 0;
+    {
+        Logger logger(settings);
+        disabled = measure([](int n) { LOG_DEBUG("stream.chunk", "session", 1, "stream", n, "chars", 12); });
+        written = measure([](int n)
+        {
+            LOG_INFO("request.sent", "session", 1, "stream", n, "backend", url, "bytes", 2310, "failovers", 0);
+        });
+    }
+
+    std::ofstream stream(directory.filePath("ostream.log").toStdString());
+    const double flushed = measure([&stream](int n)
+    {
+        stream << "Request " << n << " of session " << 1 << " sent to " << url.toStdString() << ", " << 2310
+               << " bytes." << std::endl;
+    });
+
+    QFile log(directory.filePath("bench.log"));
+    qsizetype lines = 0;
+    if (log.open(QIODevice::ReadOnly))
+        lines = log.readAll().count('\n');
+
+    std::printf("%-36s %10s\n", "", "ns/call");
+    std::printf("%-36s %10.1f\n", "log call below the runtime level", disabled);
+    std::printf("%-36s %10.1f\n", "log call written", written);
+    std::printf("%-36s %10.1f\n", "ostream with std::endl", flushed);
+    std::printf("%lld of %d records written\n", static_cast<long long>(lines), burst * bursts);
+    return 0;
+}
@@ -0,0 +1,159 @@
+/*
+    markdown_bench.cpp
+
+    Microbenchmark for MarkdownRenderer. Streams a synthetic Markdown answer a token at a time, the way ChatModel
+    receives it, and measures the per-token cost of turning the message so far into something a Text item can show:
+
+      - before:      QTextDocument::setMarkdown() on the whole message, which is what Text.MarkdownText does
+      - converter:   MarkdownRenderer::closedHtml() and openHtml() on their own
+      - after:       the same plus QTextDocument::setHtml() of the open block on every token, and of the finished
+                     blocks only when one is added, which is what the two Text items of the chat bubble then do
+
+    Usage: markdown_bench [tokens] [rounds]
+*/
+
+#include "markdownrenderer.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QList>
+#include <QString>
+#include <QTextDocument>
+#include <iostream>
+
+namespace
+{
+
+// shaped like a directions answer, with every kind of block the renderer knows
+const char *const answerLines[] = {
+    "## Getting to room 147\n",
+    "\n",
+    "From the **main entrance**, walk past the *information desk* and follow the signs to the ~~old~~ new wing.\n",
+    "\n",
+    "1. Turn left at the `T-junction` by the vending machines.\n",
+    "2. Take the stairs to the **second floor**.\n",
+    "3. Room 147 is the third door on the right, opposite the notice board.\n",
+    "\n",
+    "> The east stairwell is closed for repairs until Friday,\n",
+    "so use the lifts instead.\n",
+    "\n",
+    "- Lifts: next to the café\n",
+    "- Toilets: opposite room 140\n",
+    "\n",
+    "See [the campus map](https://example.edu/map?building=C&floor=2) for details.\n",
+    "\n",
+    "```\n",
+    "Building C, floor 2, room 147 <east wing>\n",
+    "```\n",
+    "\n",
+    "---\n",
+    "\n",
+};
+
+// splits the answer before every space and around every newline, roughly how the model's tokens fall
+QList<QString> buildTokens(int tokens)
+{
+    QList<QString> result;
+    const int lineCount = int(sizeof(answerLines) / sizeof(answerLines[0]));
+    for (int line = 0; result.size() < tokens; line = (line + 1) % lineCount)
+    {
+        const QString text = QString::fromUtf8(answerLines[line]);
+        qsizetype start = 0;
+        for (qsizetype i = 1; i <= text.size(); ++i)
+        {
+            if (i == text.size() || text[i] == u' ' || text[i] == u'\n' || text[i - 1] == u'\n')
+            {
+                result.append(text.sliced(start, i - start));
+                start = i;
+            }
+        }
+    }
+    result.resize(tokens);
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    // QTextDocument needs fonts, but not a screen
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QGuiApplication app(argc, argv);
+
+    const int tokens = argc > 1 ? QByteArray(argv[1]).toInt() : 4096;
+    const int rounds = argc > 2 ? QByteArray(argv[2]).toInt() : 1;
+    const QList<QString> stream = buildTokens(tokens);
+
+    // rendering as it streams has to end up where rendering the finished message does
+    MarkdownRenderer incremental;
+    QString whole;
+    for (const QString &token : stream)
+    {
+        incremental.append(token);
+        incremental.html();
+        whole += token;
+    }
+    MarkdownRenderer once;
+    once.append(whole);
+    if (incremental.html() != once.html())
+    {
+        std::cerr << "Streamed rendering does not match rendering the whole message at once." << std::endl;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    qint64 beforeNs = 0;
+    qint64 converterNs = 0;
+    qint64 afterNs = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        QTextDocument document;
+        QString text;
+        timer.start();
+        for (const QString &token : stream)
+        {
+            text += token;
+            document.setMarkdown(text);
+        }
+        beforeNs += timer.nsecsElapsed();
+
+        MarkdownRenderer renderer;
+        timer.start();
+        for (const QString &token : stream)
+        {
+            renderer.append(token);
+            renderer.closedHtml();
+            renderer.openHtml();
+        }
+        converterNs += timer.nsecsElapsed();
+
+        renderer.clear();
+        QTextDocument closedDocument;
+        qsizetype closedSize = 0;
+        timer.start();
+        for (const QString &token : stream)
+        {
+            renderer.append(token);
+            const QString &closed = renderer.closedHtml();
+            if (closed.size() != closedSize)
+            {
+                closedSize = closed.size();
+                closedDocument.setHtml(closed);
+            }
+            document.setHtml(renderer.openHtml());
+        }
+        afterNs += timer.nsecsElapsed();
+    }
+
+    const double perTokenBefore = double(beforeNs) / rounds / tokens / 1000;
+    const double perTokenConverter = double(converterNs) / rounds / tokens / 1000;
+    const double perTokenAfter = double(afterNs) / rounds / tokens / 1000;
+
+    std::cout << "tokens per run:               " << tokens << " (" << whole.size() << " characters)" << std::endl;
+    std::cout << "setMarkdown on whole message: " << perTokenBefore << " us/token" << std::endl;
+    std::cout << "closedHtml and openHtml:      " << perTokenConverter << " us/token" << std::endl;
+    std::cout << "plus setHtml of what changed: " << perTokenAfter << " us/token" << std::endl;
+    std::cout << "speedup:                      " << perTokenBefore / perTokenAfter << "x" << std::endl;
+    return 0;
+}
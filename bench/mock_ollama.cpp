@@ -0,0 +1,59 @@
+/*
+    mock_ollama.cpp
+
+    Runs MockOllamaServer on its own, so the app (or curl) can be pointed at a server whose speed and failures are
+    under control. For example, to try the stop button and the idle timeout against a slow, stuttering server:
+
+        mock_ollama --port 11435 --rate 5 --jitter 0.8 --first-token-ms 3000
+
+    With --tool-calls it calls every tool the app offers before answering. Setting Tools/WebSearchURL to
+    http://127.0.0.1:11435/api/web_search points the web search tool at the canned results here as well.
+*/
+
+#include "mockollamaserver.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <cstdio>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Stand-in Ollama server for benchmarks and manual testing.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "port", "Port to listen on.", "port", "11435" },
+        { "tokens", "Tokens per answer.", "count", "200" },
+        { "rate", "Tokens per second (0 = as fast as possible).", "rate", "50" },
+        { "first-token-ms", "Delay before the first token.", "ms", "100" },
+        { "jitter", "Fraction by which each gap between tokens varies either way.", "fraction", "0" },
+        { "fragment", "Split lines into random pieces of up to this many bytes (0 = whole lines).", "bytes", "0" },
+        { "error-rate", "Fraction of chat requests that fail.", "fraction", "0" },
+        { "seed", "Random seed.", "seed", "1" },
+        { "tool-calls", "Call the tools a request offers before answering." },
+    });
+    parser.process(app);
+
+    MockOllamaServer::Options options;
+    options.tokens = parser.value("tokens").toInt();
+    options.tokensPerSecond = parser.value("rate").toDouble();
+    options.firstTokenDelay = parser.value("first-token-ms").toInt();
+    options.jitter = parser.value("jitter").toDouble();
+    options.maxFragment = parser.value("fragment").toInt();
+    options.errorRate = parser.value("error-rate").toDouble();
+    options.seed = parser.value("seed").toUInt();
+    options.toolCalls = parser.isSet("tool-calls");
+
+    MockOllamaServer server(options);
+    const quint16 port = server.listen(quint16(parser.value("port").toUInt()));
+    if (port == 0)
+    {
+        std::fprintf(stderr, "could not listen on port %s\n", qPrintable(parser.value("port")));
+        return 1;
+    }
+
+    std::printf("mock Ollama server on http://127.0.0.1:%u\n", unsigned(port));
+    std::fflush(stdout);
+    return app.exec();
+}
@@ -0,0 +1,401 @@
+/*
+    mockollamaserver.cpp
+
+    Class implementation for MockOllamaServer.
+*/
+
+#include "mockollamaserver.h"
+#include <QDateTime>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+
+namespace
+{
+
+// a mix of plain words, escapes and multi-byte characters, so the client's decoder has some work to do
+const char *const words[] = {
+    "The ", "room ", "is ", "on ", "the ", "left, ", "past ", "the ", "\"big ", "screen\" ", "and ", "the ",
+    "stairs.", "\n\n", "Café ", "hours: ", "8–6 ", "**daily** ", "— ", "ask ", "at ", "the ", "front ", "desk.\n",
+};
+constexpr int wordCount = int(sizeof(words) / sizeof(words[0]));
+
+QByteArray statusText(int status)
+{
+    switch (status)
+    {
+    case 200:
+        return "OK";
+    case 404:
+        return "Not Found";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+} // namespace
+
+MockOllamaServer::MockOllamaServer(const Options &options, QObject *parent)
+    : QObject(parent), options(options), server(this), random(options.seed), chatCount(0), errorCount(0)
+{
+    // the listening socket is a child, so it moves along when the server is run on its own thread
+    connect(&server, &QTcpServer::newConnection, this, &MockOllamaServer::onNewConnection);
+}
+
+quint16 MockOllamaServer::listen(quint16 port)
+{
+    if (!server.listen(QHostAddress::LocalHost, port))
+        return 0;
+    return server.serverPort();
+}
+
+int MockOllamaServer::chatRequests() const
+{
+    return chatCount;
+}
+
+int MockOllamaServer::injectedErrors() const
+{
+    return errorCount;
+}
+
+void MockOllamaServer::onNewConnection()
+{
+    while (QTcpSocket *socket = server.nextPendingConnection())
+    {
+        // every token goes out on its own rather than waiting to be coalesced
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        Connection &connection = connections[socket];
+        connection.timer = new QTimer(socket);
+        connection.timer->setSingleShot(true);
+        connection.timer->setTimerType(Qt::PreciseTimer);
+
+        connect(connection.timer, &QTimer::timeout, this, [this, socket]() { sendNextToken(socket); });
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]()
+        {
+            connections.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+void MockOllamaServer::onReadyRead(QTcpSocket *socket)
+{
+    auto connection = connections.find(socket);
+    if (connection == connections.end())
+        return;
+
+    connection->buffer += socket->readAll();
+
+    // one request at a time per connection; the next one is picked up when the stream ends
+    while (!connection->streaming)
+    {
+        const qsizetype headerEnd = connection->buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0)
+            return;
+
+        const QList<QByteArray> lines = connection->buffer.left(headerEnd).split('\n');
+        const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        qsizetype contentLength = 0;
+        for (qsizetype i = 1; i < lines.size(); ++i)
+        {
+            const qsizetype colon = lines[i].indexOf(':');
+            if (colon > 0 && lines[i].left(colon).trimmed().toLower() == "content-length")
+                contentLength = lines[i].mid(colon + 1).trimmed().toLongLong();
+        }
+
+        if (connection->buffer.size() < headerEnd + 4 + contentLength)
+            return;
+
+        const QByteArray body = connection->buffer.mid(headerEnd + 4, contentLength);
+        connection->buffer.remove(0, headerEnd + 4 + contentLength);
+
+        handleRequest(socket, requestLine.value(0), requestLine.value(1), body);
+
+        // handling the request may have dropped the connection
+        connection = connections.find(socket);
+        if (connection == connections.end())
+            return;
+    }
+}
+
+void MockOllamaServer::handleRequest(QTcpSocket *socket, const QByteArray &method, const QByteArray &path,
+                                     const QByteArray &body)
+{
+    if (method == "GET" && path == "/api/version")
+    {
+        writeResponse(socket, 200, "application/json", R"({"version":"0.0.0-mock"})");
+        return;
+    }
+
+    if (method == "POST" && path == "/api/embed")
+    {
+        const QJsonArray input = QJsonDocument::fromJson(body).object()["input"].toArray();
+        QJsonArray vector;
+        for (int i = 0; i < 8; ++i)
+            vector.append(i == 0 ? 1.0 : 0.0);
+
+        QJsonArray embeddings;
+        for (qsizetype i = 0; i < input.size(); ++i)
+            embeddings.append(vector);
+
+        QJsonObject response;
+        response["embeddings"] = embeddings;
+        writeResponse(socket, 200, "application/json", QJsonDocument(response).toJson(QJsonDocument::Compact));
+        return;
+    }
+
+    if (method == "POST" && path == "/api/web_search")
+    {
+        const QString query = QJsonDocument::fromJson(body).object()["query"].toString();
+        QJsonObject result;
+        result["title"] = "Mock result for " + query;
+        result["url"] = "https://example.com/search?q=" + QString::fromUtf8(QUrl::toPercentEncoding(query));
+        result["content"] = "A stand-in search result about " + query + ".";
+
+        QJsonObject response;
+        response["results"] = QJsonArray{ result };
+        writeResponse(socket, 200, "application/json", QJsonDocument(response).toJson(QJsonDocument::Compact));
+        return;
+    }
+
+    if (method == "POST" && path == "/api/chat")
+    {
+        startChat(socket, body);
+        return;
+    }
+
+    writeResponse(socket, 404, "text/plain", "404 page not found");
+}
+
+void MockOllamaServer::startChat(QTcpSocket *socket, const QByteArray &body)
+{
+    const QJsonObject request = QJsonDocument::fromJson(body).object();
+    model = request["model"].toString().toUtf8();
+
+    // a request without messages only loads the model
+    if (request["messages"].toArray().isEmpty())
+    {
+        QJsonObject response;
+        response["model"] = QString::fromUtf8(model);
+        response["done"] = true;
+        response["done_reason"] = "load";
+        writeResponse(socket, 200, "application/json", QJsonDocument(response).toJson(QJsonDocument::Compact));
+        return;
+    }
+
+    ++chatCount;
+
+    // a request carrying tool results has the tool role last, and gets answered
+    const QJsonArray tools = request["tools"].toArray();
+    const QString lastRole = request["messages"].toArray().last().toObject()["role"].toString();
+    if (options.toolCalls && !tools.isEmpty() && lastRole == "user")
+    {
+        callTools(socket, tools);
+        return;
+    }
+
+    Failure failure = NoFailure;
+    if (options.errorRate > 0 && random.generateDouble() < options.errorRate)
+    {
+        failure = Failure(ServerError + random.bounded(3));
+        ++errorCount;
+    }
+
+    if (failure == ServerError)
+    {
+        writeResponse(socket, 500, "application/json", R"({"error":"mock server error"})");
+        return;
+    }
+
+    // the mid-stream failures happen halfway through the answer
+    Connection &connection = connections[socket];
+    connection.streaming = true;
+    connection.tokensLeft = failure == NoFailure ? options.tokens : qMax(1, options.tokens / 2);
+    connection.tokensSent = 0;
+    connection.failure = failure;
+
+    socket->write("HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\nTransfer-Encoding: chunked\r\n\r\n");
+    socket->flush();
+    connection.timer->start(options.firstTokenDelay);
+}
+
+void MockOllamaServer::sendNextToken(QTcpSocket *socket)
+{
+    auto connection = connections.find(socket);
+    if (connection == connections.end() || !connection->streaming)
+        return;
+
+    // the rest of a fragmented line goes first, one piece per pass through the event loop
+    if (!connection->pieces.isEmpty())
+    {
+        writeChunk(socket, connection->pieces.takeFirst());
+        connection->timer->start(connection->pieces.isEmpty() ? connection->delayAfterLine : 0);
+        return;
+    }
+
+    if (connection->tokensLeft == 0)
+    {
+        finishChat(socket);
+        return;
+    }
+
+    --connection->tokensLeft;
+    const QString word = QString::fromUtf8(words[connection->tokensSent++ % wordCount]);
+    writeLine(socket, tokenLine(word), connection->tokensLeft > 0 ? nextDelay() : 0);
+}
+
+void MockOllamaServer::finishChat(QTcpSocket *socket)
+{
+    Connection &connection = connections[socket];
+    if (connection.failure == Disconnect)
+    {
+        socket->abort();
+        return;
+    }
+
+    if (connection.failure == ErrorLine)
+    {
+        writeChunk(socket, R"({"error":"mock error partway through the answer"})" "\n");
+    }
+    else
+    {
+        writeChunk(socket, doneLine(connection.tokensSent));
+    }
+
+    socket->write("0\r\n\r\n");
+    socket->flush();
+    connection.streaming = false;
+
+    // a request that arrived while this one was streaming
+    if (!connection.buffer.isEmpty())
+        QMetaObject::invokeMethod(this, [this, socket]() { onReadyRead(socket); }, Qt::QueuedConnection);
+}
+
+void MockOllamaServer::callTools(QTcpSocket *socket, const QJsonArray &tools)
+{
+    QJsonArray calls;
+    for (const QJsonValue &tool : tools)
+    {
+        const QJsonObject function = tool["function"].toObject();
+        const QJsonObject properties = function["parameters"]["properties"].toObject();
+
+        QJsonObject arguments;
+        for (auto property = properties.begin(); property != properties.end(); ++property)
+        {
+            if (property.value()["type"].toString() == "string")
+                arguments[property.key()] = "147";
+        }
+
+        QJsonObject call;
+        call["function"] = QJsonObject{ { "name", function["name"] }, { "arguments", arguments } };
+        calls.append(call);
+    }
+
+    // the calls come in one line of their own, as Ollama sends them, followed by the done line
+    QJsonObject message;
+    message["role"] = "assistant";
+    message["content"] = "";
+    message["tool_calls"] = calls;
+
+    QJsonObject line;
+    line["model"] = QString::fromUtf8(model);
+    line["created_at"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+    line["message"] = message;
+    line["done"] = false;
+
+    socket->write("HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\nTransfer-Encoding: chunked\r\n\r\n");
+    writeChunk(socket, QJsonDocument(line).toJson(QJsonDocument::Compact) + "\n");
+    writeChunk(socket, doneLine(1));
+    socket->write("0\r\n\r\n");
+    socket->flush();
+}
+
+QByteArray MockOllamaServer::doneLine(int tokens) const
+{
+    // the timings are made up, but in the same shape as the real ones
+    QJsonObject message;
+    message["role"] = "assistant";
+    message["content"] = "";
+
+    QJsonObject line;
+    line["model"] = QString::fromUtf8(model);
+    line["created_at"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+    line["message"] = message;
+    line["done"] = true;
+    line["done_reason"] = "stop";
+    line["total_duration"] = qint64(tokens) * 20000000;
+    line["load_duration"] = 0;
+    line["prompt_eval_count"] = 32;
+    line["prompt_eval_duration"] = 1000000;
+    line["eval_count"] = tokens;
+    line["eval_duration"] = qint64(tokens) * 20000000;
+    return QJsonDocument(line).toJson(QJsonDocument::Compact) + "\n";
+}
+
+QByteArray MockOllamaServer::tokenLine(const QString &content) const
+{
+    QJsonObject message;
+    message["role"] = "assistant";
+    message["content"] = content;
+
+    QJsonObject line;
+    line["model"] = QString::fromUtf8(model);
+    line["created_at"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODateWithMs);
+    line["message"] = message;
+    line["done"] = false;
+    return QJsonDocument(line).toJson(QJsonDocument::Compact) + "\n";
+}
+
+void MockOllamaServer::writeResponse(QTcpSocket *socket, int status, const QByteArray &contentType,
+                                     const QByteArray &body)
+{
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + ' ' + statusText(status) + "\r\n";
+    response += "Content-Type: " + contentType + "\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n";
+    response += body;
+    socket->write(response);
+    socket->flush();
+}
+
+void MockOllamaServer::writeChunk(QTcpSocket *socket, const QByteArray &data)
+{
+    socket->write(QByteArray::number(data.size(), 16) + "\r\n" + data + "\r\n");
+    socket->flush();
+}
+
+void MockOllamaServer::writeLine(QTcpSocket *socket, const QByteArray &line, int delayAfter)
+{
+    Connection &connection = connections[socket];
+    if (options.maxFragment <= 0)
+    {
+        writeChunk(socket, line);
+        connection.timer->start(delayAfter);
+        return;
+    }
+
+    // split at random points, each piece its own HTTP chunk and its own write, so the client reads lines in pieces
+    for (qsizetype at = 0; at < line.size();)
+    {
+        const qsizetype piece = qMin<qsizetype>(line.size() - at, 1 + random.bounded(options.maxFragment));
+        connection.pieces.append(line.mid(at, piece));
+        at += piece;
+    }
+    connection.delayAfterLine = delayAfter;
+    sendNextToken(socket);
+}
+
+int MockOllamaServer::nextDelay()
+{
+    if (options.tokensPerSecond <= 0)
+        return 0;
+
+    const double gap = 1000.0 / options.tokensPerSecond;
+    const double varied = gap * (1 + options.jitter * (2 * random.generateDouble() - 1));
+    return qMax(0, int(varied + 0.5));
+}
@@ -0,0 +1,107 @@
+/*
+    mockollamaserver.h
+
+    Class declaration for MockOllamaServer.
+*/
+
+#ifndef MOCKOLLAMASERVER_H
+#define MOCKOLLAMASERVER_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QRandomGenerator>
+#include <QTcpServer>
+
+class QJsonArray;
+class QTcpSocket;
+class QTimer;
+
+/*
+    MockOllamaServer
+
+    A stand-in for an Ollama server, for benchmarking the client without a model. It answers GET /api/version,
+    POST /api/embed with zero vectors, POST /api/web_search with canned results, and POST /api/chat by streaming
+    NDJSON lines in the same shape Ollama sends, with a chunked transfer encoding on a keep-alive connection.
+
+    With toolCalls set, a chat request that offers tools and ends in a user message is answered by calling every tool
+    once, each string argument set to "147"; the request with the results then gets an ordinary answer.
+
+    How the stream behaves is set through Options: the time to the first token, the token rate and its jitter, how
+    the lines are broken up across writes, and how often a request fails (an HTTP 500, an error line, or the
+    connection dropping partway through the answer).
+*/
+class MockOllamaServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options
+    {
+        int tokens = 200;            // tokens per answer
+        double tokensPerSecond = 50; // 0 = as fast as possible
+        int firstTokenDelay = 100;   // ms before the first token
+        double jitter = 0;           // each gap between tokens varies by up to this fraction either way
+        int maxFragment = 0;         // > 0: lines are written in random pieces of 1 to maxFragment bytes
+        double errorRate = 0;        // fraction of chat requests that fail, spread over the three kinds of failure
+        bool toolCalls = false;      // call the tools a request offers before answering
+        quint32 seed = 1;
+    };
+
+    explicit MockOllamaServer(const Options &options, QObject *parent = nullptr);
+
+    /*
+        Starts listening on the loopback interface. A port of 0 picks a free one. Returns the port, or 0 on failure.
+    */
+    quint16 listen(quint16 port = 0);
+
+    int chatRequests() const;
+    int injectedErrors() const;
+
+private:
+    enum Failure
+    {
+        NoFailure,
+        ServerError, // HTTP 500 before anything is streamed
+        ErrorLine,   // an {"error": ...} line partway through the stream
+        Disconnect   // the connection drops partway through the stream
+    };
+
+    struct Connection
+    {
+        QByteArray buffer; // request bytes not yet handled
+        QTimer *timer = nullptr;
+        bool streaming = false;
+        int tokensLeft = 0;
+        int tokensSent = 0;
+        Failure failure = NoFailure;
+        QList<QByteArray> pieces; // the rest of a fragmented line
+        int delayAfterLine = 0;   // ms to wait once the pieces are out
+    };
+
+    void onNewConnection();
+    void onReadyRead(QTcpSocket *socket);
+    void handleRequest(QTcpSocket *socket, const QByteArray &method, const QByteArray &path, const QByteArray &body);
+    void startChat(QTcpSocket *socket, const QByteArray &body);
+    void sendNextToken(QTcpSocket *socket);
+    void finishChat(QTcpSocket *socket);
+    void callTools(QTcpSocket *socket, const QJsonArray &tools);
+    QByteArray tokenLine(const QString &content) const;
+    QByteArray doneLine(int tokens) const;
+
+    void writeResponse(QTcpSocket *socket, int status, const QByteArray &contentType, const QByteArray &body);
+    void writeChunk(QTcpSocket *socket, const QByteArray &data);
+    void writeLine(QTcpSocket *socket, const QByteArray &line, int delayAfter);
+    int nextDelay();
+
+    Options options;
+    QTcpServer server;
+    QHash<QTcpSocket *, Connection> connections;
+    QRandomGenerator random;
+    QByteArray model;
+    int chatCount;
+    int errorCount;
+};
+
+#endif // MOCKOLLAMASERVER_H
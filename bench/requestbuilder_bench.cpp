@@ -0,0 +1,112 @@
+/*
+    requestbuilder_bench.cpp
+
+    Cost of building the body of a chat request as a conversation grows to a thousand turns: encoding the whole
+    history as a QJsonDocument on every turn, as requests used to be built, compared with copying the history
+    ContextManager keeps encoded behind a request head encoded once.
+*/
+
+#include "contextmanager.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+
+constexpr int builds = 50; // per size, for each way of building
+
+// about the length of a question to the kiosk and of its answer
+const QString question = "Where is the nearest bathroom to room 147, and is it accessible by wheelchair?";
+const QString answer = QString("Go down the hallway to the east, past the stairs, and it is the second door on "
+                               "your left. ").repeated(4);
+
+double median(QList<qint64> samples)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples[samples.size() / 2] / 1000.0;
+}
+
+QByteArray encodedRequest(const ContextManager &context)
+{
+    QJsonObject options;
+    options["num_ctx"] = context.getContextSize();
+
+    QJsonObject json;
+    json["model"] = "llama3.2";
+    json["messages"] = context.messages();
+    json["stream"] = true;
+    json["options"] = options;
+    json["keep_alive"] = "30m";
+    return QJsonDocument(json).toJson(QJsonDocument::Compact);
+}
+
+QByteArray concatenatedRequest(const QByteArray &head, const ContextManager &context)
+{
+    QByteArray body;
+    body.reserve(head.size() + context.encodedSize() + 1);
+    body += head;
+    context.appendMessages(body);
+    body += '}';
+    return body;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    // large enough that nothing is trimmed, so every turn adds to what has to be sent
+    ContextManager context(100000000);
+    context.setSystemPrompt("You are Zippy, the guide on the screen in the lobby of the engineering building.");
+
+    const QByteArray head = R"({"keep_alive":"30m","model":"llama3.2","options":{"num_ctx":100000000},"stream":true,)"
+                            R"("messages":)";
+
+    std::printf("%8s %12s %16s %16s %14s\n", "turns", "body (KB)", "re-encode (us)", "concatenate (us)",
+                "add turn (us)");
+    int turns = 0;
+    for (int target : { 10, 50, 100, 250, 500, 1000 })
+    {
+        QList<qint64> addSamples;
+        QElapsedTimer timer;
+        for (; turns < target; ++turns)
+        {
+            timer.start();
+            context.addMessage("user", question);
+            context.addMessage("assistant", answer);
+            addSamples.append(timer.nsecsElapsed());
+        }
+
+        // both ways have to produce the same messages
+        QByteArray messages;
+        context.appendMessages(messages);
+        if (messages != QJsonDocument(context.messages()).toJson(QJsonDocument::Compact))
+        {
+            std::fprintf(stderr, "the encoded history differs from the history encoded in one go\n");
+            return 1;
+        }
+
+        QList<qint64> encodeSamples;
+        QList<qint64> concatenateSamples;
+        qsizetype size = 0;
+        for (int i = 0; i < builds; ++i)
+        {
+            timer.start();
+            size = encodedRequest(context).size();
+            encodeSamples.append(timer.nsecsElapsed());
+
+            timer.start();
+            size = concatenatedRequest(head, context).size();
+            concatenateSamples.append(timer.nsecsElapsed());
+        }
+
+        std::printf("%8d %12.1f %16.1f %16.1f %14.1f\n", target, size / 1024.0, median(encodeSamples),
+                    median(concatenateSamples), median(addSamples));
+    }
+    return 0;
+}
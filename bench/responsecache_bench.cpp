@@ -0,0 +1,137 @@
+/*
+    responsecache_bench.cpp
+
+    Cost of ResponseCache inserts and lookups while the cache is filled to several times its size cap, so most
+    inserts append and some compact the file. After every insert the new entry has to be found with the text it was
+    given, and at the end every entry still in the cache, read once more after reopening the file, has to match what
+    was inserted under its key. Exits with 1 on a mismatch.
+*/
+
+#include "responsecache.h"
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QRandomGenerator>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <cstdio>
+
+namespace
+{
+
+constexpr qint64 maxBytes = 256 * 1024;
+constexpr int inserts = 2000;
+
+double percentile(QList<qint64> samples, double p)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples[qsizetype(p * (samples.size() - 1))] / 1000.0;
+}
+
+double mean(const QList<qint64> &samples)
+{
+    qint64 total = 0;
+    for (qint64 sample : samples)
+        total += sample;
+    return total / 1000.0 / samples.size();
+}
+
+QByteArray keyFor(int i)
+{
+    return ResponseCache::makeKey("bench", "{}", "[]", QString("question %1").arg(i));
+}
+
+// answers of 50 bytes to 4 KB, so records of different sizes end up next to each other
+QString responseFor(int i, QRandomGenerator &random)
+{
+    return QString("answer %1 ").arg(i).repeated(int(random.bounded(5, 400)));
+}
+
+// every entry the cache still has must be the one inserted last under its key
+bool matches(ResponseCache &cache, const QHash<QByteArray, QString> &inserted, int &found)
+{
+    found = 0;
+    for (auto entry = inserted.constBegin(); entry != inserted.constEnd(); ++entry)
+    {
+        QString response;
+        if (!cache.lookup(entry.key(), response))
+            continue;
+        if (response != entry.value())
+            return false;
+        ++found;
+    }
+    return found == cache.entries();
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QRandomGenerator random(1234);
+
+    QTemporaryDir dir;
+    const QString path = dir.filePath("responses.cache");
+
+    ResponseCache cache;
+    if (!dir.isValid() || !cache.open(path, maxBytes, 0))
+        return 1;
+
+    QHash<QByteArray, QString> inserted;
+    QList<qint64> insertSamples;
+    QList<qint64> lookupSamples;
+    int compactions = 0;
+    QElapsedTimer timer;
+    for (int i = 0; i < inserts; ++i)
+    {
+        // every tenth insert replaces an earlier answer
+        const int question = i % 10 == 9 ? int(random.bounded(i)) : i;
+        const QByteArray key = keyFor(question);
+        const QString response = responseFor(i, random);
+        const int before = cache.entries();
+
+        timer.start();
+        cache.insert(key, response);
+        insertSamples.append(timer.nsecsElapsed());
+        inserted.insert(key, response);
+
+        if (!cache.isOpen())
+        {
+            std::fprintf(stderr, "the cache closed itself after insert %d\n", i);
+            return 1;
+        }
+        if (cache.entries() < before)
+            ++compactions;
+
+        QString found;
+        timer.start();
+        const bool hit = cache.lookup(key, found);
+        lookupSamples.append(timer.nsecsElapsed());
+        if (!hit || found != response)
+        {
+            std::fprintf(stderr, "insert %d can't be read back\n", i);
+            return 1;
+        }
+    }
+
+    int found = 0;
+    if (!matches(cache, inserted, found))
+    {
+        std::fprintf(stderr, "an entry differs from what was inserted under its key\n");
+        return 1;
+    }
+
+    const int entries = cache.entries();
+    cache.close();
+    if (!cache.open(path, maxBytes, 0) || cache.entries() != entries || !matches(cache, inserted, found))
+    {
+        std::fprintf(stderr, "the entries differ after reopening the cache\n");
+        return 1;
+    }
+
+    std::printf("%8s %12s %10s %12s %12s %12s %12s\n", "inserts", "compactions", "entries", "insert (us)",
+                "p99 (us)", "max (us)", "lookup (us)");
+    std::printf("%8d %12d %10d %12.1f %12.1f %12.1f %12.1f\n", inserts, compactions, entries, mean(insertSamples),
+                percentile(insertSamples, 0.99), percentile(insertSamples, 1), mean(lookupSamples));
+    return 0;
+}
@@ -0,0 +1,127 @@
+/*
+    retrieval_bench.cpp
+
+    Query latency of RetrievalIndex::search over synthetic indexes of 10k to 100k chunks, compared with a plain
+    scalar scan over the same vectors.
+*/
+
+#include "retrievalindex.h"
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <utility>
+#include <cstdio>
+
+namespace
+{
+
+constexpr int dimension = 768; // nomic-embed-text
+constexpr int topK = 3;
+constexpr int queries = 200;
+
+QList<float> randomVector(QRandomGenerator &random)
+{
+    QList<float> vector(dimension);
+    for (float &value : vector)
+        value = float(random.generateDouble() * 2 - 1);
+    return vector;
+}
+
+// the straightforward version: one scalar dot product per chunk, then a full sort
+int scalarBest(const RetrievalIndex &index, const QList<float> &query)
+{
+    QList<std::pair<float, int>> scores(index.size());
+    for (int chunk = 0; chunk < index.size(); ++chunk)
+    {
+        const float *vector = index.vector(chunk);
+        float score = 0;
+        for (int i = 0; i < dimension; ++i)
+            score += query[i] * vector[i];
+        scores[chunk] = { score, chunk };
+    }
+    std::sort(scores.begin(), scores.end(), [](const auto &a, const auto &b) { return a.first > b.first; });
+    return scores.first().second;
+}
+
+double percentile(QList<qint64> samples, double p)
+{
+    std::sort(samples.begin(), samples.end());
+    return samples[qsizetype(p * (samples.size() - 1))] / 1000.0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QRandomGenerator random(1234);
+    const QString path = QDir(QDir::tempPath()).filePath("zippy_retrieval_bench.index");
+
+    std::printf("%10s %12s %12s %12s %14s\n", "chunks", "mean (us)", "p50 (us)", "p99 (us)", "scalar (us)");
+    for (int chunks : { 10000, 25000, 50000, 100000 })
+    {
+        QList<RetrievalIndex::Entry> entries;
+        entries.reserve(chunks);
+        for (int i = 0; i < chunks; ++i)
+        {
+            const QByteArray text = "chunk " + QByteArray::number(i);
+            entries.append({ QCryptographicHash::hash(text, QCryptographicHash::Sha1), QString::fromUtf8(text),
+                             randomVector(random) });
+        }
+        if (!RetrievalIndex::write(path, dimension, entries))
+            return 1;
+        entries.clear();
+
+        RetrievalIndex index;
+        if (!index.open(path))
+            return 1;
+
+        // a query close to a known chunk, so the result can be checked against the scalar scan
+        QList<QList<float>> queryVectors;
+        for (int i = 0; i < queries; ++i)
+        {
+            const float *target = index.vector(int(random.bounded(chunks)));
+            QList<float> query(target, target + dimension);
+            for (float &value : query)
+                value += float(random.generateDouble() * 0.01);
+            queryVectors.append(query);
+        }
+
+        QList<qint64> samples;
+        QElapsedTimer timer;
+        for (const QList<float> &query : queryVectors)
+        {
+            timer.start();
+            const QList<RetrievalIndex::Match> matches = index.search(query.constData(), topK);
+            samples.append(timer.nsecsElapsed());
+
+            if (matches.isEmpty() || matches.first().chunk != scalarBest(index, query))
+            {
+                std::fprintf(stderr, "search result differs from the scalar scan\n");
+                return 1;
+            }
+        }
+
+        QList<qint64> scalarSamples;
+        for (int i = 0; i < 20; ++i)
+        {
+            timer.start();
+            scalarBest(index, queryVectors[i]);
+            scalarSamples.append(timer.nsecsElapsed());
+        }
+
+        qint64 total = 0;
+        for (qint64 sample : samples)
+            total += sample;
+
+        std::printf("%10d %12.1f %12.1f %12.1f %14.1f\n", chunks, total / 1000.0 / samples.size(),
+                    percentile(samples, 0.5), percentile(samples, 0.99), percentile(scalarSamples, 0.5));
+        index.close();
+    }
+
+    QFile::remove(path);
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+    streamparser_bench.cpp
+
+    Microbenchmark for StreamParser. Builds a synthetic /api/chat stream shaped like what Ollama sends while
+    generating, then measures the per-token cost of decoding it:
+
+      - baseline:  the old approach, one QJsonDocument per line, given whole lines (its best case)
+      - parser:    StreamParser fed the same bytes in randomly sized network-like fragments
+
+    Usage: streamparser_bench [tokens] [rounds]
+*/
+
+#include "streamparser.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QRandomGenerator>
+#include <QString>
+#include <iostream>
+
+namespace
+{
+
+const char *const words[] = {
+    "Room", " 147", ":", " Turn", " around", " from", " the", " big", " screen", ".", "\\n", " Walk", " to", " the",
+    " T", "-junction", " and", " turn", " left", ".", " \\\"Straight\\\"", " ahead", " \\u00e9", " \\ud83d\\ude00",
+};
+
+QByteArray buildStream(int tokens)
+{
+    QByteArray stream;
+    const int wordCount = int(sizeof(words) / sizeof(words[0]));
+    for (int i = 0; i < tokens; ++i)
+    {
+        stream += R"({"model":"qwen3:4b","created_at":"2025-11-23T18:08:36.123456789Z",)"
+                  R"("message":{"role":"assistant","content":")";
+        stream += words[i % wordCount];
+        stream += "\"},\"done\":false}\n";
+    }
+    stream += R"({"model":"qwen3:4b","created_at":"2025-11-23T18:08:40.123456789Z",)"
+              R"("message":{"role":"assistant","content":""},)"
+              R"("done_reason":"stop","done":true,"total_duration":4244123456,"load_duration":21354167,)"
+              R"("prompt_eval_count":812,"prompt_eval_duration":402345000,"eval_count":)"
+              + QByteArray::number(tokens) + R"(,"eval_duration":3812345678})" + "\n";
+    return stream;
+}
+
+// the decoding that onPromptReply used to do, minus the signal emission
+QString runBaseline(const QList<QByteArray> &lines)
+{
+    QString total;
+    for (const QByteArray &line : lines)
+    {
+        if (line.trimmed().isEmpty())
+            continue;
+
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject())
+            continue;
+
+        QJsonObject obj = doc.object();
+        if (obj.contains("message"))
+        {
+            QJsonObject messageObj = obj["message"].toObject();
+            if (messageObj["role"].toString() == "assistant")
+                total += messageObj["content"].toString();
+        }
+        if (obj.contains("done") && obj["done"].toBool())
+            break;
+    }
+    return total;
+}
+
+QString runParser(const QByteArray &stream, const QList<qsizetype> &fragments, qint64 &evalCount)
+{
+    StreamParser parser;
+    StreamEvent event;
+    QString total;
+
+    qsizetype offset = 0;
+    for (qsizetype size : fragments)
+    {
+        parser.append(QByteArrayView(stream).sliced(offset, size));
+        offset += size;
+
+        while (parser.next(event))
+        {
+            if (event.isAssistant)
+                total += event.content;
+            if (event.done)
+                evalCount = event.evalCount;
+        }
+    }
+    return total;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    const int tokens = argc > 1 ? QByteArray(argv[1]).toInt() : 4096;
+    const int rounds = argc > 2 ? QByteArray(argv[2]).toInt() : 20;
+
+    const QByteArray stream = buildStream(tokens);
+    const QList<QByteArray> lines = stream.split('\n');
+
+    // split the stream into 1..512 byte fragments so lines regularly straddle two reads
+    QList<qsizetype> fragments;
+    QRandomGenerator rng(1234);
+    for (qsizetype offset = 0; offset < stream.size();)
+    {
+        const qsizetype size = qMin<qsizetype>(rng.bounded(1, 513), stream.size() - offset);
+        fragments.append(size);
+        offset += size;
+    }
+
+    // both decoders must agree before their timings mean anything
+    qint64 evalCount = 0;
+    const QString expected = runBaseline(lines);
+    if (runParser(stream, fragments, evalCount) != expected || evalCount != tokens)
+    {
+        std::cerr << "StreamParser output does not match QJsonDocument output." << std::endl;
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    qint64 baselineNs = 0;
+    qint64 parserNs = 0;
+    for (int round = 0; round < rounds; ++round)
+    {
+        timer.start();
+        runBaseline(lines);
+        baselineNs += timer.nsecsElapsed();
+
+        timer.start();
+        runParser(stream, fragments, evalCount);
+        parserNs += timer.nsecsElapsed();
+    }
+
+    const double perTokenBaseline = double(baselineNs) / rounds / tokens;
+    const double perTokenParser = double(parserNs) / rounds / tokens;
+
+    std::cout << "tokens per run:        " << tokens << " (" << stream.size() << " bytes, " << fragments.size()
+              << " fragments)" << std::endl;
+    std::cout << "QJsonDocument per line: " << perTokenBaseline << " ns/token" << std::endl;
+    std::cout << "StreamParser:           " << perTokenParser << " ns/token" << std::endl;
+    std::cout << "speedup:                " << perTokenBaseline / perTokenParser << "x" << std::endl;
+    return 0;
+}
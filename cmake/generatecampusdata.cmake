@@ -0,0 +1,265 @@
+# Turns data/campus.json into campustables.h: constexpr tables of the building map, the events and the contacts, with
+# every cross reference resolved to an index, plus the text the model is given about them. Run with
+#
+#   cmake -DINPUT=data/campus.json -DOUTPUT=campustables.h -P generatecampusdata.cmake
+#
+# Mistakes in the data (a door on a waypoint that doesn't exist, a malformed date) stop the build here instead of
+# showing up as a wrong answer at runtime.
+
+cmake_minimum_required(VERSION 3.19)
+
+if(NOT INPUT OR NOT OUTPUT)
+    message(FATAL_ERROR "Usage: cmake -DINPUT=<campus.json> -DOUTPUT=<campustables.h> -P ${CMAKE_CURRENT_LIST_FILE}")
+endif()
+
+file(READ "${INPUT}" json)
+
+set(months January February March April May June July August September October November December)
+
+# a C++ string literal holding text
+function(quote out text)
+    string(REPLACE "\\" "\\\\" text "${text}")
+    string(REPLACE "\"" "\\\"" text "${text}")
+    string(REPLACE "\n" "\\n" text "${text}")
+    set(${out} "\"${text}\"" PARENT_SCOPE)
+endfunction()
+
+# a member of a JSON object, which has to be there
+function(member out object key context)
+    string(JSON value ERROR_VARIABLE error GET "${object}" "${key}")
+    if(error)
+        message(FATAL_ERROR "${INPUT}: ${context} has no \"${key}\"")
+    endif()
+    set(${out} "${value}" PARENT_SCOPE)
+endfunction()
+
+# the elements of a top level array, as a list of JSON texts; semicolons in them are escaped so the list survives
+function(elements out key)
+    set(result "")
+    string(JSON count ERROR_VARIABLE error LENGTH "${json}" "${key}")
+    if(error)
+        set(count 0)
+    endif()
+    if(count GREATER 0)
+        math(EXPR last "${count} - 1")
+        foreach(i RANGE ${last})
+            string(JSON element GET "${json}" "${key}" ${i})
+            string(REPLACE ";" "\\;" element "${element}")
+            list(APPEND result "${element}")
+        endforeach()
+    endif()
+    set(${out} "${result}" PARENT_SCOPE)
+endfunction()
+
+# waypoints; everything else refers to them by index
+elements(nodes nodes)
+set(nodeIds "")
+set(nodeRows "")
+foreach(node IN LISTS nodes)
+    member(id "${node}" id "a node")
+    member(floor "${node}" floor "node ${id}")
+    member(x "${node}" x "node ${id}")
+    member(y "${node}" y "node ${id}")
+    if(id IN_LIST nodeIds)
+        message(FATAL_ERROR "${INPUT}: node ${id} is defined twice")
+    endif()
+    list(APPEND nodeIds "${id}")
+    quote(idLiteral "${id}")
+    string(APPEND nodeRows "    { ${idLiteral}, ${floor}, ${x}, ${y} },\n")
+endforeach()
+list(LENGTH nodeIds nodeCount)
+
+member(start "${json}" start "the map")
+list(FIND nodeIds "${start}" startNode)
+if(startNode LESS 0)
+    message(FATAL_ERROR "${INPUT}: the start position ${start} is not a node")
+endif()
+
+elements(edges edges)
+set(edgeRows "")
+foreach(edge IN LISTS edges)
+    member(from "${edge}" from "an edge")
+    member(to "${edge}" to "an edge")
+    string(JSON penalty ERROR_VARIABLE error GET "${edge}" penalty)
+    if(error)
+        set(penalty 0)
+    endif()
+    list(FIND nodeIds "${from}" fromIndex)
+    list(FIND nodeIds "${to}" toIndex)
+    if(fromIndex LESS 0 OR toIndex LESS 0)
+        message(FATAL_ERROR "${INPUT}: the edge ${from} - ${to} connects a node that doesn't exist")
+    endif()
+    string(APPEND edgeRows "    { ${fromIndex}, ${toIndex}, ${penalty} },\n")
+endforeach()
+list(LENGTH edges edgeCount)
+
+elements(places places)
+set(placeKeys "")
+set(placeRows "")
+foreach(place IN LISTS places)
+    member(key "${place}" key "a place")
+    member(name "${place}" name "place ${key}")
+    member(kind "${place}" kind "place ${key}")
+    if(key IN_LIST placeKeys)
+        message(FATAL_ERROR "${INPUT}: place ${key} is defined twice")
+    endif()
+    if(kind STREQUAL "room")
+        set(kindChar R)
+    elseif(kind STREQUAL "bathroom")
+        set(kindChar B)
+    elseif(kind STREQUAL "stairs")
+        set(kindChar S)
+    elseif(kind STREQUAL "exit")
+        set(kindChar X)
+    elseif(kind STREQUAL "elevator")
+        set(kindChar E)
+    else()
+        message(FATAL_ERROR "${INPUT}: place ${key} is of unknown kind \"${kind}\"")
+    endif()
+    list(APPEND placeKeys "${key}")
+    quote(keyLiteral "${key}")
+    quote(nameLiteral "${name}")
+    string(APPEND placeRows "    { ${keyLiteral}, ${nameLiteral}, '${kindChar}' },\n")
+endforeach()
+list(LENGTH placeKeys placeCount)
+
+elements(doors doors)
+set(doorRows "")
+set(placesWithDoors "")
+foreach(door IN LISTS doors)
+    member(place "${door}" place "a door")
+    member(node "${door}" node "a door of ${place}")
+    member(side "${door}" side "a door of ${place}")
+    list(FIND placeKeys "${place}" placeIndex)
+    list(FIND nodeIds "${node}" nodeIndex)
+    if(placeIndex LESS 0 OR nodeIndex LESS 0)
+        message(FATAL_ERROR "${INPUT}: the door of ${place} at ${node} refers to something that doesn't exist")
+    endif()
+    if(NOT side MATCHES "^[NESW]$")
+        message(FATAL_ERROR "${INPUT}: the door of ${place} at ${node} is on side \"${side}\", not N, E, S or W")
+    endif()
+    list(APPEND placesWithDoors "${place}")
+    string(APPEND doorRows "    { ${placeIndex}, ${nodeIndex}, '${side}' },\n")
+endforeach()
+list(LENGTH doors doorCount)
+
+# routes are rendered to a door, so a place without one could never be found
+foreach(key IN LISTS placeKeys)
+    if(NOT key IN_LIST placesWithDoors)
+        message(FATAL_ERROR "${INPUT}: place ${key} has no door")
+    endif()
+endforeach()
+
+elements(events events)
+set(eventRows "")
+set(eventsDocument "# Upcoming events")
+foreach(event IN LISTS events)
+    member(title "${event}" title "an event")
+    member(date "${event}" date "event ${title}")
+    member(time "${event}" time "event ${title}")
+    member(location "${event}" location "event ${title}")
+    if(NOT date MATCHES "^([0-9][0-9][0-9][0-9])-([0-9][0-9])-([0-9][0-9])$")
+        message(FATAL_ERROR "${INPUT}: event ${title} is on \"${date}\", which is not YYYY-MM-DD")
+    endif()
+    set(day "${CMAKE_MATCH_3}")
+    math(EXPR monthIndex "${CMAKE_MATCH_2} - 1")
+    if(monthIndex LESS 0 OR monthIndex GREATER 11)
+        message(FATAL_ERROR "${INPUT}: event ${title} is on \"${date}\", which has no such month")
+    endif()
+    list(GET months ${monthIndex} monthName)
+    string(SUBSTRING "${monthName}" 0 3 month)
+    string(TOUPPER "${month}" month)
+    string(REGEX REPLACE "^0" "" dayNumber "${day}")
+
+    set(summary "${title}: ${monthName} ${dayNumber}, ${time}, ${location}.")
+    string(APPEND eventsDocument "\n\n${summary}")
+
+    set(row "")
+    foreach(field title date month day time location summary)
+        quote(literal "${${field}}")
+        if(row)
+            string(APPEND row ", ")
+        endif()
+        string(APPEND row "${literal}")
+    endforeach()
+    string(APPEND eventRows "    { ${row} },\n")
+endforeach()
+list(LENGTH events eventCount)
+
+elements(contacts contacts)
+set(contactRows "")
+set(contactsDocument "# Contacts")
+foreach(contact IN LISTS contacts)
+    member(name "${contact}" name "a contact")
+    member(email "${contact}" email "contact ${name}")
+    member(phone "${contact}" phone "contact ${name}")
+    member(room "${contact}" room "contact ${name}")
+
+    set(summary "${name}: ${email}, ${phone}, ${room}.")
+    string(APPEND contactsDocument "\n\n${summary}")
+
+    set(row "")
+    foreach(field name email phone room summary)
+        quote(literal "${${field}}")
+        if(row)
+            string(APPEND row ", ")
+        endif()
+        string(APPEND row "${literal}")
+    endforeach()
+    string(APPEND contactRows "    { ${row} },\n")
+endforeach()
+list(LENGTH contacts contactCount)
+
+quote(eventsLiteral "${eventsDocument}")
+quote(contactsLiteral "${contactsDocument}")
+
+file(RELATIVE_PATH source "${CMAKE_CURRENT_LIST_DIR}/.." "${INPUT}")
+set(header "/*
+    campustables.h
+
+    Generated from ${source} by cmake/generatecampusdata.cmake. Do not edit; edit the data and rebuild.
+*/
+
+#ifndef CAMPUSTABLES_H
+#define CAMPUSTABLES_H
+
+namespace CampusData
+{
+
+inline constexpr std::array<Node, ${nodeCount}> nodes{ {
+${nodeRows}} };
+
+inline constexpr int startNode = ${startNode};
+
+inline constexpr std::array<Edge, ${edgeCount}> edges{ {
+${edgeRows}} };
+
+inline constexpr std::array<Place, ${placeCount}> places{ {
+${placeRows}} };
+
+inline constexpr std::array<Door, ${doorCount}> doors{ {
+${doorRows}} };
+
+inline constexpr std::array<Event, ${eventCount}> events{ {
+${eventRows}} };
+
+inline constexpr std::array<Contact, ${contactCount}> contacts{ {
+${contactRows}} };
+
+inline constexpr char eventsDocument[] = ${eventsLiteral};
+
+inline constexpr char contactsDocument[] = ${contactsLiteral};
+
+} // namespace CampusData
+
+#endif // CAMPUSTABLES_H
+")
+
+# leaving an unchanged file alone keeps everything that includes it from being rebuilt
+set(previous "")
+if(EXISTS "${OUTPUT}")
+    file(READ "${OUTPUT}" previous)
+endif()
+if(NOT previous STREQUAL header)
+    file(WRITE "${OUTPUT}" "${header}")
+endif()
@@ -0,0 +1,124 @@
+/*
+    backendpool.h
+
+    Class declaration for BackendPool.
+*/
+
+#ifndef BACKENDPOOL_H
+#define BACKENDPOOL_H
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/*
+    BackendPool
+
+    The Ollama servers requests can be sent to, with the bookkeeping needed to choose between them: requests in flight,
+    recent time-to-first-token samples, and health.
+
+    A backend is ejected as soon as it can't be reached, or after several requests in a row fail, and is only
+    re-admitted once a health probe gets through. Ejected backends are probed with exponential backoff, healthy ones
+    at the regular interval. If every backend is ejected, requests still go to the best-scoring one rather than
+    nowhere.
+
+    The first backend is the primary one, set from the settings panel; the rest come from the ini file.
+*/
+class BackendPool
+{
+public:
+    enum Routing
+    {
+        LeastLoaded,  // fewest requests in flight, then lowest latency
+        LatencyAware  // lowest expected wait: recent latency scaled by the requests already queued
+    };
+
+    BackendPool();
+
+    /*
+        Replaces all backends. The first URL is the primary backend.
+    */
+    void setBackends(const QStringList &urls);
+
+    /*
+        Replaces the primary backend, keeping the others.
+    */
+    void setPrimary(const QString &url);
+
+    int size() const;
+    QString url(int backend) const;
+
+    void setRouting(Routing routing);
+
+    /*
+        Sets the percentile of recent time-to-first-token above which a request is hedged, e.g. 95. 0 turns hedging
+        off.
+    */
+    void setHedgePercentile(int percentile);
+
+    /*
+        Returns the backend the next request should go to, skipping exclude. Returns -1 if there is no other backend.
+    */
+    int pick(int exclude = -1) const;
+
+    void requestStarted(int backend);
+    void requestFinished(int backend);
+
+    /*
+        Records how long a request took to produce its first bytes, in milliseconds.
+    */
+    void recordFirstToken(int backend, qint64 msec);
+
+    /*
+        A probe or request got through. Re-admits the backend if it was ejected.
+    */
+    void recordSuccess(int backend);
+
+    /*
+        The backend answered a request with an error. Ejects it after several in a row.
+    */
+    void recordError(int backend);
+
+    /*
+        The backend could not be reached at all. Ejects it straight away.
+    */
+    void markUnreachable(int backend);
+
+    bool isHealthy(int backend) const;
+    bool anyHealthy() const;
+
+    /*
+        Returns how long to wait for the first bytes from a backend before hedging the request on another one, in
+        milliseconds, or 0 if the request shouldn't be hedged.
+    */
+    qint64 hedgeDelay(int backend) const;
+
+    /*
+        Returns how long to wait before probing a backend again, given whether the last probe succeeded. Healthy
+        backends are probed every healthInterval milliseconds; failing ones back off from one second.
+    */
+    int nextProbeDelay(int backend, bool lastProbeSucceeded, int healthInterval);
+
+private:
+    struct Backend
+    {
+        QString url;
+        int inFlight = 0;
+        bool healthy = true;
+        int consecutiveErrors = 0;
+        int retryInterval = 0; // in milliseconds
+
+        QList<qint64> firstTokenSamples; // ring buffer of the most recent samples
+        qsizetype nextSample = 0;
+        double averageFirstToken = 0; // exponentially weighted, in milliseconds
+    };
+
+    static Backend makeBackend(const QString &url);
+    double score(const Backend &backend) const;
+
+    QList<Backend> backends;
+    Routing routing;
+    int hedgePercentile;
+};
+
+#endif // BACKENDPOOL_H
@@ -0,0 +1,85 @@
+/*
+    batchrunner.h
+
+    Class declaration for BatchRunner.
+*/
+
+#ifndef BATCHRUNNER_H
+#define BATCHRUNNER_H
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QStringList>
+#include "programcontroller.h"
+
+/*
+    BatchRunner
+
+    Replays a file of prompts through a ProgramController and reports the throughput, for load tests that can be
+    repeated. Conversations in the file are separated by blank lines; the prompts of one conversation (one per line)
+    are sent in order in a conversation of their own, each once the answer to the one before has finished. Up to
+    the given number of conversations run at the same time, so the server sees that many concurrent prompts.
+
+    Lines starting with # are comments.
+*/
+class BatchRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BatchRunner(ProgramController *controller, QObject *parent = nullptr);
+
+    /*
+        Reads the conversations to replay. Returns false if the file can't be read or holds no prompts.
+    */
+    bool load(const QString &path);
+
+    /*
+        Starts replaying with up to concurrency conversations at a time. finished() is emitted once every prompt has
+        been answered, after the report has been written to standard output.
+    */
+    void start(int concurrency);
+
+    /*
+        Returns the number of prompts that did not finish normally.
+    */
+    int failures() const;
+
+signals:
+    void finished();
+
+private:
+    // one conversation being replayed
+    struct Replay
+    {
+        qsizetype conversation;
+        qsizetype prompt;
+        QElapsedTimer sent;
+        qint64 firstText; // nanoseconds from sending the prompt to the first text of the answer, -1 until then
+    };
+
+    bool startConversation();
+    void sendNext(int session);
+    void onAnswerReceived(int session, const QString &text);
+    void onAnswerFinished(int session, ProgramController::GenerateStatus status);
+    void report() const;
+
+    static double percentile(QList<qint64> values, double p);
+
+    ProgramController *controller;
+    QList<QStringList> conversations;
+    qsizetype nextConversation;
+    int concurrency;
+    QHash<int, Replay> running; // session -> its replay
+
+    QElapsedTimer clock;
+    QList<qint64> firstTextTimes; // nanoseconds
+    QList<qint64> answerTimes;    // nanoseconds
+    qint64 answerChars;
+    int answered;
+    int failed;
+};
+
+#endif // BATCHRUNNER_H
@@ -0,0 +1,80 @@
+/*
+    campusdata.h
+
+    Declarations for CampusData.
+*/
+
+#ifndef CAMPUSDATA_H
+#define CAMPUSDATA_H
+
+#include <array>
+
+/*
+    CampusData
+
+    The building map, the events and the contacts, compiled into the program. data/campus.json is turned into the
+    constexpr tables below at build time (see cmake/generatecampusdata.cmake), so nothing is parsed at startup, and the
+    map, the pages and the text the model is given all read the same tables.
+
+    Coordinates are in hallway steps, x to the east and y to the north. The default position is startNode, facing
+    north towards the big screen. Edges and doors refer to nodes and places by their index in the tables.
+*/
+namespace CampusData
+{
+
+struct Node
+{
+    const char *id;
+    int floor;
+    int x;
+    int y;
+};
+
+struct Edge
+{
+    int from;
+    int to;
+    int penalty; // added to the walking distance to steer routes away from a hallway
+};
+
+struct Place
+{
+    const char *key;  // lookup key, e.g. "125" or "stairs"
+    const char *name; // as used mid-sentence, e.g. "Room 125" or "the stairs"
+    char kind;        // 'R'oom, 'B'athroom, 'S'tairs, 'X' exit, 'E'levator
+};
+
+struct Door
+{
+    int place;
+    int node;
+    char side; // 'N', 'E', 'S' or 'W'
+};
+
+struct Event
+{
+    const char *title;
+    const char *date;  // YYYY-MM-DD
+    const char *month; // as shown on the events page, e.g. "OCT"
+    const char *day;   // e.g. "01"
+    const char *time;
+    const char *location;
+    const char *summary; // one line for the model, e.g. "Career Fair: October 12, 10:00 AM, Grand Hall."
+};
+
+struct Contact
+{
+    const char *name;
+    const char *email;
+    const char *phone;
+    const char *room;
+    const char *summary;
+};
+
+} // namespace CampusData
+
+// nodes, startNode, edges, places, doors, events, contacts, and eventsDocument and contactsDocument: the summaries
+// under a heading, as the retriever and the model read them
+#include "campustables.h"
+
+#endif // CAMPUSDATA_H
@@ -0,0 +1,125 @@
+/*
+    chatmodel.h
+
+    Class declaration for ChatModel.
+*/
+
+#ifndef CHATMODEL_H
+#define CHATMODEL_H
+
+#include <QAbstractListModel>
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+#include <QTimer>
+#include <QtQmlIntegration>
+#include "markdownrenderer.h"
+
+/*
+    ChatModel
+
+    The list of chat messages shown in the chat view. Exposes the "message", "renderedClosed", "renderedOpen",
+    "thinking" and "isUser" roles used by the delegate in Main.qml. The Markdown of "message" turned into rich text
+    comes in two parts: "renderedClosed" holds the blocks that are finished, and "renderedOpen" the one still being
+    written. "thinking" is the reasoning of a thinking model, shown folded away above its answer.
+
+    Streamed tokens are appended to the last message straight away, but the view is only told about it at most once
+    per flush interval (one frame by default), so a long answer costs one relayout per frame rather than one per token.
+    The rich text is brought up to date on the flush too, redoing only the Markdown block still being written; the
+    finished blocks only change, and only get laid out again, when another block is finished.
+*/
+class ChatModel : public QAbstractListModel
+{
+    Q_OBJECT
+    QML_ELEMENT
+    QML_UNCREATABLE("ChatModel is owned by ProgramController")
+
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+
+public:
+    enum Roles
+    {
+        MessageRole = Qt::UserRole + 1,
+        IsUserRole,
+        RenderedClosedRole,
+        RenderedOpenRole,
+        ThinkingRole
+    };
+
+    explicit ChatModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QHash<int, QByteArray> roleNames() const override;
+
+    /*
+        Returns the number of messages.
+    */
+    int count() const;
+
+    /*
+        Adds a new message to the end of the chat.
+    */
+    void appendMessage(const QString &message, bool isUser);
+
+    /*
+        Appends a streamed token to the last message. The change is published on the next flush.
+    */
+    void appendToken(const QString &token);
+
+    /*
+        Appends a piece of the model's reasoning to the last message. Published along with tokens.
+    */
+    void appendThinking(const QString &text);
+
+    /*
+        Publishes any pending token changes immediately.
+    */
+    void flush();
+
+    /*
+        Empties the last message and its reasoning, for an answer that is started over. It stays in the chat, ready
+        for new tokens.
+    */
+    void clearLastMessage();
+
+    /*
+        Returns the text of the last message, or an empty string if there is none.
+    */
+    QString lastMessage() const;
+
+    /*
+        Removes all messages.
+    */
+    void clear();
+
+    /*
+        Sets the minimum time between two updates of the streaming message, in milliseconds.
+    */
+    void setFlushInterval(int msec);
+
+signals:
+    void countChanged();
+
+    /*
+        The view was told about new tokens. waitedNs is how long the oldest of them had been waiting.
+    */
+    void published(qint64 waitedNs);
+
+private:
+    struct Message
+    {
+        MarkdownRenderer markdown; // holds the text as well
+        QString renderedClosed;
+        QString renderedOpen;
+        QString thinking;
+        bool isUser;
+    };
+
+    QList<Message> messages;
+    QTimer flushTimer;
+    bool pendingChange;
+    QElapsedTimer pendingSince; // when the oldest unpublished token arrived
+};
+
+#endif // CHATMODEL_H
@@ -0,0 +1,83 @@
+/*
+    chatservice.h
+
+    Class declaration for ChatService.
+*/
+
+#ifndef CHATSERVICE_H
+#define CHATSERVICE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonObject>
+#include <QObject>
+#include <QTcpServer>
+#include "programcontroller.h"
+
+class QTcpSocket;
+
+/*
+    ChatService
+
+    Serves conversations over a small HTTP API, so thin clients on other displays (or a load test) can share one
+    ProgramController without the window. Answers stream as server-sent events:
+
+        GET    /health                  {"connected": true, "conversations": 2}
+        GET    /metrics                 the request timings in the Prometheus text format
+        POST   /sessions                opens a conversation: 201 {"session": 3}
+        POST   /sessions/<id>/messages  {"prompt": "..."}: a text/event-stream of "token" events, {"text": "..."},
+                                        ending with one "done" event, {"status": "finished"} (or "cancelled",
+                                        "timedOut", "error"). A "restart" event, {}, means the text so far is
+                                        dropped and the answer starts over
+        DELETE /sessions/<id>           stops any answer and forgets the conversation: 204
+
+    A conversation answers one prompt at a time; another prompt while it is busy gets 409. A client that hangs up on
+    the event stream cancels the answer. Plain responses keep the connection open for the next request; an event
+    stream closes it when it is done.
+*/
+class ChatService : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ChatService(ProgramController *controller, QObject *parent = nullptr);
+
+    /*
+        Starts accepting connections. Returns false if the address can't be listened on.
+    */
+    bool listen(const QHostAddress &address, quint16 port);
+
+    /*
+        Returns the port being listened on, which is the one picked by the system if 0 was passed to listen().
+    */
+    quint16 port() const;
+
+private:
+    struct Connection
+    {
+        QByteArray buffer;
+        int streaming = 0; // the session whose answer is being streamed, 0 while none is
+    };
+
+    void onNewConnection();
+    void onReadyRead(QTcpSocket *socket);
+    void onDisconnected(QTcpSocket *socket);
+    void handleRequest(QTcpSocket *socket, const QByteArray &method, const QByteArray &path, const QByteArray &body);
+    void startAnswer(QTcpSocket *socket, int session, const QByteArray &body);
+    void onAnswerReceived(int session, const QString &text);
+    void onAnswerFinished(int session, ProgramController::GenerateStatus status);
+    void onAnswerRestarted(int session);
+
+    static void writeResponse(QTcpSocket *socket, int status, const QJsonObject &body);
+    static void writeResponse(QTcpSocket *socket, int status, const QByteArray &contentType, const QByteArray &body);
+    static void writeEvent(QTcpSocket *socket, const QByteArray &event, const QJsonObject &data);
+
+    ProgramController *controller;
+    QTcpServer server;
+    QHash<QTcpSocket *, Connection> connections;
+    QHash<int, QTcpSocket *> streams; // session -> the socket its answer is streamed to
+    QList<int> sessions;              // conversations opened through the service
+};
+
+#endif // CHATSERVICE_H
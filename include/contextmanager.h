@@ -0,0 +1,129 @@
+/*
+    contextmanager.h
+
+    Class declaration for ContextManager.
+*/
+
+#ifndef CONTEXTMANAGER_H
+#define CONTEXTMANAGER_H
+
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QList>
+#include <QString>
+
+/*
+    ContextManager
+
+    Owns the message history sent to the model and keeps it inside the configured context window.
+
+    There is only ever one system message and it always sits at the head of the history; setting a new system prompt
+    replaces it instead of appending another copy. Every message has its token count estimated once when it is added,
+    and whenever the total goes over budget the oldest turns are dropped whole (a user message together with the
+    replies that followed it) until the history fits again. The newest turn is never dropped.
+
+    Every message is also encoded as compact JSON once, when it is added, and kept in one buffer that only grows at
+    the end (and shrinks at the front when turns are dropped). A request for the next turn copies those bytes instead
+    of encoding the whole conversation again, so building it costs the same on the hundredth turn as on the first
+    bar the copy.
+*/
+class ContextManager
+{
+public:
+    explicit ContextManager(int contextSize);
+
+    /*
+        Sets the size of the model's context window in tokens.
+    */
+    void setContextSize(int tokens);
+
+    /*
+        Returns the size of the model's context window in tokens.
+    */
+    int getContextSize() const;
+
+    /*
+        Sets the system prompt. Replaces the previous system message if there was one.
+    */
+    void setSystemPrompt(const QString &prompt);
+
+    /*
+        Returns the current system prompt.
+    */
+    QString getSystemPrompt() const;
+
+    /*
+        Adds a message to the history and trims old turns if it no longer fits.
+    */
+    void addMessage(const QString &role, const QString &content);
+
+    /*
+        Adds a message that carries more than a role and content, such as the model's tool calls or a tool's result.
+    */
+    void addMessage(const QJsonObject &message);
+
+    /*
+        Removes all messages except the system prompt.
+    */
+    void clear();
+
+    /*
+        Returns the messages to send to the model: the system message followed by the history.
+    */
+    QJsonArray messages() const;
+
+    /*
+        Appends the same messages to body as the JSON array text of a chat request's "messages" field, with extra (an
+        already encoded message, if not empty) as the last one.
+    */
+    void appendMessages(QByteArray &body, const QByteArray &extra = QByteArray()) const;
+
+    /*
+        Returns how many bytes appendMessages() adds to a body without an extra message.
+    */
+    qsizetype encodedSize() const;
+
+    /*
+        Returns a message as compact JSON text, as appendMessages() expects an extra one.
+    */
+    static QByteArray encode(const QJsonObject &message);
+
+    /*
+        Returns the number of messages in the history, not counting the system prompt.
+    */
+    int messageCount() const;
+
+    /*
+        Returns the estimated number of tokens used by the system prompt and history.
+    */
+    int estimatedTokens() const;
+
+    /*
+        Returns roughly how many bytes of memory the system prompt and history take up.
+    */
+    qint64 memoryUsage() const;
+
+    /*
+        Rough token estimate for a piece of text. Errs on the high side so trimming kicks in before the server
+        has to truncate anything itself.
+    */
+    static int estimateTokens(const QString &text);
+
+private:
+    int budget() const;
+    void append(const QJsonObject &message, int tokens);
+    void trim();
+
+    int contextSize; // in tokens
+    QJsonObject systemMessage;
+    int systemTokens;
+    QJsonArray history;
+    QList<int> historyTokens; // estimated tokens of each message in history
+    int totalHistoryTokens;
+    QByteArray encodedSystem;       // systemMessage as compact JSON, empty if there is none
+    QByteArray encodedHistory;      // every message in history as compact JSON, separated by commas
+    QList<qsizetype> encodedSizes;  // bytes of each message in encodedHistory, not counting the commas
+};
+
+#endif // CONTEXTMANAGER_H
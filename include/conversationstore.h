@@ -0,0 +1,122 @@
+/*
+    conversationstore.h
+
+    Class declaration for ConversationStore.
+*/
+
+#ifndef CONVERSATIONSTORE_H
+#define CONVERSATIONSTORE_H
+
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QThread>
+#include "threadworker.h"
+
+/*
+    ConversationStore
+
+    Keeps the conversation on disk so it survives a restart or a crash. Every message is appended to a log file as it
+    happens, tagged with the session it belongs to; "Clear Chat" starts a new session rather than rewriting anything.
+
+    A message can belong to the chat view, to the history sent to the model, or both: the view shows the user's
+    question as typed while the model gets it with the looked-up reference material, and an error apology is only
+    shown, never sent. When a message repeats the last one of the same role (the usual case for the other half of a
+    view/history pair) only a marker is stored instead of the text again.
+
+    The file header points at the start of the newest session, so restoring on startup maps the file and reads only
+    that session's records. Records a crash cut off halfway are dropped. Once the file holds more than twice the
+    sessions to keep, the older ones are dropped by rewriting the file on a background thread; messages that come in
+    meanwhile are held back and appended when it is done.
+*/
+class ConversationStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Placement
+    {
+        InView = 0x1,
+        InHistory = 0x2
+    };
+
+    struct Message
+    {
+        QString role; // "user", "assistant" or "tool"
+        QString text;
+        int placement; // Placement flags
+    };
+
+    explicit ConversationStore(QObject *parent = nullptr);
+    ~ConversationStore();
+
+    /*
+        Opens (or creates) the log. keepSessions is how many of the most recent sessions compaction keeps (0 = all).
+        Returns false if the file can't be used, in which case nothing is stored.
+    */
+    bool open(const QString &path, int keepSessions);
+
+    void close();
+    bool isOpen() const;
+
+    /*
+        Returns the messages of the newest session, oldest first.
+    */
+    QList<Message> lastSession();
+
+    /*
+        Appends a message to the current session.
+    */
+    void append(const QString &role, const QString &text, int placement);
+
+    /*
+        Starts a new, empty session. Messages from earlier sessions are never restored again.
+    */
+    void startSession();
+
+private:
+    enum RecordKind : quint8
+    {
+        SessionStart,
+        MessageRecord
+    };
+
+    struct Pending
+    {
+        RecordKind kind;
+        QString role;
+        QString text;
+        int placement;
+    };
+
+    // finds the newest session and drops a torn record at the end of the file
+    bool load();
+
+    // decodes the records from the newest session's start; fills messages if given
+    bool scanLastSession(QList<Message> *messages);
+
+    bool writeRecord(RecordKind kind, quint8 role, quint8 flags, const QByteArray &text);
+    void writeHeader();
+
+    void compactInBackground();
+    void finishCompaction(bool succeeded);
+    static bool compactFile(const QString &path, quint32 keepFrom);
+
+    QFile file;
+    QString path;
+    int keepSessions;
+
+    quint32 firstSession;
+    quint32 currentSession;
+    qint64 sessionOffset; // of the current session's start record
+    QHash<quint8, QByteArray> lastText; // per role, the last text written in this session
+
+    bool compacting;
+    QList<Pending> pending; // held back while the file is being compacted
+    QThread compactThread;
+    ThreadWorker worker;
+};
+
+#endif // CONVERSATIONSTORE_H
@@ -0,0 +1,288 @@
+/*
+    logger.h
+
+    Class declaration for Logger.
+*/
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QSettings>
+#include <QString>
+#include <QStringView>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/*
+    Log calls below this level are left out of the build: 0 for debug, 1 info, 2 warning, 3 error. CMake sets it from
+    the ZIPPY_LOG_LEVEL cache variable.
+*/
+#ifndef ZIPPY_LOG_LEVEL
+#define ZIPPY_LOG_LEVEL 0
+#endif
+
+/*
+    Logs an event with its fields, given as key, value pairs after the event name:
+
+        LOG_INFO("request.sent", "session", session, "bytes", body.size());
+
+    The event name and the keys must be string literals; the values are copied, so they only have to live as long as
+    the call. Values can be numbers, bools, QStrings, QByteArrays, std::strings and C strings. A call below the level
+    the build was made with is discarded by the compiler, and one below the level set at runtime costs a comparison
+    without evaluating its fields.
+*/
+#define ZIPPY_LOG(level, ...)                                                                                          \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        if constexpr (level >= ZIPPY_LOG_LEVEL)                                                                        \
+        {                                                                                                              \
+            if (Logger::isEnabled(level))                                                                              \
+                Logger::write(level, __VA_ARGS__);                                                                     \
+        }                                                                                                              \
+    } while (false)
+
+#define LOG_DEBUG(...) ZIPPY_LOG(Logger::Debug, __VA_ARGS__)
+#define LOG_INFO(...) ZIPPY_LOG(Logger::Info, __VA_ARGS__)
+#define LOG_WARNING(...) ZIPPY_LOG(Logger::Warning, __VA_ARGS__)
+#define LOG_ERROR(...) ZIPPY_LOG(Logger::Error, __VA_ARGS__)
+
+/*
+    Logger
+
+    Structured log lines, written to a file and to standard error by a thread of their own, so a log call never waits
+    on the disk or the terminal. Every thread that logs gets a ring buffer of fixed-size records: a log call copies the
+    event, its fields and the time into the next free record, without a lock or an allocation, and the writer thread
+    drains the rings every 100 ms (at once after an error), formats the records as logfmt lines in the order they were
+    logged, and writes them out. A thread that logs faster than that drops records rather than waiting for room; how
+    many is logged as log.dropped.
+
+    The file is rotated once it grows past its size cap: cob_zippy_ai.log becomes cob_zippy_ai.log.1, and so on, and
+    the oldest is deleted. main() creates the one Logger before anything else and destroys it last; log calls before
+    and after do nothing. Settings (in the Log group):
+
+        Level       lowest level written: debug, info, warning, error or off (info)
+        Console     lowest level also written to standard error (info)
+        Path        the log file (cob_zippy_ai.log; empty = none)
+        MaxSizeMB   size the file is rotated at (8)
+        Files       rotated files kept next to the current one (3)
+*/
+class Logger
+{
+public:
+    enum Level
+    {
+        Debug,
+        Info,
+        Warning,
+        Error,
+        Off
+    };
+
+    explicit Logger(QSettings &settings);
+
+    /*
+        Writes out what is still buffered and stops the writer thread.
+    */
+    ~Logger();
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    /*
+        Returns whether a record at this level would be written anywhere.
+    */
+    static bool isEnabled(Level level)
+    {
+        return level >= threshold.load(std::memory_order_relaxed);
+    }
+
+    /*
+        Adds a record to the calling thread's ring. Use the LOG_ macros, which check the level first.
+    */
+    template <typename... Fields>
+    static void write(Level level, const char *event, const Fields &...fields)
+    {
+        static_assert(sizeof...(Fields) % 2 == 0, "fields are given as key, value pairs");
+        static_assert(sizeof...(Fields) / 2 <= MaxFields, "too many fields for one record");
+
+        Ring *ring = threadRing();
+        if (!ring)
+            return;
+        Record *record = ring->claim();
+        if (!record)
+            return;
+
+        record->start(level, event);
+        addFields(*record, fields...);
+        ring->publish();
+
+        // a crash right after an error would otherwise take the record with it
+        if (level >= Error)
+            wakeWriter();
+    }
+
+    static const char *levelName(Level level);
+
+private:
+    static constexpr int MaxFields = 8;
+    static constexpr int TextSize = 240;    // bytes of UTF-8 for all text values of a record together
+    static constexpr quint32 RingSize = 512; // records per thread
+
+    enum FieldType : quint8
+    {
+        Integer,
+        Real,
+        Boolean,
+        Text
+    };
+
+    struct Record
+    {
+        void start(Level level, const char *event);
+        void addText(const char *key, QStringView value);
+        void addText(const char *key, const char *value, qsizetype size); // UTF-8
+
+        template <typename T>
+        void add(const char *key, const T &value)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                keys[fieldCount] = key;
+                types[fieldCount] = Boolean;
+                values[fieldCount++].integer = value;
+            }
+            else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>)
+            {
+                keys[fieldCount] = key;
+                types[fieldCount] = Integer;
+                values[fieldCount++].integer = qint64(value);
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                keys[fieldCount] = key;
+                types[fieldCount] = Real;
+                values[fieldCount++].real = double(value);
+            }
+            else if constexpr (std::is_convertible_v<const T &, QStringView>)
+            {
+                addText(key, QStringView(value));
+            }
+            else if constexpr (std::is_same_v<T, QByteArray> || std::is_same_v<T, std::string>)
+            {
+                addText(key, value.data(), qsizetype(value.size()));
+            }
+            else
+            {
+                static_assert(std::is_convertible_v<const T &, const char *>,
+                              "log field values are numbers, bools or text");
+                const char *text = value;
+                addText(key, text, qsizetype(std::strlen(text)));
+            }
+        }
+
+        qint64 time; // microseconds since the epoch
+        const char *event;
+        const char *keys[MaxFields];
+        union
+        {
+            qint64 integer;
+            double real;
+            struct
+            {
+                quint16 offset;
+                quint16 size;
+            } span; // where the value is in text
+        } values[MaxFields];
+        FieldType types[MaxFields];
+        Level level;
+        quint8 fieldCount;
+        quint16 textUsed;
+        char text[TextSize];
+    };
+
+    // written to by one thread and read by the writer
+    struct Ring
+    {
+        Record *claim()
+        {
+            const quint32 next = head.load(std::memory_order_relaxed);
+            if (next - tail.load(std::memory_order_acquire) >= RingSize)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            return &records[next % RingSize];
+        }
+
+        void publish()
+        {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        int thread; // numbered in the order threads first logged
+        alignas(64) std::atomic<quint32> head{ 0 }; // next record to fill
+        alignas(64) std::atomic<quint32> tail{ 0 }; // next record to write out
+        std::atomic<quint32> dropped{ 0 };
+        Record records[RingSize];
+    };
+
+    // a formatted line waiting to be written
+    struct Line
+    {
+        qint64 time;
+        Level level;
+        QByteArray text;
+    };
+
+    static void addFields(Record &)
+    {
+    }
+
+    template <typename Value, typename... Rest>
+    static void addFields(Record &record, const char *key, const Value &value, const Rest &...rest)
+    {
+        record.add(key, value);
+        addFields(record, rest...);
+    }
+
+    static Ring *threadRing();
+    static void wakeWriter();
+    static Level levelFromName(const QString &name, Level fallback);
+    static QByteArray format(const Record &record, int thread);
+
+    void run();
+    void drain();
+    void writeLines(const std::vector<Line> &lines);
+    void rotate();
+
+    static std::atomic<int> threshold;
+    static std::atomic<quint64> generation; // changes whenever a Logger comes or goes, so rings are registered anew
+    static std::mutex instanceMutex;
+    static Logger *instance;
+
+    Level fileLevel;
+    Level consoleLevel;
+    QString path;
+    qint64 maxBytes;
+    int files;
+    QFile file;
+
+    std::mutex ringsMutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    bool stopping;
+    std::thread writer;
+};
+
+#endif // LOGGER_H
@@ -0,0 +1,90 @@
+/*
+    markdownrenderer.h
+
+    Class declaration for MarkdownRenderer.
+*/
+
+#ifndef MARKDOWNRENDERER_H
+#define MARKDOWNRENDERER_H
+
+#include <QString>
+#include <QStringList>
+#include <QStringView>
+
+/*
+    MarkdownRenderer
+
+    Turns the Markdown the model writes into the rich text (HTML subset) that a QML Text item shows with
+    Text.RichText. It covers what answers actually use: paragraphs, headings, bullet and numbered lists, block
+    quotes, fenced code, rules, and bold, italic, strikethrough, inline code and links within a line.
+
+    The text is meant to grow a token at a time. Every complete line is parsed once and the HTML of each block is
+    kept once the block is closed, so only the block that is still open and the line being written are redone. The
+    closed blocks and the open one come out as separate strings, so a view that shows them separately does work
+    proportional to the open block on each update, not to the whole message.
+*/
+class MarkdownRenderer
+{
+public:
+    /*
+        Adds text to the end of the message. It is parsed on the next call to closedHtml(), openHtml() or html().
+    */
+    void append(const QString &text);
+
+    /*
+        Returns the rich text of the blocks that can no longer change. It only ever grows at the end, when a block
+        is closed.
+    */
+    const QString &closedHtml();
+
+    /*
+        Returns the rich text of the block still being written, the line being written included.
+    */
+    QString openHtml();
+
+    /*
+        Returns the whole message as rich text: closedHtml() followed by openHtml().
+    */
+    QString html();
+
+    /*
+        Returns the Markdown source.
+    */
+    const QString &text() const;
+
+    void clear();
+
+private:
+    enum BlockKind
+    {
+        NoBlock,
+        Paragraph,
+        CodeBlock,
+        BulletList,
+        NumberedList,
+        Quote
+    };
+
+    struct Block
+    {
+        BlockKind kind = NoBlock;
+        QStringList lines; // for lists, one entry per item
+        int start = 1;     // first number of a numbered list
+        bool blank = false; // a list was followed by a blank line, so the next line may or may not continue it
+    };
+
+    // parses the complete lines not parsed yet
+    void parseLines();
+
+    // adds one line to the open block; blocks it closes are rendered to html
+    static void feed(Block &block, QStringView line, QString &html);
+    static void close(Block &block, QString &html);
+    static QString renderInline(QStringView text);
+
+    QString source;
+    qsizetype parsed = 0; // start of the first line not parsed yet
+    QString closed;       // html of the blocks that can no longer change
+    Block open;
+};
+
+#endif // MARKDOWNRENDERER_H
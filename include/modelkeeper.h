@@ -0,0 +1,66 @@
+/*
+    modelkeeper.h
+
+    Class declaration for ModelKeeper.
+*/
+
+#ifndef MODELKEEPER_H
+#define MODELKEEPER_H
+
+#include <QObject>
+#include <QSettings>
+#include <QTime>
+#include <QTimer>
+
+class OllamaInterface;
+
+/*
+    ModelKeeper
+
+    Decides when the model should be resident in the Ollama server's memory. Settings (in the Ollama group):
+
+        IdleUnloadMinutes   unload the model after this many minutes without a prompt (0 = never, the default)
+        OpeningTime         time of day ("HH:mm") to load the model again ahead of the first visitor (empty = never)
+
+    While an idle unload is configured the model is kept loaded indefinitely between prompts, so the server's own
+    keep-alive expiry can't unload it early.
+*/
+class ModelKeeper : public QObject
+{
+    Q_OBJECT
+
+public:
+    ModelKeeper(OllamaInterface *ollama, QSettings &settings, QObject *parent = nullptr);
+
+    /*
+        Starts the idle and opening time schedules. The model is loaded whenever the server becomes reachable, unless
+        it was unloaded for being idle.
+    */
+    void start();
+
+    /*
+        Lets the keeper know a prompt is being sent, which restarts the idle countdown.
+    */
+    void notifyActivity();
+
+    /*
+        Returns whether the keeper has unloaded the model.
+    */
+    bool isUnloaded() const;
+
+private slots:
+    void onIdle();
+    void onConnectedChanged(bool connected);
+    void onOpeningTime();
+
+private:
+    void scheduleOpeningTime();
+
+    OllamaInterface *ollama;
+    QTimer idleTimer;
+    QTimer openingTimer;
+    QTime openingTime;
+    bool unloaded;
+};
+
+#endif // MODELKEEPER_H
@@ -0,0 +1,94 @@
+/*
+    modelrouter.h
+
+    Class declaration for ModelRouter.
+*/
+
+#ifndef MODELROUTER_H
+#define MODELROUTER_H
+
+#include <QSettings>
+#include <QString>
+
+/*
+    ModelRouter
+
+    Sorts prompts by intent, and decides which model answers them. Greetings, thanks and short questions that stand on
+    their own go to a small, fast model; long or open-ended questions, several questions at once, and follow-ups that
+    lean on the conversation so far go to the model configured in Ollama/Model. The decision comes from the wording
+    alone, so it takes no server round trip. The intent also picks the generation options a prompt is sent with (see
+    ProgramController). Settings (in the Routing group):
+
+        FastModel      the small model (empty = route nothing, the default)
+        MaxFastWords   longest prompt, in words, the small model is given (12)
+        Escalate       ask the configured model again when the small one's answer looks unsure (true)
+*/
+class ModelRouter
+{
+public:
+    enum Tier
+    {
+        Fast,
+        Large
+    };
+
+    enum Intent
+    {
+        SmallTalk, // greetings, thanks, goodbyes
+        Question,  // a short question that stands on its own
+        FollowUp,  // leans on what was said before
+        OpenEnded, // long, several questions at once, or asking for reasoning
+        IntentCount
+    };
+
+    struct Route
+    {
+        Tier tier;
+        Intent intent;
+        QString model;  // empty for the configured model
+        QString reason; // why, for the log
+    };
+
+    explicit ModelRouter(QSettings &settings);
+
+    /*
+        Returns whether a small model is set up to route to.
+    */
+    bool isEnabled() const;
+
+    /*
+        Returns whether an unsure answer from the small model is asked again of the configured one.
+    */
+    bool escalates() const;
+
+    /*
+        Picks the intent and tier for a prompt. midConversation is whether the conversation already has messages the
+        prompt could be following up on. Without a small model every prompt gets the large tier.
+    */
+    Route route(const QString &prompt, bool midConversation) const;
+
+    /*
+        Returns whether an answer says it doesn't know, or sends the visitor elsewhere, rather than answering.
+    */
+    static bool looksUnsure(const QString &answer);
+
+    /*
+        Returns "fast" or "large", as the tiers appear in the log and the metrics.
+    */
+    static QString tierName(Tier tier);
+
+    /*
+        Returns the intent's name as used in the settings, e.g. "SmallTalk".
+    */
+    static QString intentName(Intent intent);
+
+private:
+    // the intent, with the large tier
+    Route classify(const QString &prompt, bool midConversation) const;
+
+    QString fastModel;
+    int maxFastWords;
+    bool escalate;
+};
+
+#endif // MODELROUTER_H
@@ -0,0 +1,148 @@
+/*
+    navigationgraph.h
+
+    Class declaration for NavigationGraph.
+*/
+
+#ifndef NAVIGATIONGRAPH_H
+#define NAVIGATIONGRAPH_H
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+
+/*
+    NavigationGraph
+
+    The building map as a graph, used to answer "where is room X" questions without asking the model.
+
+    Hallways are a grid of waypoints; every room, bathroom, staircase or exit is a door on one compass side of a
+    waypoint, and a place may have several doors. Waypoints carry a floor number and staircases connect floors, so
+    further floors are added as more map data (in CampusData) rather than more code.
+
+    All shortest paths are computed once at construction and every route from every starting point is rendered to
+    turn-by-turn text up front, so answering a question is a pattern match and a hash lookup.
+*/
+class NavigationGraph
+{
+public:
+    NavigationGraph();
+
+    /*
+        Answers a navigation question such as "how do I get to room 147?" from the map. Returns an empty string if
+        the prompt is not asking for directions to a place on the map, in which case the model should answer it.
+    */
+    QString answer(const QString &prompt) const;
+
+    /*
+        Returns turn-by-turn directions to a place ("147", "bathroom", ...). Without an origin the directions start
+        from the default position, facing the big screen. Returns an empty string for unknown places.
+    */
+    QString directions(const QString &destination, const QString &origin = QString()) const;
+
+    /*
+        Returns the names of all places on the map.
+    */
+    QStringList places() const;
+
+    /*
+        Returns the directions from the default position to every place on the map, one line per place in map order.
+    */
+    QString overview() const;
+
+private:
+    enum Direction
+    {
+        North,
+        East,
+        South,
+        West,
+        Up,
+        Down
+    };
+
+    enum Turn
+    {
+        Straight,
+        Right,
+        Back,
+        Left
+    };
+
+    enum PlaceKind
+    {
+        Room,
+        Bathroom,
+        Stairs,
+        Exit,
+        Elevator
+    };
+
+    struct Door
+    {
+        int place;
+        int node;
+        Direction side; // which side of the hallway the door is on
+    };
+
+    struct Node
+    {
+        int floor;
+        int x; // east
+        int y; // north
+        QList<int> neighbours;
+        QList<Door> doors;
+    };
+
+    struct Place
+    {
+        QString name; // as used mid-sentence, e.g. "Room 125" or "the stairs"
+        QString key;  // lookup key, e.g. "125" or "stairs"
+        PlaceKind kind;
+        QList<Door> doors;
+    };
+
+    // a stretch of the route walked in one direction, from path[start] to path[end]
+    struct Run
+    {
+        qsizetype start;
+        qsizetype end;
+        Direction heading;
+    };
+
+    void load();
+    void computeShortestPaths();
+    void renderAllRoutes();
+
+    QString render(int origin, int destination) const;
+    QString openingSentence(int origin, Turn turn) const;
+    QString turnSentence(const QList<int> &path, const Run &run, Direction nextHeading, int destination) const;
+    QString arrivalSentence(const QList<int> &path, const Run &run, const Door &door, bool firstRun) const;
+    QString passingPhrase(const QList<int> &path, const Run &run, int destination) const;
+
+    QList<int> shortestPath(int from, int to) const;
+    Direction directionBetween(int from, int to) const;
+    bool hasNeighbour(int node, Direction direction) const;
+    int findPlace(const QString &key) const;
+    int routeKey(int origin, int destination) const;
+
+    static Turn turnBetween(Direction from, Direction to);
+    static Direction rotate(Direction heading, Turn turn);
+    static QString turnName(Turn turn);
+    static QString ordinal(int n);
+    static QString capitalized(const QString &text);
+    static QString verbFor(const Place &place);
+
+    QList<Node> nodes;
+    QList<Place> placeList;
+    QHash<QString, int> placeIndex; // key -> index in placeList
+    int startNode;                  // the default position, in front of the big screen
+
+    QList<int> distances; // nodes.size() squared, row major
+    QList<int> nextHop;   // first step on the shortest path from row to column, -1 if unreachable
+
+    QHash<int, QString> routes; // routeKey(origin, destination) -> rendered directions
+};
+
+#endif // NAVIGATIONGRAPH_H
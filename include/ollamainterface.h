@@ -3,32 +3,187 @@
 
 #include <QObject>
 #include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <QNetworkAccessManager>
 #include <QNetworkReply>
 #include <QUrl>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
+#include <QMap>
+#include <QHash>
+#include <QStringList>
+#include <functional>
 #include <string>
 #include "threadworker.h"
+#include "streamparser.h"
+#include "contextmanager.h"
+#include "responsecache.h"
+#include "backendpool.h"
+#include "telemetry.h"
+#include "toolregistry.h"
 
 using std::string;
 
+/*
+    OllamaInterface
+
+    Talks to the Ollama servers on behalf of any number of conversations at once. Each conversation is a session with
+    its own history; requests, signals and the history all carry the session they belong to, so answers streaming in
+    for one never end up in another.
+
+    Decoding the streamed replies happens on a worker thread, so the thread drawing the UI only copies bytes off the
+    sockets and gets each received chunk's text in one piece. Request bodies need no work there: the history is kept
+    as JSON text (see ContextManager), and the rest of a request is encoded once per setting change, so a body is put
+    together by copying those pieces.
+
+    With tools set, the model may call them instead of answering. The calls run at the same time and their results
+    go back to the model in a streamed follow-up request, which waits its turn for a request slot like any prompt.
+
+    A session has at most one prompt being answered. With a limit on concurrent requests, prompts beyond it wait in a
+    queue that is served in order, so one busy session can't keep the others from their turn. Idle sessions can be
+    evicted after a while, or when their histories together grow past a memory budget; a prompt to an evicted session
+    starts over from an empty history.
+*/
 class OllamaInterface : public QObject
 {
     Q_OBJECT
 public:
+    // Why a reply ended before the model finished it
+    enum StopReason
+    {
+        NotStopped,
+        Cancelled,  // cancel() was called
+        TimedOut,   // the request ran past its timeout, or the server went quiet for too long
+        Interrupted // the connection failed partway through the answer
+    };
+    Q_ENUM(StopReason)
+
+    // How one prompt is to be answered, where that differs from the configured model and the server's defaults
+    struct PromptOptions
+    {
+        // a constructor rather than member initializers, so sendPrompt() can take a default-constructed one
+        PromptOptions() : escalate(false), think(-1), numPredict(0), temperature(-1)
+        {
+        }
+
+        QString model;      // answers instead of the configured model, if not empty
+        bool escalate;      // with a model above: ask the configured one instead if the answer looks unsure
+        int think;          // 1 to let a thinking model reason before answering, 0 not to, -1 for its default
+        int numPredict;     // most tokens to generate (0 = no limit)
+        double temperature; // negative for the model's default
+        QStringList stop;   // sequences that end the answer when generated
+
+        bool isDefault() const
+        {
+            return model.isEmpty() && think < 0 && numPredict <= 0 && temperature < 0 && stop.isEmpty();
+        }
+    };
+
     explicit OllamaInterface(string url, string model, int contextSize, int timeout);
     ~OllamaInterface();
 
-    // Ping the Ollama server
-    bool ping();
+    // Probe the Ollama servers in the background. The result arrives through pingFinished() (for the primary server)
+    // and connectedChanged() (for the pool as a whole)
+    void ping();
+
+    // Keep probing the servers: every intervalSeconds while they answer, and with exponential backoff from one second
+    // while they don't. An interval of 0 only probes when ping() is called
+    void startHealthMonitor(int intervalSeconds);
+
+    // Add servers to share the chat requests with, besides the primary one set with setURL()
+    void addBackends(const QStringList &urls);
+
+    // How a server is chosen for each chat request
+    void setRouting(BackendPool::Routing routing);
+
+    // Send a chat request to a second server as well if the first hasn't started answering within this percentile of
+    // its recent response times (0 = never)
+    void setHedgePercentile(int percentile);
+
+    // Number of chat requests that were hedged on a second server
+    int hedgedRequests() const;
+
+    // Start a new conversation and return its session id
+    int openSession();
+
+    // Stop anything the session is waiting on and forget it
+    void closeSession(int session);
+
+    // Most chat requests sent at the same time, over all sessions (0 = no limit)
+    void setMaxConcurrentRequests(int requests);
+
+    // Evict sessions that have been idle for idleMinutes, and the longest idle ones while all histories together take
+    // more than memoryBudget bytes (0 = no limit for either)
+    void setSessionLimits(int idleMinutes, qint64 memoryBudget);
+
+    // Send a prompt to the model and receive the result asynchronously. Reference text, if given, is passed to the
+    // model along with the prompt. A prompt sent while the session is still busy with one is refused with
+    // requestError()
+    //
+    // The options apply to this prompt only, tool call rounds included. With escalate, an answer from the options'
+    // model that looks unsure (see ModelRouter::looksUnsure()) is dropped and the configured model asked instead,
+    // which responseEscalated() announces. A thinking model's reasoning arrives through thinkingReceived(), apart
+    // from the answer, and is not kept in the history
+    void sendPrompt(int session, const QString &systemPrompt, const QString &userPrompt,
+                    const QString &reference = QString(), const PromptOptions &options = PromptOptions());
 
-    // Send a prompt to the model and receive the result asynchronously
-    void sendPrompt(const QString &systemPrompt, const QString &userPrompt);
+    // Ask a server to evaluate the session's history, and what the user has typed so far, ahead of the prompt, so the
+    // server has it in its prompt cache when the prompt is sent. A new prefill replaces one still in flight; one that
+    // comes sooner than the prefill interval after the last is ignored
+    void prefill(int session, const QString &systemPrompt, const QString &draft);
 
-    // request web search from ollama api
-    void requestWebSearch(const QString &query, const QString &apiKey);
+    // Shortest time between two prefills of the same session, in milliseconds
+    void setPrefillInterval(int msec);
+
+    // Abort the session's prompt, whether it is in flight or still queued. Whatever had been generated stays in the
+    // history, marked as cut short, and responseStopped() is emitted
+    void cancel(int session);
+
+    // The text added to a cut-short answer in the history
+    static QString truncationMarker(StopReason reason);
+
+    // Embed a batch of texts with an embedding model. The callback gets one vector per input, or an error message
+    void requestEmbeddings(const QString &embedModel, const QStringList &input,
+                           std::function<void(const QList<QList<float>> &embeddings, const QString &error)> onFinished);
+
+    // Offer the model these tools. It may call them in up to maxRounds rounds per prompt; after that it has to answer.
+    // The registry is not owned
+    void setTools(ToolRegistry *registry, int maxRounds);
+
+    // Search the web through Ollama's web search API, or a stand-in at another endpoint. The callback gets the
+    // results as text for the model, or an error message
+    void requestWebSearch(const QString &endpoint, const QString &query, const QString &apiKey,
+                          std::function<void(const QString &results, const QString &error)> onFinished);
+
+    // Load the model into server memory ahead of the first prompt. If a warm-up prompt is set it is evaluated as
+    // well so the server has its KV prefix cached
+    void preloadModel();
+
+    // Ask the server to release the model from memory now
+    void unloadModel();
+
+    // Answer repeated prompts from a persistent cache of earlier responses
+    bool openResponseCache(const QString &path, qint64 maxBytes, int maxAgeHours);
+
+    // Counters for tuning the response cache. Coalesced prompts were identical to one already in flight and were
+    // answered from that request instead of a new one
+    int cacheHits() const;
+    int cacheMisses() const;
+    int coalescedRequests() const;
+
+    // Add an exchange that was answered without the model to the history, so follow-up questions have it as context
+    void recordExchange(int session, const QString &userPrompt, const QString &response);
+
+    // Whether the session's history holds any messages besides the system prompt
+    bool hasHistory(int session) const;
+
+    // Forget the conversation so far; the next prompt starts from just the system prompt
+    void clearHistory(int session);
+
+    // Put back a message from a saved conversation without announcing it through historyAppended
+    void restoreMessage(int session, const QString &role, const QString &content);
 
     bool isConnected() const;
     void setURL(string url);
@@ -39,32 +194,247 @@ public:
     int getContextSize() const;
     void setTimeout(int seconds);
     int getTimeout() const;
+    void setIdleTimeout(int seconds);
+    int getIdleTimeout() const;
+    void setKeepAlive(string keepAlive);
+    string getKeepAlive() const;
+    void setWarmupPrompt(const QString &systemPrompt);
 
 signals:
     void pingFinished(bool success);
-    void responseReceived(const QString &response);
-    void responseFinished();
-    void requestError(const QString &error);
+    void connectedChanged(bool connected);
+    void responseReceived(int session, const QString &response);
+    void thinkingReceived(int session, const QString &thinking);
+    void responseFinished(int session);
+    void responseStopped(int session, OllamaInterface::StopReason reason);
+
+    // the answer streamed so far came from the prompt's own model and looked unsure; it is dropped, and the configured
+    // model's answer follows through responseReceived() as if from the start
+    void responseEscalated(int session);
+    void requestMeasured(const RequestTimings &timings);
+    void requestError(int session, const QString &error);
+    void cacheStatsChanged();
+    void historyAppended(int session, const QString &role, const QString &content);
+
+    // the session's history was dropped to save memory; it starts over on the next prompt
+    void sessionEvicted(int session);
+
+    // a prefill was sent, and a prompt followed one or more prefills; it paid off if the last of them had finished
+    // with the history the prompt was sent with
+    void prefillSent();
+    void prefillUsed(bool paidOff);
 
 private slots:
     void onPingReply(QNetworkReply *reply);
     void onPromptReply(QNetworkReply *reply);
-    void receiveWebSearch(QNetworkReply *reply);
 
 private:
-    void addMessageToHistory(QString role, QString content);
+    // one conversation
+    struct Session
+    {
+        enum State
+        {
+            Idle,
+            Queued,    // waiting for a free request slot
+            Waiting,   // on an identical prompt that is already being answered
+            Running,
+            Calling    // running the tools the model called; the request slot is free meanwhile
+        };
+
+        explicit Session(int contextSize = 0) : context(contextSize) {}
 
-    // send a prompt to the model containing the response from a tool function
-    void sendToolPrompt(const QString &toolResponse);
+        void setSystemPrompt(const QString &prompt)
+        {
+            if (prompt.isEmpty() || prompt == context.getSystemPrompt())
+                return;
+            context.setSystemPrompt(prompt);
+            ++historyVersion;
+        }
 
-    bool connected;
-    string url;
+        ContextManager context; // message history, kept within the context window
+        State state = Idle;
+        QByteArray cacheKey;  // of the prompt being answered, if the cache is open
+        qint64 lastActive = 0; // on the clock below
+        quint64 ticket = 0;    // counts tool call rounds, so results for a prompt that was since stopped are dropped
+        int toolRounds = 0;    // of the prompt being answered
+        PromptOptions options; // of the prompt being answered
+        QByteArray head;       // its requests start with this rather than chatHead, if not empty
+
+        // speculative prefill of the history while the next prompt is being typed
+        quint64 historyVersion = 0; // bumped whenever the messages sent to the model change
+        QNetworkReply *prefillReply = nullptr;
+        bool prefillPending = false; // prefills were sent since the last prompt
+        qint64 prefilledVersion = -1; // of the last prefill that finished, -1 if none
+        qint64 lastPrefill = -1;      // on the clock below
+        int prefillBackend = -1;      // the prompt goes where its prefix was evaluated
+    };
+
+    // what the worker made of one chunk of a streamed reply
+    struct DecodedChunk
+    {
+        QString content; // the assistant text of every line in the chunk, joined
+        QString thinking; // the same for the model's reasoning
+        StreamEvent end; // the done or error line, if the chunk had one
+        QJsonArray toolCalls;
+    };
+
+    // the session, created empty if it doesn't exist (any more)
+    Session &sessionFor(int session);
+
+    void addMessageToHistory(int session, QString role, QString content);
+
+    // send queued prompts while there are free request slots
+    void dispatch();
+    void sendChat(Session &current, int session);
+    void sendPrefill(int session, quint64 version, const QByteArray &body);
+
+    // the session's prompt has been answered, or given up on; its request slot is free again
+    void endRequest(int session);
+
+    // give up on a prompt that was never sent
+    void stopUnsent(int session, StopReason reason);
+
+    void evictSessions();
+
+    void setConnected(bool isConnected);
+
+    // open the TCP connection to a server ahead of the first request
+    void warmConnection(int backend);
+
+    // health probes: send one now, or arm the timer for the next one due
+    void probe(int backend);
+    void scheduleProbes();
+    void onProbesDue();
+
+    // post a chat request body to one server. Unless this is already a retry, a request that is slow to start
+    // answering may be hedged on another server
+    QNetworkReply *postChat(int session, const QByteArray &body, int backend, int failovers, bool allowHedge);
+    void hedge(QNetworkReply *reply);
+
+    // abort the reply that lost a hedge race, without it reporting anything
+    void discardReply(QNetworkReply *reply);
+
+    // abort a reply on purpose, and wrap up one that ended early, keeping what it had generated
+    void stopReply(QNetworkReply *reply, StopReason reason);
+    void endTruncated(QNetworkReply *reply, int session, const QString &partial, StopReason reason);
+
+    // hand the cache key of a request over to the reply that now carries it
+    void moveCacheKey(QNetworkReply *from, QNetworkReply *to);
+
+    // failures that mean the server can't be reached, as opposed to it answering with an error
+    static bool isConnectionError(QNetworkReply::NetworkError error);
+
+    // model options sent with every chat request
+    QJsonObject requestOptions() const;
+
+    // encode the parts of the chat and prefill requests that only change with the settings
+    void updateRequestHeads();
+    QByteArray encodeHead(const PromptOptions &options, bool prefill) const;
+
+    // the options that change an answer, encoded the same whenever they are the same, for the response cache key
+    static QByteArray generationKey(const PromptOptions &options);
+
+    // the chat request body for the session's history as it stands
+    QByteArray chatRequest(const Session &session) const;
+
+    // keep_alive as the server expects it: a number of seconds, or a duration string such as "30m"
+    QJsonValue keepAliveValue() const;
+
+    // post a chat request whose reply content is not needed (model loading and unloading)
+    void postControlRequest(const QJsonObject &json, const char *description);
+
+    // hook up the readyRead/finished handlers for a streamed /api/chat reply
+    void watchPromptReply(QNetworkReply *reply);
+
+    // hand a chunk of a reply to the worker to decode; the result comes back through onDecoded(). The last chunk is
+    // sent once the reply has finished, and wraps it up with finishReply()
+    void decode(quint64 stream, const QByteArray &data, bool last);
+    void onDecoded(quint64 stream, const DecodedChunk &chunk, bool last);
+    void finishReply(QNetworkReply *reply);
+
+    // play a cached response back through the same signals as a streamed one
+    void replayResponse(int session, const QString &response);
+
+    // answer the prompts that were waiting on an identical in-flight request
+    void releaseWaiters(const QByteArray &key, const QString &response, const QString &error);
+
+    // run the tools the model called in its reply, then send the results back to it
+    void callTools(int session, const QString &content, const QJsonArray &calls);
+
+    // drop the session's answer and queue the prompt again for the configured model
+    void escalatePrompt(int session);
+
+    bool connected; // any server reachable, as of the last probe or request; requests are sent regardless
+    BackendPool backends;
     string model;
-    int contextSize; // in tokens
-    int timeout; // in seconds
-    QJsonArray messageHistory;
+    int timeout;     // longest a chat request may take, in seconds (0 = no limit)
+    int idleTimeout; // longest gap between two pieces of a streaming answer, in seconds (0 = no limit)
+    string keepAlive; // how long the server keeps the model loaded after a request
+    QString warmupPrompt;
+    int contextSize;  // in tokens, for every session
+    QByteArray chatHead;    // {"model":...,"options":...,"messages": of every chat request, up to the messages
+    QByteArray prefillHead; // the same for prefills, which don't stream and stop after one token
+
+    QHash<int, Session> sessions;
+    int nextSession;
+    QList<int> queue;   // sessions with a prompt waiting for a request slot, oldest first
+    int maxConcurrent;  // 0 = no limit
+    int running;        // sessions with a request in flight
+    qint64 sessionIdleLimit; // in milliseconds, 0 = never evict for being idle
+    qint64 sessionMemoryBudget; // in bytes, 0 = no budget
+    int prefillInterval; // in milliseconds
+    ToolRegistry *tools; // nullptr = no tools
+    int maxToolRounds;
+    QTimer evictionTimer;
+
+    // what the worker keeps of a reply that is still streaming
+    struct StreamDecoder
+    {
+        StreamParser parser;    // carry-over buffer for a line split across reads
+        bool inThinkTag = false; // inside <think>...</think>, for models that put their reasoning in the answer text
+    };
+
+    // by stream id. only touched on the worker thread
+    QHash<quint64, StreamDecoder> decoders;
+    StreamEvent streamEvent;
+
+    ResponseCache responseCache;
+    QMap<QNetworkReply *, QByteArray> replyKeys; // cache key of each streaming prompt reply
+    QHash<QByteArray, QList<int>> inFlight;     // cache key -> sessions with an identical prompt waiting on it
+    int coalescedCount;
+
+    // a chat request on its way to one server
+    struct ChatAttempt
+    {
+        int session;
+        int backend;
+        QByteArray body;     // kept to fail over or hedge on another server
+        QElapsedTimer sent;
+        bool receivedData;   // once anything has arrived the request can no longer move
+        int failovers;       // servers already tried before this one
+        QNetworkReply *rival; // the other half of a hedged request
+        qint64 firstByte;     // these four in nanoseconds on the sent timer, -1 until they happen
+        qint64 firstThought;
+        qint64 firstToken;
+        qint64 lastToken;
+        QString response;     // the answer so far
+        StopReason stopped;
+        QTimer *idleTimer;    // owned by the reply
+        quint64 stream;       // names the reply to the worker, which never touches the reply itself
+        bool ended;           // the done or error line has been handled, or the request was stopped
+        QJsonArray toolCalls; // the model's, as they came in
+    };
+    QMap<QNetworkReply *, ChatAttempt> chatAttempts;
+    QHash<quint64, QNetworkReply *> streams; // stream id -> reply, for as long as the attempt lasts
+    quint64 nextStream;
+    int hedgedCount;
 
     QNetworkAccessManager *networkManager;
+    QHash<QNetworkReply *, int> probes; // health probes in flight -> backend
+    QList<qint64> probeDue;             // per backend, on the clock below; -1 = not scheduled
+    QElapsedTimer clock;
+    QTimer healthTimer;
+    int healthInterval; // in milliseconds, 0 = no background probes
     QThread requestThread;
     ThreadWorker worker;
 };
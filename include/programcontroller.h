@@ -5,7 +5,22 @@
 #include <QString>
 #include <QtQmlIntegration>
 #include "ollamainterface.h"
+#include "chatmodel.h"
+#include "conversationstore.h"
+#include "modelkeeper.h"
+#include "modelrouter.h"
+#include "navigationgraph.h"
+#include "retriever.h"
+#include "telemetry.h"
+#include "toolregistry.h"
+#include <QElapsedTimer>
+#include <QHash>
 #include <QSettings>
+#include <QTimer>
+#include <QVariantList>
+#include <QVariantMap>
+
+class QQuickWindow;
 
 /*
     Serves as the interface to C++ from QML.
@@ -59,21 +74,25 @@ public:
     Q_INVOKABLE int getTimeout() const;
 
     /*
-        Pings the Ollama server and returns the status.
+        Checks the connection to the Ollama server in the background. The result arrives through pingFinished().
     */
-    Q_INVOKABLE bool pingOllama();
+    Q_INVOKABLE void pingOllama();
 
     /*
         Returns whether the Ollama server is connected.
     */
     Q_INVOKABLE bool getOllamaStatus();
 
+    Q_PROPERTY(bool connected READ getOllamaStatus NOTIFY connectedChanged);
+
     enum GenerateStatus
     {
         Idle,
         Generating,
         Finished,
-        Error
+        Error,
+        Cancelled,
+        TimedOut
     };
     Q_ENUM(GenerateStatus)
 
@@ -82,10 +101,98 @@ public:
     */
     Q_INVOKABLE void generate(const QString& prompt);
 
+    /*
+        Tells the controller what is in the input field. With speculation on, a pause in typing has the server
+        evaluate the conversation so far, so the answer starts sooner once the prompt is sent.
+    */
+    Q_INVOKABLE void updateDraft(const QString &text);
+
+    /*
+        Stops the answer being generated. What has been generated so far stays in the chat, marked as cut short.
+    */
+    Q_INVOKABLE void cancel();
+
     Q_INVOKABLE GenerateStatus getGenerateStatus() const;
 
     Q_PROPERTY(GenerateStatus generateStatus READ getGenerateStatus NOTIFY generateStatusChanged);
 
+    /*
+        Returns the model holding the chat messages shown in the chat view.
+    */
+    ChatModel *getChatModel();
+
+    Q_PROPERTY(ChatModel *chatModel READ getChatModel CONSTANT);
+
+    /*
+        Starts a new conversation: removes all messages from the chat view and from the history the model sees. An
+        answer still being generated is stopped first.
+    */
+    Q_INVOKABLE void clearChat();
+
+    /*
+        Response cache counters, for tuning the cache settings.
+    */
+    int getCacheHits() const;
+    int getCacheMisses() const;
+    int getCoalescedRequests() const;
+
+    Q_PROPERTY(int cacheHits READ getCacheHits NOTIFY cacheStatsChanged);
+    Q_PROPERTY(int cacheMisses READ getCacheMisses NOTIFY cacheStatsChanged);
+    Q_PROPERTY(int coalescedRequests READ getCoalescedRequests NOTIFY cacheStatsChanged);
+
+    /*
+        The upcoming events (title, month, day, time, location) and the contacts (name, email, phone, room), from the
+        campus data compiled into the program.
+    */
+    QVariantList getEvents() const;
+    QVariantList getContacts() const;
+
+    Q_PROPERTY(QVariantList events READ getEvents CONSTANT);
+    Q_PROPERTY(QVariantList contacts READ getContacts CONSTANT);
+
+    /*
+        Request timings for the diagnostics overlay: per stage (firstByte, firstToken, generation, request, modelLoad,
+        promptEval, eval, uiRender, thinking) the last, median and 95th percentile time in milliseconds and the sample
+        count.
+    */
+    QVariantMap getDiagnostics() const;
+
+    Q_PROPERTY(QVariantMap diagnostics READ getDiagnostics NOTIFY diagnosticsChanged);
+
+    /*
+        Measures how long streamed tokens take to show up in frames of this window.
+    */
+    void watchFrames(QQuickWindow *window);
+
+    /*
+        Passes on how long a phase of starting up took, for the diagnostics overlay and the metrics file.
+    */
+    void recordStartup(const QString &phase, qint64 nsecs);
+
+    /*
+        Conversations for clients other than this screen, such as the displays served by ChatService. They get the
+        same directions, content lookups and tools as the one on screen, but nothing of theirs is shown or saved.
+    */
+    int openConversation();
+    void closeConversation(int session);
+
+    /*
+        Sends a prompt in a conversation opened above. Returns false if the conversation is unknown or still busy
+        with the last prompt. The answer arrives through answerReceived() and answerFinished(), possibly before this
+        returns.
+    */
+    bool ask(int session, const QString &prompt);
+
+    /*
+        Stops the conversation's answer; answerFinished() follows with Cancelled.
+    */
+    void cancelAnswer(int session);
+
+    /*
+        The request timings in the Prometheus text format.
+    */
+    QByteArray metrics() const;
+
 signals:
     /*
         Signal to be emitted when Ollama finishes generating a response to pass the response on to QML.
@@ -93,6 +200,16 @@ signals:
     void generateFinished(QString response);
     void streamFinished();
 
+    /*
+        Signal to be emitted when a connection check started by pingOllama() finishes.
+    */
+    void pingFinished(bool success);
+
+    /*
+        Signal to be emitted when the Ollama server becomes reachable or unreachable.
+    */
+    void connectedChanged();
+
     /*
         Signal to be emitted when the response from Ollama could not be parsed.
     */
@@ -103,20 +220,111 @@ signals:
     */
     void generateStatusChanged();
 
+    /*
+        Signal to be emitted when the response cache counters change.
+    */
+    void cacheStatsChanged();
+
+    /*
+        Signal to be emitted when new request timings are in.
+    */
+    void diagnosticsChanged();
+
+    /*
+        Signals to be emitted as the answer in a conversation opened with openConversation() streams in and ends.
+    */
+    void answerReceived(int session, const QString &text);
+    void answerFinished(int session, ProgramController::GenerateStatus status);
+
+    /*
+        Signal to be emitted when the answer so far in such a conversation is dropped, and a new one starts streaming.
+    */
+    void answerRestarted(int session);
+
 private slots:
     /*
         Slot to be called when Ollama finishes generating a response.
         Decodes the output and then invokes abc2midi to convert the output to a MIDI file.
     */
-    void onGenerateFinished(QString response);
-    void onStreamFinished();
+    void onGenerateFinished(int session, QString response);
+    void onStreamFinished(int session);
+    void onRequestError(int session, const QString &error);
+    void onResponseStopped(int session, OllamaInterface::StopReason reason);
+    void onSessionEvicted(int session);
+    void onResponseEscalated(int session);
+    void onThinkingReceived(int session, const QString &thinking);
 
 private:
     QSettings settings;
     OllamaInterface ollama;
+    ChatModel chatModel;
+    ModelKeeper modelKeeper;
+    NavigationGraph navigation;
+    Retriever retriever;
+    ModelRouter router;
+    ToolRegistry tools;
+    int chatSession; // the conversation on this screen
+    Telemetry telemetry;
+    ConversationStore conversations;
     GenerateStatus currentGenerateStatus;
+    quint64 generation; // counts prompts, so a lookup finishing after its prompt was stopped can be dropped
+    QString draft;      // the input field's text, prefilled once typing pauses
+    QTimer draftTimer;
+    QString systemPrompt; // sent with every conversation, composed once at startup
+    QHash<int, quint64> otherConversations; // session -> the prompt being answered, 0 while idle
+    quint64 lastAsk;
+
+    // how a prompt was routed, kept while it is answered
+    struct RoutedPrompt
+    {
+        QString tier; // "fast", "large", or "escalated" once a fast answer was asked again
+        QElapsedTimer sent;
+    };
+    QHash<int, RoutedPrompt> routedPrompts; // by session
+    QList<OllamaInterface::PromptOptions> intentOptions; // by ModelRouter::Intent
+    bool showThinking; // a thinking model's reasoning is shown, folded away, above its answer
+
+    /*
+        Reads the generation options for each intent from the Generation settings.
+    */
+    void loadGenerationOptions();
+
+    /*
+        Sends a prompt to the model the router picks for it, with the generation options for its intent.
+    */
+    void sendPrompt(int session, const QString &prompt, const QString &reference);
+
+    /*
+        Records how long the session's routed prompt took, once its answer is complete.
+    */
+    void finishRoute(int session);
+
+    /*
+        Ends the answer in one of the other conversations.
+    */
+    void finishAnswer(int session, GenerateStatus status);
 
     void setGenerateStatus(GenerateStatus);
+
+    /*
+        Puts the last conversation back in the chat view and the model's history.
+    */
+    void restoreConversation();
+
+    /*
+        Saves the answer in the last chat message once it is complete.
+    */
+    void saveAnswer();
+
+    /*
+        Offers the model the map, the events list and, if it is set up, a web search as tools.
+    */
+    void registerTools();
+
+    /*
+        Composes the system prompt from the campus data, for a model that can or can't call the tools.
+    */
+    QString composeSystemPrompt(bool withTools) const;
 };
 
 #endif // PROGRAMCONTROLLER_H
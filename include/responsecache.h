@@ -0,0 +1,96 @@
+/*
+    responsecache.h
+
+    Class declaration for ResponseCache.
+*/
+
+#ifndef RESPONSECACHE_H
+#define RESPONSECACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QString>
+
+/*
+    ResponseCache
+
+    Finished model answers stored on disk so a question that has been asked before can be answered without a new
+    generation. Entries are keyed by a hash of the model, the conversation so far (system prompt included) and the
+    normalized prompt, so an answer is only reused in the same context it was generated in.
+
+    The cache is a single file that is memory-mapped while open: lookups read straight from the mapping and marking an
+    entry as used is a write into it, so only inserts touch the file through the normal I/O path. When the file grows
+    past its size cap the least recently used entries are dropped and the survivors are rewritten to a new file.
+*/
+class ResponseCache
+{
+public:
+    ResponseCache();
+    ~ResponseCache();
+
+    ResponseCache(const ResponseCache &) = delete;
+    ResponseCache &operator=(const ResponseCache &) = delete;
+
+    /*
+        Opens (or creates) the cache file. maxBytes caps the file size; entries older than maxAgeHours are treated as
+        missing (0 = they never expire). Returns false if the file can't be used, in which case the cache stays closed
+        and every lookup misses.
+    */
+    bool open(const QString &path, qint64 maxBytes, int maxAgeHours);
+
+    /*
+        Unmaps and closes the cache file.
+    */
+    void close();
+
+    bool isOpen() const;
+
+    /*
+        Looks up a cached response. On a hit the entry becomes the most recently used one.
+    */
+    bool lookup(const QByteArray &key, QString &response);
+
+    /*
+        Stores a response, replacing any previous one for the same key.
+    */
+    void insert(const QByteArray &key, const QString &response);
+
+    /*
+        Returns the cache key for a prompt. Case, surrounding whitespace and trailing punctuation of the prompt are
+        ignored, so "Where is room 147?" and "where is room 147" share an entry. options are the generation options the
+        answer is made with, in any encoding that is the same for the same options, so an answer cut short or made
+        with another temperature isn't served for the default ones. conversation is the messages before the prompt as
+        the JSON text they are sent as.
+    */
+    static QByteArray makeKey(const QString &model, const QByteArray &options, const QByteArray &conversation,
+                              const QString &prompt);
+
+    int hits() const;
+    int misses() const;
+    int entries() const;
+
+private:
+    struct Entry
+    {
+        qint64 offset; // of the record header in the file
+        qint64 created;
+    };
+
+    bool map();
+    bool load();
+    void compact();
+    void markDead(qint64 offset);
+
+    QFile file;
+    uchar *mapped;
+    qint64 mappedSize;
+    qint64 maxBytes;
+    qint64 maxAge; // in milliseconds, 0 = no limit
+
+    QHash<QByteArray, Entry> index;
+    int hitCount;
+    int missCount;
+};
+
+#endif // RESPONSECACHE_H
@@ -0,0 +1,96 @@
+/*
+    retrievalindex.h
+
+    Class declaration for RetrievalIndex.
+*/
+
+#ifndef RETRIEVALINDEX_H
+#define RETRIEVALINDEX_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+
+/*
+    RetrievalIndex
+
+    A read-only, memory-mapped file of text chunks and their embedding vectors, searched by cosine similarity.
+
+    The vectors are normalized when the file is written and stored back to back as 32-bit floats, so a search is one
+    pass of dot products over a single contiguous block of memory. The dot product uses AVX2/FMA or SSE on x86 and NEON
+    on ARM, picked once at startup from what the CPU supports. Each chunk also records a hash of its text, which lets a
+    rebuild reuse the vectors of chunks that have not changed.
+*/
+class RetrievalIndex
+{
+public:
+    struct Entry
+    {
+        QByteArray hash; // identifies the chunk text and the model that embedded it
+        QString text;
+        QList<float> vector;
+    };
+
+    struct Match
+    {
+        int chunk;
+        float score; // cosine similarity, -1 to 1
+    };
+
+    RetrievalIndex();
+    ~RetrievalIndex();
+
+    RetrievalIndex(const RetrievalIndex &) = delete;
+    RetrievalIndex &operator=(const RetrievalIndex &) = delete;
+
+    /*
+        Maps an index file written by write(). Returns false if it is missing or not a valid index.
+    */
+    bool open(const QString &path);
+
+    void close();
+    bool isOpen() const;
+
+    /*
+        Returns the number of chunks in the index.
+    */
+    int size() const;
+
+    /*
+        Returns the length of the vectors in the index.
+    */
+    int dimension() const;
+
+    /*
+        Returns the k chunks most similar to the query vector, best first. The query doesn't need to be normalized.
+    */
+    QList<Match> search(const float *query, int k) const;
+
+    QString text(int chunk) const;
+    QByteArray hash(int chunk) const;
+
+    /*
+        Returns the normalized vector of a chunk, dimension() floats long.
+    */
+    const float *vector(int chunk) const;
+
+    /*
+        Writes a new index file, replacing the old one atomically. Every entry's vector must have the given dimension.
+        The file must not be open in any RetrievalIndex while it is replaced.
+    */
+    static bool write(const QString &path, int dimension, const QList<Entry> &entries);
+
+private:
+    QFile file;
+    const uchar *mapped;
+    qint64 mappedSize;
+
+    int count;
+    int dims;
+    const float *vectors;
+    const uchar *chunks; // one ChunkRecord per chunk
+    const char *texts;
+};
+
+#endif // RETRIEVALINDEX_H
@@ -0,0 +1,97 @@
+/*
+    retriever.h
+
+    Class declaration for Retriever.
+*/
+
+#ifndef RETRIEVER_H
+#define RETRIEVER_H
+
+#include <QObject>
+#include <QSettings>
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include "retrievalindex.h"
+
+class OllamaInterface;
+
+/*
+    Retriever
+
+    Looks up the parts of the college content (events, contacts, ...) that are relevant to a question, so only those
+    are sent to the model instead of everything in the system prompt. Settings (in the Retrieval group):
+
+        Enabled         look up reference material for prompts (default true)
+        ContentPath     directory of further .md and .txt files to index (default "content")
+        IndexPath       where the index is stored (default "cob_zippy_ai_retrieval.index")
+        EmbedModel      Ollama embedding model (default "nomic-embed-text")
+        TopK            most chunks to pass to the model per prompt (default 3)
+        MinScore        cosine similarity below which a chunk is not considered relevant (default 0.5)
+
+    Documents compiled into the program (see addDocument()) are indexed along with the files. Content files and
+    documents are split into chunks at blank lines, each chunk carrying the heading it sits under. Rebuilding the
+    index only embeds chunks whose text (or the embedding model) changed; the vectors of the others are copied over
+    from the previous index.
+*/
+class Retriever : public QObject
+{
+    Q_OBJECT
+
+public:
+    Retriever(OllamaInterface *ollama, QSettings &settings, QObject *parent = nullptr);
+
+    /*
+        Adds a document to index along with the content files, for text the program already holds.
+    */
+    void addDocument(const QString &text);
+
+    /*
+        Brings the index up to date with the content directory in the background. The previous index keeps answering
+        queries until the new one is ready.
+    */
+    void rebuild();
+
+    /*
+        Returns whether there is an index to search.
+    */
+    bool isReady() const;
+
+    /*
+        Finds the chunks relevant to a query and passes them to the callback as one block of text, which is empty if
+        nothing relevant was found or the lookup failed.
+    */
+    void retrieve(const QString &query, std::function<void(const QString &reference)> onFinished);
+
+    /*
+        Splits a content file into chunks of at most maxChars characters (unless a single paragraph is longer).
+    */
+    static QStringList chunkText(const QString &text, int maxChars);
+
+signals:
+    void indexRebuilt(int chunks);
+
+private:
+    void embedNextBatch();
+    void finishRebuild();
+
+    OllamaInterface *ollama;
+    RetrievalIndex index;
+
+    bool enabled;
+    QStringList documents;
+    QString contentPath;
+    QString indexPath;
+    QString embedModel;
+    int topK;
+    float minScore;
+
+    // rebuild state
+    bool building;
+    bool stale; // the last rebuild failed, so try again on the next query
+    QList<RetrievalIndex::Entry> entries;
+    QList<qsizetype> pending; // entries still waiting for a vector
+    int dimension;
+};
+
+#endif // RETRIEVER_H
@@ -0,0 +1,56 @@
+/*
+    startuptrace.h
+
+    Class declaration for StartupTrace.
+*/
+
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+class QQuickWindow;
+
+/*
+    StartupTrace
+
+    Times how long the kiosk takes to come up, phase by phase. Every mark() records the time since the trace was
+    created, which main() does before anything else. Watching the window adds "firstFrame" once the first frame is on
+    screen and "interactive" once the event loop has caught up after it, which is when a touch is first handled.
+
+    The phases are logged when the trace is complete, and then finished() is emitted.
+*/
+class StartupTrace : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Phase
+    {
+        QString name;
+        qint64 nsecs; // since the trace was created
+    };
+
+    explicit StartupTrace(QObject *parent = nullptr);
+
+    void mark(const QString &phase);
+
+    /*
+        Completes the trace with the window's first frame.
+    */
+    void watch(QQuickWindow *window);
+
+    QList<Phase> phases() const;
+
+signals:
+    void finished();
+
+private:
+    QElapsedTimer clock;
+    QList<Phase> recorded;
+};
+
+#endif // STARTUPTRACE_H
@@ -0,0 +1,91 @@
+/*
+    streamparser.h
+
+    Class declaration for StreamParser.
+*/
+
+#ifndef STREAMPARSER_H
+#define STREAMPARSER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QString>
+
+/*
+    StreamEvent
+
+    The fields we care about from one line of an Ollama /api/chat NDJSON stream. Everything else in the line is
+    skipped without being decoded.
+*/
+struct StreamEvent
+{
+    bool valid = false;       // false if the line was not a well formed JSON object
+    bool isAssistant = false; // message.role == "assistant"
+    bool done = false;
+    QString content;          // message.content, unescaped
+    QString thinking;         // message.thinking: the reasoning of a thinking model, kept apart from the answer
+    QString error;            // top level "error" field, if the server sent one
+    QByteArray toolCalls;     // message.tool_calls as raw JSON, if the model called tools
+
+    // timing fields, only present on the final (done) line. durations are in nanoseconds
+    qint64 totalDuration = 0;
+    qint64 loadDuration = 0;
+    qint64 promptEvalCount = 0;
+    qint64 promptEvalDuration = 0;
+    qint64 evalCount = 0;
+    qint64 evalDuration = 0;
+
+    void clear();
+};
+
+/*
+    StreamParser
+
+    Incremental parser for newline delimited JSON as streamed by Ollama. Bytes are fed in as they arrive from the
+    network and complete lines are pulled out one at a time with next(). A line split across two reads is carried over
+    until the rest of it arrives, and only bytes that have not been scanned yet are searched for line boundaries.
+
+    Lines are decoded with a small forward-only tokenizer that works directly on the receive buffer instead of building
+    a QJsonDocument for every token.
+*/
+class StreamParser
+{
+public:
+    /*
+        Appends raw bytes to the carry-over buffer.
+    */
+    void append(QByteArrayView data);
+
+    /*
+        Decodes the next complete line into event. Returns false if there is no complete line buffered yet.
+        Blank lines are skipped. A line that fails to parse is still returned, with event.valid set to false.
+    */
+    bool next(StreamEvent &event);
+
+    /*
+        Decodes a trailing line that was not terminated by a newline. Call once the stream has ended.
+        Returns false if there was nothing left over.
+    */
+    bool flush(StreamEvent &event);
+
+    /*
+        Returns whether there are buffered bytes that have not been returned as a line yet.
+    */
+    bool hasPendingData() const;
+
+    /*
+        Discards all buffered data.
+    */
+    void reset();
+
+private:
+    void compact();
+    bool parseLine(QByteArrayView line, StreamEvent &event);
+
+    QByteArray buffer;
+    qsizetype readPos = 0; // start of the first line that has not been returned yet
+    qsizetype scanPos = 0; // everything before this has already been searched for '\n'
+    QByteArray scratch;    // reused when a string needs unescaping
+};
+
+#endif // STREAMPARSER_H
@@ -0,0 +1,173 @@
+/*
+    telemetry.h
+
+    Class declaration for Telemetry.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVariantMap>
+
+/*
+    RequestTimings
+
+    Where the time went for one chat request. The client side times are in nanoseconds since the request was sent, or
+    -1 if that point was never reached. The server side ones are copied from the final line of the stream.
+*/
+struct RequestTimings
+{
+    qint64 firstByte = -1;
+    qint64 firstThought = -1; // the first of a thinking model's reasoning, which is not shown as the answer
+    qint64 firstToken = -1;   // the first of the answer itself
+    qint64 lastToken = -1;
+    qint64 finished = -1;
+
+    qint64 loadDuration = 0;
+    qint64 promptEvalDuration = 0;
+    qint64 promptEvalCount = 0;
+    qint64 evalDuration = 0;
+    qint64 evalCount = 0;
+};
+
+/*
+    Telemetry
+
+    Collects the timings of chat requests into histograms, so slowness can be pinned on model loading, prompt
+    evaluation, generation, the network or our own UI. The server's view comes from the final line of each stream;
+    the client's from timestamps taken as the reply arrives, and from how long a token waits before a frame showing it
+    is on screen.
+
+    The histograms can be read as a summary for the diagnostics overlay, and are written out periodically in the
+    Prometheus text format, for node_exporter's textfile collector or anything else that reads it.
+*/
+class Telemetry : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Telemetry(QObject *parent = nullptr);
+
+    void recordRequest(const RequestTimings &timings);
+
+    /*
+        The chat view was told about new tokens, the oldest of which arrived waitedNs ago. The render time is taken
+        when the next frame is presented.
+    */
+    void recordPublished(qint64 waitedNs);
+    void recordFrame();
+
+    /*
+        A speculative prefill was sent, and a prompt followed prefills, which paid off if the last of them had
+        finished with the same history in time.
+    */
+    void recordPrefill();
+    void recordPrefillOutcome(bool paidOff);
+
+    /*
+        A tool the model called finished after nsecs.
+    */
+    void recordToolCall(const QString &tool, qint64 nsecs, bool succeeded);
+
+    /*
+        A prompt routed to a model tier ("fast" or "large", or "escalated" for a fast answer asked again of the large
+        model) was answered nsecs after it was sent.
+    */
+    void recordRoutedAnswer(const QString &tier, qint64 nsecs);
+
+    /*
+        The kiosk reached a phase of starting up nsecs after launch (see StartupTrace).
+    */
+    void recordStartup(const QString &phase, qint64 nsecs);
+
+    /*
+        One entry per stage, each holding "last", "p50" and "p95" in milliseconds and the sample "count", plus
+        "tokensPerSecond" for the last answer and the "prefills", "prefillHits" and "prefillMisses" counts. "tools"
+        holds the same timings per tool the model called, "tiers" per model tier prompts were routed to, and "startup"
+        the milliseconds from launch to each phase of starting up.
+    */
+    QVariantMap summary() const;
+
+    /*
+        The metrics in the Prometheus text exposition format.
+    */
+    QByteArray prometheusText() const;
+
+    /*
+        Writes prometheusText() to path every intervalSeconds, replacing the file atomically. 0 stops writing.
+    */
+    void startExport(const QString &path, int intervalSeconds);
+
+signals:
+    void updated();
+
+private:
+    /*
+        A histogram with fixed, roughly logarithmic bucket bounds from 1 ms to 2 minutes.
+    */
+    struct Histogram
+    {
+        const char *name;  // Prometheus metric name
+        const char *key;   // name in summary()
+        const char *help;
+        QList<quint64> buckets; // per bucket, not cumulative; the last one is +Inf
+        double sum = 0;         // in seconds
+        quint64 count = 0;
+        double last = 0;        // in seconds
+
+        void record(double seconds);
+        double percentile(double p) const;
+    };
+
+    struct StartupPhase
+    {
+        QString name;
+        double seconds; // since launch
+    };
+
+    enum Stage
+    {
+        FirstByte,
+        FirstToken,
+        Generation,
+        Request,
+        ModelLoad,
+        PromptEval,
+        Eval,
+        UiRender,
+        Thinking,
+        StageCount
+    };
+
+    void writeExport();
+
+    static QVariantMap stageSummary(const Histogram &histogram);
+    static void appendHistogram(QByteArray &text, const Histogram &histogram, const QByteArray &labels);
+
+    QList<Histogram> histograms;
+    quint64 requests;
+    quint64 promptTokens;
+    quint64 generatedTokens;
+    double lastTokensPerSecond;
+    quint64 prefills;
+    quint64 prefillHits;
+    quint64 prefillMisses;
+    QMap<QString, Histogram> toolCalls; // by tool name
+    QMap<QString, quint64> toolFailures;
+    QMap<QString, Histogram> routedAnswers; // by tier
+    QList<StartupPhase> startupPhases; // in the order reached
+
+    QElapsedTimer clock;
+    qint64 oldestUnrendered; // on the clock above, -1 if everything published is on screen
+
+    QString exportPath;
+    QTimer exportTimer;
+};
+
+#endif // TELEMETRY_H
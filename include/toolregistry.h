@@ -0,0 +1,87 @@
+/*
+    toolregistry.h
+
+    Class declaration for ToolRegistry.
+*/
+
+#ifndef TOOLREGISTRY_H
+#define TOOLREGISTRY_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <functional>
+
+/*
+    ToolRegistry
+
+    The functions the model may call while it answers. Every tool is advertised to the model in the "tools" field of a
+    chat request, with a JSON schema of its arguments. When the model calls some of them, they all run at once and
+    the answer carries on once the last result is in.
+
+    A tool is a handler that gets the arguments the model chose and reports back through a callback whenever it is
+    done, so one that waits on the network doesn't hold up the others. Being plain callbacks, tools can be swapped for
+    local stand-ins to try the model's use of them without the real lookups.
+*/
+class ToolRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    // a failed call still has a result: the error, which the model is told about
+    using Done = std::function<void(bool succeeded, const QString &result)>;
+    using Handler = std::function<void(const QJsonObject &arguments, Done done)>;
+
+    struct Call
+    {
+        QString name;
+        QJsonObject arguments;
+    };
+
+    explicit ToolRegistry(QObject *parent = nullptr);
+
+    /*
+        Adds a tool, or replaces the one with the same name. parameters is the JSON schema of its arguments.
+    */
+    void add(const QString &name, const QString &description, const QJsonObject &parameters, Handler handler);
+
+    bool isEmpty() const;
+
+    /*
+        Returns the tools as the "tools" field of a chat request expects them, as JSON text.
+    */
+    QByteArray definitions() const;
+
+    /*
+        Longest a call may take before it is answered with an error instead, in milliseconds (0 = no limit).
+    */
+    void setTimeout(int msec);
+
+    /*
+        Runs the calls at the same time. onFinished gets their results, in the order of the calls, once all of them
+        are in.
+    */
+    void run(const QList<Call> &calls, std::function<void(const QStringList &results)> onFinished);
+
+signals:
+    /*
+        A call finished after nsecs, whether it succeeded or not.
+    */
+    void callFinished(const QString &name, qint64 nsecs, bool succeeded);
+
+private:
+    struct Tool
+    {
+        QJsonObject definition;
+        Handler handler;
+    };
+
+    QList<Tool> tools;
+    QByteArray cachedDefinitions;
+    int timeout;
+};
+
+#endif // TOOLREGISTRY_H
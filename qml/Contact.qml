@@ -28,22 +28,28 @@ Page {
         spacing: 20
 
 
-        Rectangle {
-            Layout.fillWidth: true
-            height: 150
-            radius: 15
-            color: "white"
-            border.color: "#e0e0e0"
+        // compiled in from data/campus.json, the same contacts the model is told about
+        Repeater {
+            model: (typeof controller !== "undefined") ? controller.contacts : []
+
+            delegate: Rectangle {
+                required property var modelData
+                Layout.fillWidth: true
+                height: 150
+                radius: 15
+                color: "white"
+                border.color: "#e0e0e0"
 
-            ColumnLayout {
-                anchors.centerIn: parent
-                spacing: 10
+                ColumnLayout {
+                    anchors.centerIn: parent
+                    spacing: 10
 
-                Text { text: "College of Business IT"; font.bold: true; font.pixelSize: 18; color: "#070c72" }
-                Rectangle { height: 1; width: 100; color: "#eee" } // Separator
-                Text { text: "zipAIsupport@uakron.edu"; font.pixelSize: 16 }
-                Text { text: "(330) 123-4567"; font.pixelSize: 16 }
-                Text { text: "Room 107"; font.pixelSize: 16 }
+                    Text { text: modelData.name; font.bold: true; font.pixelSize: 18; color: "#070c72" }
+                    Rectangle { height: 1; width: 100; color: "#eee" } // Separator
+                    Text { text: modelData.email; font.pixelSize: 16 }
+                    Text { text: modelData.phone; font.pixelSize: 16 }
+                    Text { text: modelData.room; font.pixelSize: 16 }
+                }
             }
         }
 
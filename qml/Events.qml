@@ -18,23 +18,17 @@ Page {
         }
     }
 
-
-    ListModel {
-        id: eventModel
-        ListElement { title: "Career Fair 2024"; date: "OCT 12"; time: "10:00 AM"; location: "Grand Hall" }
-        ListElement { title: "AI in Business Talk"; date: "OCT 15"; time: "2:00 PM"; location: "Room 304" }
-        ListElement { title: "Alumni Networking"; date: "NOV 01"; time: "6:00 PM"; location: "Student Union" }
-    }
-
     ListView {
         id: eventList
         anchors.fill: parent
         anchors.margins: 20
         spacing: 15
-        model: eventModel
+        // compiled in from data/campus.json, the same list the model is told about
+        model: (typeof controller !== "undefined") ? controller.events : []
         clip: true
 
         delegate: Rectangle {
+            required property var modelData
             width: eventList.width
             height: 100
             radius: 12
@@ -63,12 +57,12 @@ Page {
                         anchors.centerIn: parent
                         spacing: 2
                         Text {
-                            text: model.date.split(" ")[0]
+                            text: modelData.month
                             color: "white"; font.pixelSize: 12
                             Layout.alignment: Qt.AlignHCenter
                         }
                         Text {
-                            text: model.date.split(" ")[1]
+                            text: modelData.day
                             color: "white"; font.pixelSize: 22; font.bold: true
                             Layout.alignment: Qt.AlignHCenter
                         }
@@ -82,12 +76,12 @@ Page {
                     spacing: 5
 
                     Text {
-                        text: model.title
+                        text: modelData.title
                         font.bold: true; font.pixelSize: 18
                         color: "#333"
                     }
                     Text {
-                        text: "🕒 " + model.time + "  📍 " + model.location
+                        text: "🕒 " + modelData.time + "  📍 " + modelData.location
                         color: "#666"; font.pixelSize: 14
                     }
                 }
@@ -11,24 +11,18 @@ Window {
     visible: true
     title: qsTr("Zippy AI")
 
-    // Data model to store chat messages
+    // Data model to store chat messages, owned by the C++ controller
     // Kept at Window level so chat persists when navigating between tabs
-    ListModel {
-        id: chatModel
-    }
+    readonly property var chatModel: (typeof controller !== "undefined") ? controller.chatModel : null
+
+    // the settings window, built in the background the first time it is opened and shown again after that
+    property var configWindow: null
 
     Rectangle {
         anchors.fill: parent
         color: "#070c72"
     }
 
-    Component.onCompleted: {
-        // Safe check ensures UI loads even if C++ controller isn't ready
-        if (typeof controller !== "undefined") {
-            controller.pingOllama();
-        }
-    }
-
     ColumnLayout {
         id: mainLayout
         spacing: 0
@@ -59,6 +53,20 @@ Window {
                     font.bold: true
                     Layout.fillWidth: true
                 }
+                // Connection status, kept up to date by the controller's health monitor.
+                // Press and hold it (or Ctrl+Shift+D) for the diagnostics overlay
+                Rectangle {
+                    Layout.preferredWidth: 12
+                    Layout.preferredHeight: 12
+                    radius: 6
+                    color: (typeof controller !== "undefined" && controller.connected) ? "#4caf50" : "#f44336"
+
+                    MouseArea {
+                        anchors.fill: parent
+                        anchors.margins: -10
+                        onPressAndHold: diagnosticsOverlay.visible = !diagnosticsOverlay.visible
+                    }
+                }
                 Button {
                     id: configButton
                     text: "⚙"
@@ -66,9 +74,23 @@ Window {
                     Layout.preferredWidth: 45
                     Layout.preferredHeight: 40
                     onClicked: {
-                        const component = Qt.createComponent("OllamaConfig.qml")
-                        const win = component.createObject()
-                        if (win) win.show()
+                        if (window.configWindow) {
+                            window.configWindow.show()
+                            window.configWindow.raise()
+                            return
+                        }
+
+                        const component = Qt.createComponent("OllamaConfig.qml", Component.Asynchronous)
+                        const create = () => {
+                            if (component.status === Component.Ready && !window.configWindow)
+                                window.configWindow = component.createObject(window)
+                            else if (component.status === Component.Error)
+                                console.warn(component.errorString())
+                        }
+                        if (component.status === Component.Loading)
+                            component.statusChanged.connect(create)
+                        else
+                            create()
                     }
                     background: Rectangle {
                         color: configButton.hovered ? "#0a0f8f" : "transparent"
@@ -78,16 +100,28 @@ Window {
             }
         }
 
-        // ===== CONTENT AREA (StackView) =====
-        // This handles switching between Chat, Maps, Events, etc.
-        StackView {
+        // ===== CONTENT AREA (StackLayout) =====
+        // This handles switching between Chat, Maps, Events, etc. Only the chat is built at startup; the other pages
+        // are built in the background the first time they are opened and kept after that
+        StackLayout {
             id: contentStack
             Layout.fillWidth: true
             Layout.fillHeight: true
-            initialItem: homePage // Default to the Chat Component
+            currentIndex: 0
 
-            replaceEnter: Transition { PropertyAnimation { property: "opacity"; from: 0; to: 1; duration: 200 } }
-            replaceExit: Transition { PropertyAnimation { property: "opacity"; from: 1; to: 0; duration: 200 } }
+            function show(index) {
+                children[index].active = true
+                currentIndex = index
+            }
+
+            onCurrentIndexChanged: pageFade.restart()
+
+            NumberAnimation { id: pageFade; target: contentStack; property: "opacity"; from: 0; to: 1; duration: 200 }
+
+            Loader { sourceComponent: homePage }
+            Loader { source: "BuildingMaps.qml"; active: false; asynchronous: true }
+            Loader { source: "Events.qml"; active: false; asynchronous: true }
+            Loader { source: "Contact.qml"; active: false; asynchronous: true }
         }
 
         // ===== FOOTER NAV BAR (Always Visible) =====
@@ -123,23 +157,22 @@ Window {
 
                 NavButton {
                     text: "Home Page"
-                    onClicked: contentStack.replace(homePage)
+                    onClicked: contentStack.show(0)
                 }
 
                 NavButton {
                     text: "Building Maps"
-                    // Loads external BuildingMaps.qml
-                    onClicked: contentStack.replace("BuildingMaps.qml")
+                    onClicked: contentStack.show(1)
                 }
 
                 NavButton {
                     text: "Events"
-                    onClicked: contentStack.replace("Events.qml")
+                    onClicked: contentStack.show(2)
                 }
 
                 NavButton {
                     text: "Contact"
-                    onClicked: contentStack.replace("Contact.qml")
+                    onClicked: contentStack.show(3)
                 }
             }
         }
@@ -203,10 +236,9 @@ Window {
                                         width: parent.width - 4; height: parent.height - 4
                                         fillMode: Image.PreserveAspectFit
 
-                                        // High Quality Settings
+                                        // decoded once at the size it is shown at, and shared by every message
+                                        sourceSize: Qt.size(width * Screen.devicePixelRatio, height * Screen.devicePixelRatio)
                                         smooth: true
-                                        mipmap: true
-                                        antialiasing: true
                                     }
                                 }
                             }
@@ -214,8 +246,13 @@ Window {
                             // Message Bubble
                             Rectangle {
                                 id: messageBubble
-                                width: Math.min(messageText.implicitWidth + 24, chatListView.width * 0.75)
-                                height: messageText.implicitHeight + 20
+                                // full width while the reasoning is unfolded, so it doesn't wrap into a narrow column
+                                width: Math.min(thinkingSection.expanded
+                                                    ? chatListView.width
+                                                    : Math.max(closedText.implicitWidth, openText.implicitWidth,
+                                                               thinkingSection.visible ? thinkingToggle.implicitWidth : 0) + 24,
+                                                chatListView.width * 0.75)
+                                height: bubbleContent.implicitHeight + 20
                                 radius: 18
                                 color: model.isUser ? "#80007AFF" : "#803a3a3c"
                                 border.color: model.isUser ? "#99FFFFFF" : "#77FFFFFF"
@@ -236,15 +273,70 @@ Window {
                                     }
                                 }
 
-                                Text {
-                                    id: messageText
-                                    text: model.message
-                                    textFormat: Text.MarkdownText
-                                    color: "white"
-                                    wrapMode: Text.Wrap
+                                Column {
+                                    id: bubbleContent
                                     anchors.fill: parent; anchors.margins: 12
-                                    font.pixelSize: 16
-                                    onLinkActivated: (link) => Qt.openUrlExternally(link)
+                                    spacing: 6
+
+                                    // the model's reasoning, folded away until tapped
+                                    Column {
+                                        id: thinkingSection
+                                        property bool expanded: false
+                                        visible: model.thinking !== ""
+                                        width: parent.width
+                                        spacing: 4
+
+                                        Text {
+                                            id: thinkingToggle
+                                            text: (thinkingSection.expanded ? "▾ " : "▸ ") + "Reasoning"
+                                            color: "#CCFFFFFF"
+                                            font.pixelSize: 13
+                                            font.italic: true
+
+                                            MouseArea {
+                                                anchors.fill: parent
+                                                onClicked: thinkingSection.expanded = !thinkingSection.expanded
+                                            }
+                                        }
+                                        Text {
+                                            visible: thinkingSection.expanded
+                                            width: parent.width
+                                            text: model.thinking
+                                            textFormat: Text.PlainText
+                                            color: "#CCFFFFFF"
+                                            wrapMode: Text.Wrap
+                                            font.pixelSize: 13
+                                        }
+                                    }
+
+                                    // the finished blocks and the one still streaming in are laid out apart, so a
+                                    // new token only relayouts the last block
+                                    Column {
+                                        width: parent.width
+
+                                        Text {
+                                            id: closedText
+                                            visible: text !== ""
+                                            width: parent.width
+                                            text: model.renderedClosed
+                                            textFormat: Text.RichText
+                                            color: "white"
+                                            wrapMode: Text.Wrap
+                                            font.pixelSize: 16
+                                            onLinkActivated: (link) => Qt.openUrlExternally(link)
+                                        }
+                                        Text {
+                                            id: openText
+                                            visible: text !== ""
+                                            width: parent.width
+                                            text: model.renderedOpen
+                                            textFormat: Text.RichText
+                                            color: "white"
+                                            wrapMode: Text.Wrap
+                                            font.pixelSize: 16
+                                            onLinkActivated: (link) => Qt.openUrlExternally(link)
+                                        }
+                                    }
                                 }
                             }
                         }
@@ -299,10 +391,10 @@ Window {
                         Layout.preferredWidth: 300; Layout.preferredHeight: 300
                         fillMode: Image.PreserveAspectFit
 
-                        // High Quality Settings
+                        // decoded at the size it is shown at, off the thread drawing the first frame
+                        sourceSize: Qt.size(300 * Screen.devicePixelRatio, 300 * Screen.devicePixelRatio)
+                        asynchronous: true
                         smooth: true
-                        mipmap: true
-                        antialiasing: true
                     }
 
                     Text {
@@ -334,7 +426,7 @@ Window {
                         Layout.preferredWidth: 110; Layout.preferredHeight: 55
                         font.bold: true
                         enabled: chatModel.count > 0
-                        onClicked: chatModel.clear()
+                        onClicked: controller.clearChat()
                         background: Rectangle {
                             radius: 27.5
                             color: clearChatButton.enabled ? "#8B0000" : "#5a5a5a"
@@ -363,18 +455,10 @@ Window {
                             verticalAlignment: TextInput.AlignVCenter
                             background: Rectangle { color: "transparent" }
                             onAccepted: sendButton.clicked()
+                            onTextChanged: if (typeof controller !== "undefined") controller.updateDraft(text)
 
                             Connections {
                                 target: (typeof controller !== "undefined") ? controller : null
-                                function onGenerateFinished(response) {
-                                    if (chatModel.count > 0) {
-                                        var lastIndex = chatModel.count - 1
-                                        var lastMsg = chatModel.get(lastIndex)
-                                        if (!lastMsg.isUser) {
-                                            chatModel.setProperty(lastIndex, "message", lastMsg.message + response)
-                                        }
-                                    }
-                                }
                                 function onStreamFinished() {
                                     mainLayout.isGenerating = false
                                 }
@@ -382,17 +466,19 @@ Window {
                         }
                     }
 
+                    // doubles as the stop button while an answer is being generated
                     Button {
                         id: sendButton
-                        text: "↑"
-                        enabled: !mainLayout.isGenerating && inputField.text.trim() !== ""
+                        text: mainLayout.isGenerating ? "■" : "↑"
+                        enabled: mainLayout.isGenerating || inputField.text.trim() !== ""
                         Layout.preferredWidth: 55; Layout.preferredHeight: 55
                         font.pixelSize: 24
                         onClicked: {
-                            if (inputField.text.trim() !== "") {
+                            if (mainLayout.isGenerating) {
+                                if (typeof controller !== "undefined") controller.cancel()
+                            } else if (inputField.text.trim() !== "") {
                                 mainLayout.isGenerating = true
-                                chatModel.append({ message: inputField.text, isUser: true })
-                                chatModel.append({ message: "", isUser: false })
+                                // the controller adds the user message and the empty reply bubble to the chat model
                                 if (typeof controller !== "undefined") controller.generate(inputField.text)
                                 inputField.text = ""
                                 chatListView.forceActiveFocus()
@@ -400,7 +486,7 @@ Window {
                         }
                         background: Rectangle {
                             radius: 27.5
-                            color: sendButton.enabled ? "#007AFF" : "#3a3a3c"
+                            color: mainLayout.isGenerating ? "#8B0000" : (sendButton.enabled ? "#007AFF" : "#3a3a3c")
                         }
                         contentItem: Text {
                             text: sendButton.text; color: "white"
@@ -412,6 +498,156 @@ Window {
         }
     }
 
+    // ===== DIAGNOSTICS OVERLAY =====
+    // Where the time went for recent answers: server-side model load, prompt evaluation and generation next to what
+    // the app measured itself, down to the frame a token appears in
+    Shortcut {
+        sequence: "Ctrl+Shift+D"
+        onActivated: diagnosticsOverlay.visible = !diagnosticsOverlay.visible
+    }
+
+    Rectangle {
+        id: diagnosticsOverlay
+        visible: false
+        z: 100
+        anchors.top: parent.top
+        anchors.right: parent.right
+        anchors.margins: 70
+        width: 330
+        height: diagnosticsColumn.implicitHeight + 20
+        radius: 8
+        color: "#cc000000"
+
+        readonly property var diagnostics: (typeof controller !== "undefined") ? controller.diagnostics : ({})
+        readonly property var stages: [
+            { key: "firstByte", label: "First byte" },
+            { key: "thinking", label: "Reasoning" },
+            { key: "firstToken", label: "First visible token" },
+            { key: "modelLoad", label: "Model load (server)" },
+            { key: "promptEval", label: "Prompt eval (server)" },
+            { key: "eval", label: "Generation (server)" },
+            { key: "generation", label: "Generation (client)" },
+            { key: "request", label: "Whole request" },
+            { key: "uiRender", label: "Token to screen" }
+        ]
+
+        function format(ms) {
+            return ms >= 1000 ? (ms / 1000).toFixed(2) + " s" : ms.toFixed(1) + " ms"
+        }
+
+        Column {
+            id: diagnosticsColumn
+            anchors.fill: parent
+            anchors.margins: 10
+            spacing: 4
+
+            Text {
+                text: "last / p50 / p95"
+                color: "#aaaaaa"
+                font.pixelSize: 11
+            }
+
+            Repeater {
+                model: diagnosticsOverlay.stages
+                delegate: Row {
+                    required property var modelData
+                    readonly property var stage: diagnosticsOverlay.diagnostics[modelData.key]
+                    spacing: 8
+
+                    Text {
+                        width: 130
+                        text: modelData.label
+                        color: "white"
+                        font.pixelSize: 12
+                    }
+                    Text {
+                        text: (stage && stage.count > 0)
+                              ? diagnosticsOverlay.format(stage.last) + " / " + diagnosticsOverlay.format(stage.p50)
+                                + " / " + diagnosticsOverlay.format(stage.p95)
+                              : "–"
+                        color: "white"
+                        font.pixelSize: 12
+                        font.family: "monospace"
+                    }
+                }
+            }
+
+            // one row per tool the model has called
+            Repeater {
+                model: Object.keys(diagnosticsOverlay.diagnostics.tools || {})
+                delegate: Row {
+                    required property string modelData
+                    readonly property var stage: diagnosticsOverlay.diagnostics.tools[modelData]
+                    spacing: 8
+
+                    Text {
+                        width: 130
+                        text: "Tool " + modelData
+                        color: "white"
+                        font.pixelSize: 12
+                    }
+                    Text {
+                        text: diagnosticsOverlay.format(stage.last) + " / " + diagnosticsOverlay.format(stage.p50)
+                              + " / " + diagnosticsOverlay.format(stage.p95)
+                        color: "white"
+                        font.pixelSize: 12
+                        font.family: "monospace"
+                    }
+                }
+            }
+
+            // one row per model tier prompts were routed to, with how many went there
+            Repeater {
+                model: Object.keys(diagnosticsOverlay.diagnostics.tiers || {})
+                delegate: Row {
+                    required property string modelData
+                    readonly property var stage: diagnosticsOverlay.diagnostics.tiers[modelData]
+                    spacing: 8
+
+                    Text {
+                        width: 130
+                        text: "Route " + modelData + " (" + stage.count + ")"
+                        color: "white"
+                        font.pixelSize: 12
+                    }
+                    Text {
+                        text: diagnosticsOverlay.format(stage.last) + " / " + diagnosticsOverlay.format(stage.p50)
+                              + " / " + diagnosticsOverlay.format(stage.p95)
+                        color: "white"
+                        font.pixelSize: 12
+                        font.family: "monospace"
+                    }
+                }
+            }
+
+            Text {
+                text: "Generation speed: " + (diagnosticsOverlay.diagnostics.tokensPerSecond || 0).toFixed(1) + " tokens/s"
+                color: "white"
+                font.pixelSize: 12
+            }
+
+            Text {
+                text: "Prefills: " + (diagnosticsOverlay.diagnostics.prefills || 0) + " sent, "
+                      + (diagnosticsOverlay.diagnostics.prefillHits || 0) + " ready in time, "
+                      + (diagnosticsOverlay.diagnostics.prefillMisses || 0) + " too late"
+                color: "white"
+                font.pixelSize: 12
+            }
+
+            Text {
+                readonly property var startup: diagnosticsOverlay.diagnostics.startup || ({})
+
+                function phase(ms) {
+                    return ms !== undefined ? diagnosticsOverlay.format(ms) : "–"
+                }
+
+                text: "Startup: first frame " + phase(startup.firstFrame) + ", interactive " + phase(startup.interactive)
+                color: "white"
+                font.pixelSize: 12
+            }
+        }
+    }
+
     // ===== MOBILE KEYBOARD HANDLING =====
     InputPanel {
         id: inputPanel
@@ -14,10 +14,30 @@ ApplicationWindow {
     title: "llmelody - Ollama Config"
     flags: Qt.Window | Qt.WindowMinimizeButtonHint | Qt.WindowCloseButtonHint
 
-    // update ollama status on close
-    onClosing: {
-        controller.pingOllama();
-        root.updateOllamaStatus();
+    // settings to go back to if the new ones can't connect
+    property string oldURL: ""
+    property string oldModel: ""
+    property bool testing: false
+
+    // the connection test runs in the background; its result arrives here
+    Connections {
+        target: controller
+        function onPingFinished(success) {
+            if (!rootOllamaConfig.testing)
+                return;
+            rootOllamaConfig.testing = false;
+
+            if (success)
+            {
+                rootOllamaConfig.close();
+            }
+            else
+            {
+                statusLabel.text = "<font color=\"#FF0000\">Connection failed!</font>";
+                controller.setURL(rootOllamaConfig.oldURL);
+                controller.setModel(rootOllamaConfig.oldModel);
+            }
+        }
     }
 
     Pane {
@@ -90,27 +110,20 @@ ApplicationWindow {
             anchors.bottom: parent.bottom
             anchors.right: parent.right
             anchors.margins: 4
+            enabled: !rootOllamaConfig.testing
             onClicked: {
                 // save the old settings so that we can revert if necessary
-                var oldURL = controller.getURL();
-                var oldModel = controller.getModel();
+                rootOllamaConfig.oldURL = controller.getURL();
+                rootOllamaConfig.oldModel = controller.getModel();
 
                 // save the settings
                 controller.setURL(urlField.text);
                 controller.setModel(modelField.text);
 
                 // test ollama connection
-                if (controller.pingOllama())
-                {
-                    rootOllamaConfig.close();
-                }
-                else
-                {
-                    statusLabel.text = "<font color=\"#FF0000\">Connection failed!</font>";
-                    controller.setURL(oldURL);
-                    controller.setModel(oldModel);
-                    controller.ping();
-                }
+                rootOllamaConfig.testing = true;
+                statusLabel.text = "Connecting...";
+                controller.pingOllama();
             }
         }
     }
@@ -0,0 +1,206 @@
+/*
+    backendpool.cpp
+
+    Class implementation for BackendPool.
+*/
+
+#include "backendpool.h"
+#include "logger.h"
+#include <algorithm>
+
+namespace
+{
+
+constexpr int maxConsecutiveErrors = 3;
+constexpr qsizetype sampleCount = 64;    // first-token samples kept per backend
+constexpr qsizetype minHedgeSamples = 20; // fewer than this and the percentile means nothing
+constexpr double averageWeight = 0.2;    // weight of the newest sample in the running average
+constexpr int firstRetryInterval = 1000; // ms
+constexpr int maxRetryInterval = 60000;  // ms
+
+} // namespace
+
+BackendPool::BackendPool()
+    : routing(LeastLoaded), hedgePercentile(0)
+{
+}
+
+void BackendPool::setBackends(const QStringList &urls)
+{
+    backends.clear();
+    for (const QString &url : urls)
+    {
+        if (!url.trimmed().isEmpty())
+            backends.append(makeBackend(url.trimmed()));
+    }
+}
+
+void BackendPool::setPrimary(const QString &url)
+{
+    if (backends.isEmpty())
+        backends.append(makeBackend(url));
+    else
+        backends[0] = makeBackend(url);
+}
+
+int BackendPool::size() const
+{
+    return int(backends.size());
+}
+
+QString BackendPool::url(int backend) const
+{
+    return backend >= 0 && backend < backends.size() ? backends[backend].url : QString();
+}
+
+void BackendPool::setRouting(Routing newRouting)
+{
+    routing = newRouting;
+}
+
+void BackendPool::setHedgePercentile(int percentile)
+{
+    hedgePercentile = qBound(0, percentile, 99);
+}
+
+int BackendPool::pick(int exclude) const
+{
+    // healthy backends first; if all of them are out, fall back to the best of the rest
+    int best = -1;
+    for (int pass = 0; pass < 2 && best < 0; ++pass)
+    {
+        for (int i = 0; i < backends.size(); ++i)
+        {
+            if (i == exclude || (pass == 0 && !backends[i].healthy))
+                continue;
+            if (best < 0 || score(backends[i]) < score(backends[best]))
+                best = i;
+        }
+    }
+    return best;
+}
+
+void BackendPool::requestStarted(int backend)
+{
+    if (backend >= 0 && backend < backends.size())
+        ++backends[backend].inFlight;
+}
+
+void BackendPool::requestFinished(int backend)
+{
+    if (backend >= 0 && backend < backends.size())
+        backends[backend].inFlight = qMax(0, backends[backend].inFlight - 1);
+}
+
+void BackendPool::recordFirstToken(int backend, qint64 msec)
+{
+    if (backend < 0 || backend >= backends.size())
+        return;
+
+    Backend &b = backends[backend];
+    if (b.firstTokenSamples.size() < sampleCount)
+        b.firstTokenSamples.append(msec);
+    else
+        b.firstTokenSamples[b.nextSample] = msec;
+    b.nextSample = (b.nextSample + 1) % sampleCount;
+
+    b.averageFirstToken = b.firstTokenSamples.size() == 1
+                              ? double(msec)
+                              : (1 - averageWeight) * b.averageFirstToken + averageWeight * double(msec);
+}
+
+void BackendPool::recordSuccess(int backend)
+{
+    if (backend < 0 || backend >= backends.size())
+        return;
+
+    Backend &b = backends[backend];
+    if (!b.healthy)
+        LOG_INFO("backend.readmitted", "url", b.url);
+    b.healthy = true;
+    b.consecutiveErrors = 0;
+}
+
+void BackendPool::recordError(int backend)
+{
+    if (backend < 0 || backend >= backends.size())
+        return;
+
+    Backend &b = backends[backend];
+    if (++b.consecutiveErrors >= maxConsecutiveErrors && b.healthy)
+    {
+        LOG_WARNING("backend.ejected", "url", b.url, "reason", "errors", "errors", b.consecutiveErrors);
+        b.healthy = false;
+    }
+}
+
+void BackendPool::markUnreachable(int backend)
+{
+    if (backend < 0 || backend >= backends.size())
+        return;
+
+    Backend &b = backends[backend];
+    if (b.healthy)
+        LOG_WARNING("backend.ejected", "url", b.url, "reason", "unreachable");
+    b.healthy = false;
+}
+
+bool BackendPool::isHealthy(int backend) const
+{
+    return backend >= 0 && backend < backends.size() && backends[backend].healthy;
+}
+
+bool BackendPool::anyHealthy() const
+{
+    return std::any_of(backends.begin(), backends.end(), [](const Backend &b) { return b.healthy; });
+}
+
+qint64 BackendPool::hedgeDelay(int backend) const
+{
+    if (hedgePercentile <= 0 || backends.size() < 2 || backend < 0 || backend >= backends.size())
+        return 0;
+
+    QList<qint64> samples = backends[backend].firstTokenSamples;
+    if (samples.size() < minHedgeSamples)
+        return 0;
+
+    const qsizetype rank = samples.size() * hedgePercentile / 100;
+    std::nth_element(samples.begin(), samples.begin() + rank, samples.end());
+    return qMax<qint64>(1, samples[rank]);
+}
+
+int BackendPool::nextProbeDelay(int backend, bool lastProbeSucceeded, int healthInterval)
+{
+    if (backend < 0 || backend >= backends.size())
+        return healthInterval;
+
+    Backend &b = backends[backend];
+    if (lastProbeSucceeded)
+    {
+        b.retryInterval = firstRetryInterval;
+        return healthInterval;
+    }
+
+    const int delay = b.retryInterval;
+    b.retryInterval = qMin(b.retryInterval * 2, maxRetryInterval);
+    return delay;
+}
+
+BackendPool::Backend BackendPool::makeBackend(const QString &url)
+{
+    Backend backend;
+    backend.url = url;
+    backend.retryInterval = firstRetryInterval;
+    backend.firstTokenSamples.reserve(sampleCount);
+    return backend;
+}
+
+double BackendPool::score(const Backend &backend) const
+{
+    // a backend without samples yet scores as fast, so it gets tried
+    if (routing == LatencyAware)
+        return backend.averageFirstToken * (backend.inFlight + 1) + backend.inFlight;
+
+    // in-flight count first; the latency only breaks ties (it is far below one request's worth)
+    return backend.inFlight + backend.averageFirstToken / 1e9;
+}
@@ -0,0 +1,196 @@
+/*
+    batchrunner.cpp
+
+    Class implementation for BatchRunner.
+*/
+
+#include "batchrunner.h"
+#include <QFile>
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+BatchRunner::BatchRunner(ProgramController *controller, QObject *parent)
+    : QObject(parent), controller(controller), nextConversation(0), concurrency(1), answerChars(0), answered(0),
+      failed(0)
+{
+    connect(controller, &ProgramController::answerReceived, this, &BatchRunner::onAnswerReceived);
+    connect(controller, &ProgramController::answerFinished, this, &BatchRunner::onAnswerFinished);
+}
+
+bool BatchRunner::load(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        std::cerr << "Could not read " << path.toStdString() << "." << std::endl;
+        return false;
+    }
+
+    conversations.clear();
+    QStringList conversation;
+    const QStringList lines = QString::fromUtf8(file.readAll()).split('\n');
+    for (const QString &line : lines)
+    {
+        const QString prompt = line.trimmed();
+        if (prompt.startsWith('#'))
+            continue;
+
+        if (!prompt.isEmpty())
+        {
+            conversation.append(prompt);
+        }
+        else if (!conversation.isEmpty())
+        {
+            conversations.append(conversation);
+            conversation.clear();
+        }
+    }
+    if (!conversation.isEmpty())
+        conversations.append(conversation);
+
+    if (conversations.isEmpty())
+    {
+        std::cerr << path.toStdString() << " holds no prompts." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void BatchRunner::start(int concurrency)
+{
+    this->concurrency = qMax(1, concurrency);
+    nextConversation = 0;
+    firstTextTimes.clear();
+    answerTimes.clear();
+    answerChars = 0;
+    answered = 0;
+    failed = 0;
+
+    clock.start();
+    while (running.size() < this->concurrency && startConversation())
+    {
+    }
+
+    if (running.isEmpty())
+    {
+        report();
+        emit finished();
+    }
+}
+
+int BatchRunner::failures() const
+{
+    return failed;
+}
+
+/*
+    Opens a conversation for the next one in the file. Returns false once there are none left.
+*/
+bool BatchRunner::startConversation()
+{
+    if (nextConversation >= conversations.size())
+        return false;
+
+    const int session = controller->openConversation();
+    running.insert(session, { nextConversation++, 0, QElapsedTimer(), -1 });
+    sendNext(session);
+    return true;
+}
+
+void BatchRunner::sendNext(int session)
+{
+    Replay &replay = running[session];
+    replay.sent.start();
+    replay.firstText = -1;
+
+    if (!controller->ask(session, conversations[replay.conversation][replay.prompt]))
+        onAnswerFinished(session, ProgramController::Error);
+}
+
+void BatchRunner::onAnswerReceived(int session, const QString &text)
+{
+    auto replay = running.find(session);
+    if (replay == running.end())
+        return;
+
+    if (replay->firstText < 0 && !text.isEmpty())
+        replay->firstText = replay->sent.nsecsElapsed();
+    answerChars += text.size();
+}
+
+void BatchRunner::onAnswerFinished(int session, ProgramController::GenerateStatus status)
+{
+    auto replay = running.find(session);
+    if (replay == running.end())
+        return;
+
+    ++answered;
+    if (status == ProgramController::Finished)
+    {
+        answerTimes.append(replay->sent.nsecsElapsed());
+        if (replay->firstText >= 0)
+            firstTextTimes.append(replay->firstText);
+    }
+    else
+    {
+        ++failed;
+    }
+
+    // answers from the map arrive while the prompt is being sent, so the next one goes out from the event loop
+    QMetaObject::invokeMethod(this, [this, session]()
+    {
+        auto replay = running.find(session);
+        if (replay == running.end())
+            return;
+
+        if (++replay->prompt < conversations[replay->conversation].size())
+        {
+            sendNext(session);
+            return;
+        }
+
+        running.erase(replay);
+        controller->closeConversation(session);
+        startConversation();
+
+        if (running.isEmpty())
+        {
+            report();
+            emit finished();
+        }
+    }, Qt::QueuedConnection);
+}
+
+/*
+    Writes the throughput and latency figures to standard output.
+*/
+void BatchRunner::report() const
+{
+    const double seconds = clock.nsecsElapsed() / 1e9;
+    auto milliseconds = [](double nsecs) { return nsecs / 1e6; };
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Replayed " << answered << " prompts in " << conversations.size() << " conversations, "
+              << concurrency << " at a time, in " << seconds << " s" << std::endl;
+    std::cout << "Throughput: " << std::setprecision(2) << (seconds > 0 ? answered / seconds : 0.0)
+              << " prompts/s, " << std::setprecision(0) << (seconds > 0 ? answerChars / seconds : 0.0)
+              << " characters/s" << std::endl;
+    std::cout << std::setprecision(0);
+    std::cout << "First text: p50 " << milliseconds(percentile(firstTextTimes, 0.5)) << " ms, p95 "
+              << milliseconds(percentile(firstTextTimes, 0.95)) << " ms" << std::endl;
+    std::cout << "Whole answer: p50 " << milliseconds(percentile(answerTimes, 0.5)) << " ms, p95 "
+              << milliseconds(percentile(answerTimes, 0.95)) << " ms" << std::endl;
+    std::cout << "Failed: " << failed << std::endl;
+}
+
+double BatchRunner::percentile(QList<qint64> values, double p)
+{
+    if (values.isEmpty())
+        return 0;
+
+    std::sort(values.begin(), values.end());
+    const qsizetype index = qMin(values.size() - 1, qsizetype(std::ceil(p * values.size())) - 1);
+    return double(values[qMax<qsizetype>(0, index)]);
+}
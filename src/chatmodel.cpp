@@ -0,0 +1,172 @@
+/*
+    chatmodel.cpp
+
+    Class implementation for ChatModel.
+*/
+
+#include "chatmodel.h"
+#include "logger.h"
+
+ChatModel::ChatModel(QObject *parent)
+    : QAbstractListModel(parent), pendingChange(false)
+{
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(16);
+    flushTimer.setTimerType(Qt::PreciseTimer);
+    connect(&flushTimer, &QTimer::timeout, this, &ChatModel::flush);
+}
+
+int ChatModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(messages.size());
+}
+
+QVariant ChatModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= messages.size())
+        return QVariant();
+
+    const Message &message = messages.at(index.row());
+    switch (role)
+    {
+    case MessageRole:
+        return message.markdown.text();
+    case RenderedClosedRole:
+        return message.renderedClosed;
+    case RenderedOpenRole:
+        return message.renderedOpen;
+    case IsUserRole:
+        return message.isUser;
+    case ThinkingRole:
+        return message.thinking;
+    default:
+        return QVariant();
+    }
+}
+
+QHash<int, QByteArray> ChatModel::roleNames() const
+{
+    return {
+        { MessageRole, "message" },
+        { IsUserRole, "isUser" },
+        { RenderedClosedRole, "renderedClosed" },
+        { RenderedOpenRole, "renderedOpen" },
+        { ThinkingRole, "thinking" }
+    };
+}
+
+int ChatModel::count() const
+{
+    return int(messages.size());
+}
+
+void ChatModel::appendMessage(const QString &message, bool isUser)
+{
+    // anything still pending belongs to the previous message, so get it out before the rows shift
+    flush();
+
+    const int row = int(messages.size());
+    Message added;
+    added.markdown.append(message);
+    added.renderedClosed = added.markdown.closedHtml();
+    added.renderedOpen = added.markdown.openHtml();
+    added.isUser = isUser;
+
+    beginInsertRows(QModelIndex(), row, row);
+    messages.append(added);
+    endInsertRows();
+    emit countChanged();
+}
+
+void ChatModel::appendToken(const QString &token)
+{
+    if (messages.isEmpty() || messages.last().isUser || token.isEmpty())
+        return;
+
+    // QString grows geometrically, so appending here stays amortized O(1) per token
+    messages.last().markdown.append(token);
+    if (!pendingChange)
+        pendingSince.start();
+    pendingChange = true;
+
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+void ChatModel::appendThinking(const QString &text)
+{
+    if (messages.isEmpty() || messages.last().isUser || text.isEmpty())
+        return;
+
+    messages.last().thinking += text;
+    if (!pendingChange)
+        pendingSince.start();
+    pendingChange = true;
+
+    if (!flushTimer.isActive())
+        flushTimer.start();
+}
+
+void ChatModel::flush()
+{
+    flushTimer.stop();
+    if (!pendingChange)
+        return;
+
+    pendingChange = false;
+    Message &message = messages.last();
+    const qsizetype closedSize = message.renderedClosed.size();
+    message.renderedClosed = message.markdown.closedHtml();
+    message.renderedOpen = message.markdown.openHtml();
+
+    // the finished blocks are left alone unless one was added to them
+    QList<int> roles = { MessageRole, RenderedOpenRole, ThinkingRole };
+    const bool closedChanged = message.renderedClosed.size() != closedSize;
+    if (closedChanged)
+        roles.append(RenderedClosedRole);
+
+    const QModelIndex last = index(int(messages.size()) - 1);
+    emit dataChanged(last, last, roles);
+    emit published(pendingSince.nsecsElapsed());
+    LOG_DEBUG("ui.flushed", "row", last.row(), "open", message.renderedOpen.size(), "closed", closedChanged,
+              "waited_us", pendingSince.nsecsElapsed() / 1000);
+}
+
+void ChatModel::clearLastMessage()
+{
+    if (messages.isEmpty() || messages.last().isUser)
+        return;
+
+    flushTimer.stop();
+    pendingChange = false;
+
+    Message &message = messages.last();
+    message.markdown.clear();
+    message.renderedClosed.clear();
+    message.renderedOpen.clear();
+    message.thinking.clear();
+
+    const QModelIndex last = index(int(messages.size()) - 1);
+    emit dataChanged(last, last, { MessageRole, RenderedClosedRole, RenderedOpenRole, ThinkingRole });
+}
+
+QString ChatModel::lastMessage() const
+{
+    return messages.isEmpty() ? QString() : messages.last().markdown.text();
+}
+
+void ChatModel::clear()
+{
+    flushTimer.stop();
+    pendingChange = false;
+
+    beginResetModel();
+    messages.clear();
+    endResetModel();
+    emit countChanged();
+}
+
+void ChatModel::setFlushInterval(int msec)
+{
+    flushTimer.setInterval(qMax(0, msec));
+}
@@ -0,0 +1,309 @@
+/*
+    chatservice.cpp
+
+    Class implementation for ChatService.
+*/
+
+#include "chatservice.h"
+#include <QJsonDocument>
+#include <QTcpSocket>
+
+namespace
+{
+
+QByteArray statusText(int status)
+{
+    switch (status)
+    {
+    case 200:
+        return "OK";
+    case 201:
+        return "Created";
+    case 204:
+        return "No Content";
+    case 400:
+        return "Bad Request";
+    case 404:
+        return "Not Found";
+    case 405:
+        return "Method Not Allowed";
+    case 409:
+        return "Conflict";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+QJsonObject errorBody(const QString &message)
+{
+    QJsonObject body;
+    body["error"] = message;
+    return body;
+}
+
+} // namespace
+
+ChatService::ChatService(ProgramController *controller, QObject *parent)
+    : QObject(parent), controller(controller), server(this)
+{
+    connect(&server, &QTcpServer::newConnection, this, &ChatService::onNewConnection);
+    connect(controller, &ProgramController::answerReceived, this, &ChatService::onAnswerReceived);
+    connect(controller, &ProgramController::answerFinished, this, &ChatService::onAnswerFinished);
+    connect(controller, &ProgramController::answerRestarted, this, &ChatService::onAnswerRestarted);
+}
+
+bool ChatService::listen(const QHostAddress &address, quint16 port)
+{
+    return server.listen(address, port);
+}
+
+quint16 ChatService::port() const
+{
+    return server.serverPort();
+}
+
+void ChatService::onNewConnection()
+{
+    while (QTcpSocket *socket = server.nextPendingConnection())
+    {
+        // tokens go out as they arrive rather than waiting to be coalesced
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+        connections.insert(socket, Connection());
+        connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QTcpSocket::disconnected, this, [this, socket]() { onDisconnected(socket); });
+    }
+}
+
+void ChatService::onReadyRead(QTcpSocket *socket)
+{
+    auto connection = connections.find(socket);
+    if (connection == connections.end())
+        return;
+
+    connection->buffer += socket->readAll();
+
+    // one request at a time per connection; anything sent while an answer streams waits in the buffer
+    while (connection->streaming == 0)
+    {
+        const qsizetype headerEnd = connection->buffer.indexOf("\r\n\r\n");
+        if (headerEnd < 0)
+            return;
+
+        const QList<QByteArray> lines = connection->buffer.left(headerEnd).split('\n');
+        const QList<QByteArray> requestLine = lines.first().trimmed().split(' ');
+        qsizetype contentLength = 0;
+        for (qsizetype i = 1; i < lines.size(); ++i)
+        {
+            const qsizetype colon = lines[i].indexOf(':');
+            if (colon > 0 && lines[i].left(colon).trimmed().toLower() == "content-length")
+                contentLength = lines[i].mid(colon + 1).trimmed().toLongLong();
+        }
+
+        if (connection->buffer.size() < headerEnd + 4 + contentLength)
+            return;
+
+        const QByteArray body = connection->buffer.mid(headerEnd + 4, contentLength);
+        connection->buffer.remove(0, headerEnd + 4 + contentLength);
+
+        QByteArray path = requestLine.value(1);
+        const qsizetype query = path.indexOf('?');
+        if (query >= 0)
+            path.truncate(query);
+
+        handleRequest(socket, requestLine.value(0), path, body);
+
+        // a short answer may have been streamed and the connection closed already
+        connection = connections.find(socket);
+        if (connection == connections.end())
+            return;
+    }
+}
+
+void ChatService::onDisconnected(QTcpSocket *socket)
+{
+    const Connection connection = connections.take(socket);
+    socket->deleteLater();
+
+    // nobody is listening to the answer any more
+    if (connection.streaming != 0)
+    {
+        streams.remove(connection.streaming);
+        controller->cancelAnswer(connection.streaming);
+    }
+}
+
+void ChatService::handleRequest(QTcpSocket *socket, const QByteArray &method, const QByteArray &path,
+                                const QByteArray &body)
+{
+    if (path == "/health")
+    {
+        QJsonObject health;
+        health["connected"] = controller->getOllamaStatus();
+        health["conversations"] = int(sessions.size());
+        writeResponse(socket, 200, health);
+        return;
+    }
+
+    if (path == "/metrics")
+    {
+        writeResponse(socket, 200, "text/plain; version=0.0.4", controller->metrics());
+        return;
+    }
+
+    if (path == "/sessions")
+    {
+        if (method != "POST")
+        {
+            writeResponse(socket, 405, errorBody("Use POST to open a conversation."));
+            return;
+        }
+
+        const int session = controller->openConversation();
+        sessions.append(session);
+
+        QJsonObject created;
+        created["session"] = session;
+        writeResponse(socket, 201, created);
+        return;
+    }
+
+    // /sessions/<id> and /sessions/<id>/messages
+    const QList<QByteArray> parts = path.split('/');
+    bool validId = false;
+    const int session = parts.value(2).toInt(&validId);
+    if (parts.size() < 3 || parts.size() > 4 || parts[1] != "sessions" || !validId)
+    {
+        writeResponse(socket, 404, errorBody("There is nothing at " + QString::fromUtf8(path) + "."));
+        return;
+    }
+
+    if (!sessions.contains(session))
+    {
+        writeResponse(socket, 404, errorBody("There is no conversation " + QString::number(session) + "."));
+        return;
+    }
+
+    if (parts.size() == 3)
+    {
+        if (method != "DELETE")
+        {
+            writeResponse(socket, 405, errorBody("Use DELETE to end a conversation."));
+            return;
+        }
+
+        sessions.removeOne(session);
+        controller->closeConversation(session);
+        writeResponse(socket, 204, QByteArray(), QByteArray());
+        return;
+    }
+
+    if (parts[3] != "messages")
+    {
+        writeResponse(socket, 404, errorBody("There is nothing at " + QString::fromUtf8(path) + "."));
+        return;
+    }
+    if (method != "POST")
+    {
+        writeResponse(socket, 405, errorBody("Use POST to send a prompt."));
+        return;
+    }
+
+    startAnswer(socket, session, body);
+}
+
+void ChatService::startAnswer(QTcpSocket *socket, int session, const QByteArray &body)
+{
+    const QString prompt = QJsonDocument::fromJson(body).object()["prompt"].toString().trimmed();
+    if (prompt.isEmpty())
+    {
+        writeResponse(socket, 400, errorBody("The body needs a \"prompt\"."));
+        return;
+    }
+
+    if (streams.contains(session))
+    {
+        writeResponse(socket, 409, errorBody("The conversation is still answering the last prompt."));
+        return;
+    }
+
+    // the stream is set up first, since an answer straight from the map arrives before ask() returns
+    socket->write("HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                  "Connection: close\r\n\r\n");
+    connections[socket].streaming = session;
+    streams.insert(session, socket);
+
+    if (!controller->ask(session, prompt))
+        onAnswerFinished(session, ProgramController::Error);
+}
+
+void ChatService::onAnswerReceived(int session, const QString &text)
+{
+    QTcpSocket *socket = streams.value(session);
+    if (!socket)
+        return;
+
+    QJsonObject token;
+    token["text"] = text;
+    writeEvent(socket, "token", token);
+}
+
+void ChatService::onAnswerFinished(int session, ProgramController::GenerateStatus status)
+{
+    QTcpSocket *socket = streams.take(session);
+    if (!socket)
+        return;
+
+    QJsonObject done;
+    switch (status)
+    {
+    case ProgramController::Finished:
+        done["status"] = "finished";
+        break;
+    case ProgramController::Cancelled:
+        done["status"] = "cancelled";
+        break;
+    case ProgramController::TimedOut:
+        done["status"] = "timedOut";
+        break;
+    default:
+        done["status"] = "error";
+        break;
+    }
+    writeEvent(socket, "done", done);
+
+    // the stream ends with the connection; anything pipelined behind it is dropped
+    Connection &connection = connections[socket];
+    connection.streaming = 0;
+    connection.buffer.clear();
+    socket->disconnectFromHost();
+}
+
+void ChatService::onAnswerRestarted(int session)
+{
+    // an unsure answer from the small model is being asked again of the large one
+    if (QTcpSocket *socket = streams.value(session))
+        writeEvent(socket, "restart", QJsonObject());
+}
+
+void ChatService::writeResponse(QTcpSocket *socket, int status, const QJsonObject &body)
+{
+    writeResponse(socket, status, "application/json", QJsonDocument(body).toJson(QJsonDocument::Compact));
+}
+
+void ChatService::writeResponse(QTcpSocket *socket, int status, const QByteArray &contentType,
+                                const QByteArray &body)
+{
+    QByteArray response = "HTTP/1.1 " + QByteArray::number(status) + ' ' + statusText(status) + "\r\n";
+    if (!contentType.isEmpty())
+        response += "Content-Type: " + contentType + "\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n\r\n";
+    response += body;
+    socket->write(response);
+}
+
+void ChatService::writeEvent(QTcpSocket *socket, const QByteArray &event, const QJsonObject &data)
+{
+    // compact JSON has no line breaks, so every event is a single data line
+    socket->write("event: " + event + "\ndata: " + QJsonDocument(data).toJson(QJsonDocument::Compact) + "\n\n");
+}
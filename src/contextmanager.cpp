@@ -0,0 +1,213 @@
+/*
+    contextmanager.cpp
+
+    Class implementation for ContextManager.
+*/
+
+#include "contextmanager.h"
+#include "logger.h"
+#include <QJsonDocument>
+
+namespace
+{
+    // tokens the chat template adds around every message (role markers, separators)
+    constexpr int messageOverhead = 4;
+
+    // tokens kept free for the model's answer, as a fraction of the context window
+    constexpr int responseReserveDivisor = 4;
+    constexpr int maxResponseReserve = 2048;
+}
+
+ContextManager::ContextManager(int contextSize)
+    : contextSize(contextSize), systemTokens(0), totalHistoryTokens(0)
+{
+}
+
+void ContextManager::setContextSize(int tokens)
+{
+    contextSize = tokens;
+    trim();
+}
+
+int ContextManager::getContextSize() const
+{
+    return contextSize;
+}
+
+void ContextManager::setSystemPrompt(const QString &prompt)
+{
+    if (prompt == getSystemPrompt())
+        return;
+
+    if (prompt.isEmpty())
+    {
+        systemMessage = QJsonObject();
+        encodedSystem.clear();
+        systemTokens = 0;
+        return;
+    }
+
+    systemMessage = QJsonObject();
+    systemMessage["role"] = "system";
+    systemMessage["content"] = prompt;
+    encodedSystem = encode(systemMessage);
+    systemTokens = estimateTokens(prompt);
+    trim();
+}
+
+QString ContextManager::getSystemPrompt() const
+{
+    return systemMessage["content"].toString();
+}
+
+void ContextManager::addMessage(const QString &role, const QString &content)
+{
+    if (role == "system")
+    {
+        setSystemPrompt(content);
+        return;
+    }
+
+    QJsonObject message;
+    message["role"] = role;
+    message["content"] = content;
+    append(message, estimateTokens(content));
+}
+
+void ContextManager::addMessage(const QJsonObject &message)
+{
+    // the model reads tool calls as JSON, so they count at the length of their JSON text
+    int tokens = estimateTokens(message["content"].toString());
+    if (message.contains("tool_calls"))
+    {
+        const QByteArray calls = QJsonDocument(message["tool_calls"].toArray()).toJson(QJsonDocument::Compact);
+        tokens += estimateTokens(QString::fromUtf8(calls)) - messageOverhead;
+    }
+    append(message, tokens);
+}
+
+void ContextManager::clear()
+{
+    history = QJsonArray();
+    historyTokens.clear();
+    totalHistoryTokens = 0;
+    encodedHistory.clear();
+    encodedSizes.clear();
+}
+
+QJsonArray ContextManager::messages() const
+{
+    if (systemMessage.isEmpty())
+        return history;
+
+    QJsonArray result;
+    result.append(systemMessage);
+    for (const QJsonValue &message : history)
+        result.append(message);
+    return result;
+}
+
+void ContextManager::appendMessages(QByteArray &body, const QByteArray &extra) const
+{
+    body += '[';
+    body += encodedSystem;
+    if (!encodedSystem.isEmpty() && !encodedHistory.isEmpty())
+        body += ',';
+    body += encodedHistory;
+    if (!extra.isEmpty())
+    {
+        if (!encodedSystem.isEmpty() || !encodedHistory.isEmpty())
+            body += ',';
+        body += extra;
+    }
+    body += ']';
+}
+
+qsizetype ContextManager::encodedSize() const
+{
+    return encodedSystem.size() + encodedHistory.size() + 3;
+}
+
+QByteArray ContextManager::encode(const QJsonObject &message)
+{
+    return QJsonDocument(message).toJson(QJsonDocument::Compact);
+}
+
+int ContextManager::messageCount() const
+{
+    return int(history.size());
+}
+
+int ContextManager::estimatedTokens() const
+{
+    return systemTokens + totalHistoryTokens;
+}
+
+qint64 ContextManager::memoryUsage() const
+{
+    // the text is what grows with a conversation; the bookkeeping around it is small and fixed per message
+    qint64 bytes = getSystemPrompt().size() * qint64(sizeof(QChar));
+    for (const QJsonValue &message : history)
+        bytes += message["content"].toString().size() * qint64(sizeof(QChar));
+
+    // and again as the UTF-8 JSON text the requests are built from
+    bytes += encodedSystem.size() + encodedHistory.size();
+    return bytes;
+}
+
+int ContextManager::estimateTokens(const QString &text)
+{
+    // BPE tokenizers average a bit under four characters per token on English text
+    return int((text.size() + 3) / 4) + messageOverhead;
+}
+
+int ContextManager::budget() const
+{
+    return contextSize - qMin(contextSize / responseReserveDivisor, maxResponseReserve);
+}
+
+void ContextManager::append(const QJsonObject &message, int tokens)
+{
+    const QByteArray encoded = encode(message);
+    if (!encodedHistory.isEmpty())
+        encodedHistory += ',';
+    encodedHistory += encoded;
+    encodedSizes.append(encoded.size());
+
+    history.append(message);
+    historyTokens.append(tokens);
+    totalHistoryTokens += tokens;
+
+    trim();
+}
+
+void ContextManager::trim()
+{
+    const qsizetype messagesBefore = history.size();
+    const int tokensBefore = estimatedTokens();
+    while (estimatedTokens() > budget())
+    {
+        // find where the second turn starts; everything before it is the oldest turn
+        qsizetype end = 1;
+        while (end < history.size() && history.at(end)["role"].toString() != "user")
+            ++end;
+
+        // the newest turn has to stay, even if it doesn't fit on its own
+        if (end >= history.size())
+            break;
+
+        // the dropped messages come off the front of the encoded history in one go, along with the comma after each
+        qsizetype bytes = 0;
+        for (qsizetype i = 0; i < end; ++i)
+        {
+            totalHistoryTokens -= historyTokens.takeFirst();
+            history.removeFirst();
+            bytes += encodedSizes.takeFirst() + 1;
+        }
+        encodedHistory.remove(0, bytes);
+    }
+
+    if (history.size() < messagesBefore)
+        LOG_DEBUG("history.trimmed", "messages", messagesBefore - history.size(), "tokens",
+                  tokensBefore - estimatedTokens(), "kept", history.size());
+}
@@ -0,0 +1,409 @@
+/*
+    conversationstore.cpp
+
+    Class implementation for ConversationStore.
+*/
+
+#include "conversationstore.h"
+#include "logger.h"
+#include <QDateTime>
+#include <QSaveFile>
+#include <cstring>
+
+namespace
+{
+
+/*
+    File layout: a FileHeader, then records back to back. Each record is a RecordHeader followed by its text as UTF-8,
+    padded so the next header is 8-byte aligned. A session is a SessionStart record and the messages after it; the
+    header points at the newest one so a restore can skip everything before it.
+*/
+constexpr char fileMagic[8] = { 'Z', 'I', 'P', 'P', 'Y', 'C', 'V', '1' };
+constexpr quint32 recordMagic = 0x5a4d5347; // "ZMSG"
+constexpr quint8 mirrorFlag = 0x80;         // the text is the same as the previous one of this role; none is stored
+
+struct FileHeader
+{
+    char magic[8];
+    qint64 lastSessionOffset; // of the newest SessionStart record, 0 if there is none yet
+    quint32 firstSession;
+    quint32 lastSession;
+    qint64 reserved;
+};
+
+struct RecordHeader
+{
+    quint32 magic;
+    quint32 session;
+    quint8 kind;
+    quint8 role;
+    quint8 flags; // ConversationStore::Placement, plus mirrorFlag
+    quint8 reserved;
+    quint32 length; // of the text in bytes, without padding
+    qint64 timestamp; // ms since epoch
+    qint64 reserved2;
+};
+
+const char *const roleNames[] = { "user", "assistant", "tool" };
+constexpr quint8 roleCount = quint8(sizeof(roleNames) / sizeof(roleNames[0]));
+
+qint64 recordSize(quint32 length)
+{
+    return qint64(sizeof(RecordHeader)) + ((qint64(length) + 7) & ~qint64(7));
+}
+
+quint8 roleIndex(const QString &role)
+{
+    for (quint8 i = 0; i < roleCount; ++i)
+    {
+        if (role == QLatin1String(roleNames[i]))
+            return i;
+    }
+    return roleCount;
+}
+
+} // namespace
+
+ConversationStore::ConversationStore(QObject *parent)
+    : QObject(parent), keepSessions(0), firstSession(0), currentSession(0), sessionOffset(0), compacting(false)
+{
+    worker.moveToThread(&compactThread);
+    compactThread.start();
+}
+
+ConversationStore::~ConversationStore()
+{
+    // a compaction still running finishes first, so it never leaves a half-written file behind
+    compactThread.quit();
+    compactThread.wait();
+
+    // its reply to this object is never delivered now, so reopen here to write what was held back
+    if (compacting)
+        finishCompaction(true);
+    close();
+}
+
+bool ConversationStore::open(const QString &path, int keepSessions)
+{
+    close();
+
+    this->path = path;
+    this->keepSessions = qMax(0, keepSessions);
+
+    // unbuffered, so every message is in the file as soon as write() returns
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered))
+    {
+        LOG_ERROR("conversations.open_failed", "path", path, "error", file.errorString());
+        return false;
+    }
+
+    if (file.size() == 0)
+    {
+        FileHeader header = {};
+        std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    if (!load())
+    {
+        close();
+        return false;
+    }
+
+    if (sessionOffset == 0)
+        startSession();
+    else if (this->keepSessions > 0 && currentSession - firstSession + 1 > quint32(this->keepSessions) * 2)
+        compactInBackground();
+
+    return isOpen() || compacting;
+}
+
+void ConversationStore::close()
+{
+    if (file.isOpen())
+        file.close();
+    lastText.clear();
+}
+
+bool ConversationStore::isOpen() const
+{
+    return file.isOpen();
+}
+
+QList<ConversationStore::Message> ConversationStore::lastSession()
+{
+    QList<Message> messages;
+    if (file.isOpen())
+        scanLastSession(&messages);
+    return messages;
+}
+
+void ConversationStore::append(const QString &role, const QString &text, int placement)
+{
+    if (compacting)
+    {
+        pending.append({ MessageRecord, role, text, placement });
+        return;
+    }
+
+    const quint8 index = roleIndex(role);
+    if (!file.isOpen() || index == roleCount)
+        return;
+
+    const QByteArray utf8 = text.toUtf8();
+    auto last = lastText.constFind(index);
+    if (last != lastText.constEnd() && *last == utf8)
+    {
+        writeRecord(MessageRecord, index, quint8(placement) | mirrorFlag, QByteArray());
+        return;
+    }
+
+    if (writeRecord(MessageRecord, index, quint8(placement), utf8))
+        lastText.insert(index, utf8);
+}
+
+void ConversationStore::startSession()
+{
+    if (compacting)
+    {
+        pending.append({ SessionStart, QString(), QString(), 0 });
+        return;
+    }
+    if (!file.isOpen())
+        return;
+
+    const qint64 offset = file.size();
+    const quint32 session = sessionOffset == 0 ? firstSession : currentSession + 1;
+    currentSession = session;
+    if (!writeRecord(SessionStart, 0, 0, QByteArray()))
+        return;
+
+    sessionOffset = offset;
+    lastText.clear();
+    writeHeader();
+
+    if (keepSessions > 0 && currentSession - firstSession + 1 > quint32(keepSessions) * 2)
+        compactInBackground();
+}
+
+bool ConversationStore::load()
+{
+    const qint64 size = file.size();
+    FileHeader header;
+    if (size < qint64(sizeof(header)) || !file.seek(0)
+        || file.read(reinterpret_cast<char *>(&header), sizeof(header)) != sizeof(header)
+        || std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0)
+    {
+        LOG_WARNING("conversations.ignored", "path", file.fileName(), "reason", "not a conversation log");
+        return false;
+    }
+
+    firstSession = header.firstSession;
+    currentSession = header.lastSession;
+    sessionOffset = header.lastSessionOffset;
+
+    // the header is written after the session's first record, so a crash in between leaves it pointing one back; the
+    // scan below moves on to any session that starts later
+    if (sessionOffset < qint64(sizeof(header)) || sessionOffset >= size)
+        sessionOffset = 0;
+
+    return scanLastSession(nullptr);
+}
+
+bool ConversationStore::scanLastSession(QList<Message> *messages)
+{
+    const qint64 size = file.size();
+    const qint64 recorded = sessionOffset;
+    const qint64 start = sessionOffset > 0 ? sessionOffset : qint64(sizeof(FileHeader));
+    if (start >= size)
+        return true;
+
+    // only the newest session is mapped; older ones are never touched
+    uchar *mapped = file.map(start, size - start);
+    if (!mapped)
+    {
+        LOG_ERROR("conversations.map_failed", "path", file.fileName(), "error", file.errorString());
+        return false;
+    }
+
+    QHash<quint8, QByteArray> texts;
+    qint64 pos = 0;
+    while (start + pos + qint64(sizeof(RecordHeader)) <= size)
+    {
+        RecordHeader header;
+        std::memcpy(&header, mapped + pos, sizeof(header));
+        if (header.magic != recordMagic || start + pos + recordSize(header.length) > size)
+            break;
+
+        if (header.kind == SessionStart)
+        {
+            if (messages)
+                messages->clear();
+            texts.clear();
+            sessionOffset = start + pos;
+            currentSession = header.session;
+        }
+        else if (header.role < roleCount)
+        {
+            QByteArray text;
+            if (header.flags & mirrorFlag)
+                text = texts.value(header.role);
+            else
+            {
+                text = QByteArray(reinterpret_cast<const char *>(mapped + pos + sizeof(header)), header.length);
+                texts.insert(header.role, text);
+            }
+
+            if (messages)
+                messages->append({ roleNames[header.role], QString::fromUtf8(text), header.flags & ~mirrorFlag });
+        }
+        pos += recordSize(header.length);
+    }
+    file.unmap(mapped);
+    lastText = texts;
+
+    // whatever follows the last complete record was cut off by a crash mid-write
+    if (start + pos < size)
+    {
+        LOG_WARNING("conversations.truncated", "path", file.fileName(), "bytes", size - start - pos);
+        if (!file.resize(start + pos))
+            return false;
+    }
+
+    if (sessionOffset != recorded)
+        writeHeader();
+    return true;
+}
+
+bool ConversationStore::writeRecord(RecordKind kind, quint8 role, quint8 flags, const QByteArray &text)
+{
+    RecordHeader header = {};
+    header.magic = recordMagic;
+    header.session = currentSession;
+    header.kind = kind;
+    header.role = role;
+    header.flags = flags;
+    header.length = quint32(text.size());
+    header.timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    QByteArray record(recordSize(header.length), '\0');
+    std::memcpy(record.data(), &header, sizeof(header));
+    std::memcpy(record.data() + sizeof(header), text.constData(), text.size());
+
+    const qint64 offset = file.size();
+    if (!file.seek(offset) || file.write(record) != record.size())
+    {
+        LOG_ERROR("conversations.write_failed", "path", file.fileName(), "error", file.errorString());
+        file.resize(offset);
+        return false;
+    }
+    return true;
+}
+
+void ConversationStore::writeHeader()
+{
+    FileHeader header = {};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.lastSessionOffset = sessionOffset;
+    header.firstSession = firstSession;
+    header.lastSession = currentSession;
+
+    if (!file.seek(0) || file.write(reinterpret_cast<const char *>(&header), sizeof(header)) != sizeof(header))
+        LOG_ERROR("conversations.write_failed", "path", file.fileName(), "error", file.errorString());
+}
+
+void ConversationStore::compactInBackground()
+{
+    if (compacting)
+        return;
+
+    // the file is handed over to the worker; messages are held back until it is reopened
+    compacting = true;
+    const quint32 keepFrom = currentSession - quint32(keepSessions) + 1;
+    file.close();
+
+    QMetaObject::invokeMethod(&worker, [this, path = path, keepFrom]() {
+        const bool succeeded = compactFile(path, keepFrom);
+        QMetaObject::invokeMethod(this, [this, succeeded]() { finishCompaction(succeeded); }, Qt::QueuedConnection);
+    });
+}
+
+void ConversationStore::finishCompaction(bool succeeded)
+{
+    compacting = false;
+    if (!succeeded)
+        LOG_WARNING("conversations.compact_failed", "path", path);
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered) || !load())
+    {
+        LOG_ERROR("conversations.reopen_failed", "path", path, "error", file.errorString());
+        close();
+        pending.clear();
+        return;
+    }
+
+    const QList<Pending> held = std::move(pending);
+    pending.clear();
+    for (const Pending &entry : held)
+    {
+        if (entry.kind == SessionStart)
+            startSession();
+        else
+            append(entry.role, entry.text, entry.placement);
+    }
+}
+
+bool ConversationStore::compactFile(const QString &path, quint32 keepFrom)
+{
+    // runs on the worker thread, so it only touches its own copies of the file
+    QFile input(path);
+    if (!input.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = input.size();
+    uchar *mapped = input.map(0, size);
+    if (!mapped || size < qint64(sizeof(FileHeader)))
+        return false;
+
+    FileHeader header;
+    std::memcpy(&header, mapped, sizeof(header));
+
+    // find where the oldest session to keep starts; everything before it goes
+    qint64 cut = -1;
+    qint64 pos = sizeof(FileHeader);
+    while (pos + qint64(sizeof(RecordHeader)) <= size)
+    {
+        RecordHeader record;
+        std::memcpy(&record, mapped + pos, sizeof(record));
+        if (record.magic != recordMagic || pos + recordSize(record.length) > size)
+            break;
+
+        if (record.kind == SessionStart && record.session >= keepFrom)
+        {
+            cut = pos;
+            break;
+        }
+        pos += recordSize(record.length);
+    }
+
+    if (cut < 0 || header.lastSessionOffset < cut)
+    {
+        input.unmap(mapped);
+        return false;
+    }
+
+    header.lastSessionOffset -= cut - qint64(sizeof(FileHeader));
+    header.firstSession = keepFrom;
+
+    QSaveFile output(path);
+    const bool written = output.open(QIODevice::WriteOnly)
+                         && output.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header)
+                         && output.write(reinterpret_cast<const char *>(mapped + cut), size - cut) == size - cut;
+
+    // the old file has to be released before it can be replaced on every platform
+    input.unmap(mapped);
+    input.close();
+    return written && output.commit();
+}
@@ -0,0 +1,379 @@
+/*
+    logger.cpp
+
+    Class implementation for Logger.
+*/
+
+#include "logger.h"
+#include <QDateTime>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+std::atomic<int> Logger::threshold{ Logger::Off };
+std::atomic<quint64> Logger::generation{ 0 };
+std::mutex Logger::instanceMutex;
+Logger *Logger::instance = nullptr;
+
+namespace
+{
+
+// how often the writer looks for new records when nothing wakes it sooner
+constexpr std::chrono::milliseconds writeInterval(100);
+
+/*
+    Appends a value to a logfmt line, quoted if it has to be.
+*/
+void appendText(QByteArray &line, const char *text, qsizetype size)
+{
+    const bool quote = size == 0 || std::any_of(text, text + size, [](char c)
+    {
+        return c == ' ' || c == '=' || c == '"' || c == '\\' || c == '\n' || c == '\r' || c == '\t';
+    });
+    if (!quote)
+    {
+        line.append(text, size);
+        return;
+    }
+
+    line += '"';
+    for (qsizetype i = 0; i < size; ++i)
+    {
+        switch (text[i])
+        {
+        case '"':
+            line += "\\\"";
+            break;
+        case '\\':
+            line += "\\\\";
+            break;
+        case '\n':
+            line += "\\n";
+            break;
+        case '\r':
+            line += "\\r";
+            break;
+        case '\t':
+            line += "\\t";
+            break;
+        default:
+            line += text[i];
+        }
+    }
+    line += '"';
+}
+
+} // namespace
+
+Logger::Logger(QSettings &settings)
+    : fileLevel(levelFromName(settings.value("Log/Level", "info").toString(), Info)),
+      consoleLevel(levelFromName(settings.value("Log/Console", "info").toString(), Info)),
+      path(settings.value("Log/Path", "cob_zippy_ai.log").toString()),
+      maxBytes(settings.value("Log/MaxSizeMB", 8).toLongLong() * 1024 * 1024),
+      files(qMax(0, settings.value("Log/Files", 3).toInt())),
+      stopping(false)
+{
+    if (path.isEmpty())
+    {
+        fileLevel = Off;
+    }
+    else if (fileLevel != Off)
+    {
+        file.setFileName(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        {
+            // there is nowhere else to say so
+            std::fprintf(stderr, "Could not open log file %s: %s\n", qPrintable(path), qPrintable(file.errorString()));
+            fileLevel = Off;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(instanceMutex);
+        instance = this;
+        generation.fetch_add(1, std::memory_order_release);
+    }
+    threshold.store(qMin(fileLevel, consoleLevel), std::memory_order_relaxed);
+
+    writer = std::thread(&Logger::run, this);
+}
+
+Logger::~Logger()
+{
+    threshold.store(Off, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(instanceMutex);
+        instance = nullptr;
+        generation.fetch_add(1, std::memory_order_release);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_one();
+    writer.join();
+}
+
+const char *Logger::levelName(Level level)
+{
+    switch (level)
+    {
+    case Debug:
+        return "debug";
+    case Info:
+        return "info";
+    case Warning:
+        return "warning";
+    case Error:
+        return "error";
+    default:
+        return "off";
+    }
+}
+
+Logger::Level Logger::levelFromName(const QString &name, Level fallback)
+{
+    for (Level level : { Debug, Info, Warning, Error, Off })
+    {
+        if (name.compare(QLatin1String(levelName(level)), Qt::CaseInsensitive) == 0)
+            return level;
+    }
+    std::fprintf(stderr, "Ignoring unknown log level \"%s\".\n", qPrintable(name));
+    return fallback;
+}
+
+void Logger::Record::start(Level level, const char *event)
+{
+    time = std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+    this->event = event;
+    this->level = level;
+    fieldCount = 0;
+    textUsed = 0;
+}
+
+void Logger::Record::addText(const char *key, QStringView value)
+{
+    // encoded by hand, since QString::toUtf8() would allocate
+    const quint16 offset = textUsed;
+    char *out = text + textUsed;
+    char *const end = text + TextSize;
+    for (qsizetype i = 0; i < value.size(); ++i)
+    {
+        char32_t c = value[i].unicode();
+        if (QChar::isHighSurrogate(c) && i + 1 < value.size() && value[i + 1].isLowSurrogate())
+            c = QChar::surrogateToUcs4(char16_t(c), value[++i].unicode());
+        else if (QChar::isSurrogate(c))
+            c = QChar::ReplacementCharacter;
+
+        const int length = c < 0x80 ? 1 : c < 0x800 ? 2 : c < 0x10000 ? 3 : 4;
+        if (end - out < length)
+            break;
+
+        if (length == 1)
+        {
+            *out++ = char(c);
+        }
+        else
+        {
+            static const unsigned char leads[] = { 0, 0, 0xc0, 0xe0, 0xf0 };
+            for (int shift = 6 * (length - 1), first = 1; shift >= 0; shift -= 6, first = 0)
+                *out++ = char(first ? leads[length] | (c >> shift) : 0x80 | ((c >> shift) & 0x3f));
+        }
+    }
+
+    textUsed = quint16(out - text);
+    keys[fieldCount] = key;
+    types[fieldCount] = Text;
+    values[fieldCount].span.offset = offset;
+    values[fieldCount++].span.size = quint16(textUsed - offset);
+}
+
+void Logger::Record::addText(const char *key, const char *value, qsizetype size)
+{
+    qsizetype length = qMin(size, qsizetype(TextSize - textUsed));
+
+    // a character cut in half would come out as garbage
+    if (length < size)
+    {
+        while (length > 0 && (value[length] & 0xc0) == 0x80)
+            --length;
+    }
+
+    std::memcpy(text + textUsed, value, length);
+    keys[fieldCount] = key;
+    types[fieldCount] = Text;
+    values[fieldCount].span.offset = textUsed;
+    values[fieldCount++].span.size = quint16(length);
+    textUsed = quint16(textUsed + length);
+}
+
+/*
+    Returns the calling thread's ring, registering one on the thread's first log call. Returns nullptr while there is
+    no Logger.
+*/
+Logger::Ring *Logger::threadRing()
+{
+    thread_local Ring *ring = nullptr;
+    thread_local quint64 ringGeneration = 0;
+
+    if (ring && ringGeneration == generation.load(std::memory_order_acquire))
+        return ring;
+
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (!instance)
+        return nullptr;
+
+    std::lock_guard<std::mutex> ringsLock(instance->ringsMutex);
+    instance->rings.push_back(std::make_unique<Ring>());
+    ring = instance->rings.back().get();
+    ring->thread = int(instance->rings.size());
+    ringGeneration = generation.load(std::memory_order_relaxed);
+    return ring;
+}
+
+void Logger::wakeWriter()
+{
+    std::lock_guard<std::mutex> lock(instanceMutex);
+    if (instance)
+        instance->wake.notify_one();
+}
+
+QByteArray Logger::format(const Record &record, int thread)
+{
+    QByteArray line;
+    line.reserve(96 + record.textUsed);
+    line += "time=";
+    line += QDateTime::fromMSecsSinceEpoch(record.time / 1000).toString(Qt::ISODateWithMs).toLatin1();
+    line += " level=";
+    line += levelName(record.level);
+    line += " thread=";
+    line += QByteArray::number(thread);
+    line += " event=";
+    line += record.event;
+
+    for (int i = 0; i < record.fieldCount; ++i)
+    {
+        line += ' ';
+        line += record.keys[i];
+        line += '=';
+        switch (record.types[i])
+        {
+        case Integer:
+            line += QByteArray::number(record.values[i].integer);
+            break;
+        case Real:
+            line += QByteArray::number(record.values[i].real, 'g', 6);
+            break;
+        case Boolean:
+            line += record.values[i].integer ? "true" : "false";
+            break;
+        case Text:
+            appendText(line, record.text + record.values[i].span.offset, record.values[i].span.size);
+            break;
+        }
+    }
+    line += '\n';
+    return line;
+}
+
+void Logger::run()
+{
+    std::unique_lock<std::mutex> lock(wakeMutex);
+    while (!stopping)
+    {
+        wake.wait_for(lock, writeInterval);
+        lock.unlock();
+        drain();
+        lock.lock();
+    }
+
+    // whatever was logged while stopping
+    lock.unlock();
+    drain();
+}
+
+/*
+    Takes every finished record out of the rings and writes them, oldest first.
+*/
+void Logger::drain()
+{
+    std::vector<Ring *> current;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        current.reserve(rings.size());
+        for (const std::unique_ptr<Ring> &ring : rings)
+            current.push_back(ring.get());
+    }
+
+    std::vector<Line> lines;
+    for (Ring *ring : current)
+    {
+        const quint32 head = ring->head.load(std::memory_order_acquire);
+        quint32 tail = ring->tail.load(std::memory_order_relaxed);
+        for (; tail != head; ++tail)
+        {
+            const Record &record = ring->records[tail % RingSize];
+            lines.push_back({ record.time, record.level, format(record, ring->thread) });
+        }
+        ring->tail.store(tail, std::memory_order_release);
+
+        if (const quint32 dropped = ring->dropped.exchange(0, std::memory_order_relaxed))
+        {
+            Record record;
+            record.start(Warning, "log.dropped");
+            record.add("records", dropped);
+            lines.push_back({ record.time, Warning, format(record, ring->thread) });
+        }
+    }
+    if (lines.empty())
+        return;
+
+    // each ring is in order already, but the threads' records interleave
+    std::stable_sort(lines.begin(), lines.end(), [](const Line &a, const Line &b) { return a.time < b.time; });
+    writeLines(lines);
+}
+
+void Logger::writeLines(const std::vector<Line> &lines)
+{
+    bool toConsole = false;
+    for (const Line &line : lines)
+    {
+        if (line.level >= fileLevel && file.isOpen())
+            file.write(line.text);
+        if (line.level >= consoleLevel)
+        {
+            std::fwrite(line.text.constData(), 1, size_t(line.text.size()), stderr);
+            toConsole = true;
+        }
+    }
+
+    if (toConsole)
+        std::fflush(stderr);
+    if (file.isOpen())
+    {
+        file.flush();
+        if (maxBytes > 0 && file.size() >= maxBytes)
+            rotate();
+    }
+}
+
+/*
+    Moves the full log file aside as path.1, shifting the older ones along and dropping the oldest, and starts a new
+    one.
+*/
+void Logger::rotate()
+{
+    file.close();
+    QFile::remove(path + "." + QString::number(files));
+    for (int i = files - 1; i >= 1; --i)
+        QFile::rename(path + "." + QString::number(i), path + "." + QString::number(i + 1));
+    if (files > 0)
+        QFile::rename(path, path + ".1");
+    else
+        QFile::remove(path);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        std::fprintf(stderr, "Could not open log file %s: %s\n", qPrintable(path), qPrintable(file.errorString()));
+}
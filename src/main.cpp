@@ -1,13 +1,128 @@
+#include <QCommandLineParser>
+#include <QCoreApplication>
 #include <QGuiApplication>
 #include <QQmlApplicationEngine>
+#include "batchrunner.h"
+#include "chatservice.h"
+#include "logger.h"
 #include "programcontroller.h"
+#include "startuptrace.h"
 #include <QQmlContext>
+#include <QQuickWindow>
+#include <cstdio>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+/*
+    Whether to run without the window. The application object depends on it, so this looks at the arguments before
+    there is one to parse them properly.
+*/
+static bool isHeadless(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        // exactly, so a mistyped option like --batchsize doesn't start the wrong mode
+        if (std::strcmp(argv[i], "--headless") == 0 || std::strcmp(argv[i], "--batch") == 0 ||
+            std::strncmp(argv[i], "--batch=", 8) == 0)
+            return true;
+    }
+    return false;
+}
+
+/*
+    On Windows the executable is built for the GUI subsystem, so it starts without a console and what it writes to
+    standard output and standard error is lost. Without the window, it writes to the console it was started from
+    instead, unless the output was redirected.
+*/
+static void attachConsole()
+{
+#ifdef Q_OS_WIN
+    if (!AttachConsole(ATTACH_PARENT_PROCESS))
+        return;
+
+    FILE *stream = nullptr;
+    if (!GetStdHandle(STD_OUTPUT_HANDLE))
+        freopen_s(&stream, "CONOUT$", "w", stdout);
+    if (!GetStdHandle(STD_ERROR_HANDLE))
+        freopen_s(&stream, "CONOUT$", "w", stderr);
+#endif
+}
+
+/*
+    Serves conversations over HTTP for other displays, or replays a file of prompts and reports the throughput.
+*/
+static int runHeadless(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Zippy AI without the window: a chat service for other displays, or a load test.");
+    parser.addHelpOption();
+    parser.addOptions({
+        { "headless", "Serve conversations over HTTP instead of showing the window." },
+        { "port", "Port to serve on (default Service/Port).", "port" },
+        { "batch", "Replay the prompts in this file, report the throughput and exit.", "file" },
+        { "concurrency", "Conversations replayed at the same time.", "count", "1" },
+    });
+    parser.process(app);
+
+    ProgramController controller;
+
+    if (parser.isSet("batch"))
+    {
+        BatchRunner batch(&controller);
+        if (!batch.load(parser.value("batch")))
+            return 1;
+
+        QObject::connect(&batch, &BatchRunner::finished, &app, [&batch]()
+        {
+            QCoreApplication::exit(batch.failures() > 0 ? 1 : 0);
+        }, Qt::QueuedConnection);
+        batch.start(parser.value("concurrency").toInt());
+        return app.exec();
+    }
+
+    // local only by default; serving other machines is a deliberate setting
+    QSettings settings("cob_zippy_ai.ini", QSettings::IniFormat);
+    const QString address = settings.value("Service/Address", "127.0.0.1").toString();
+    const quint16 port = quint16(parser.isSet("port") ? parser.value("port").toUInt()
+                                                      : settings.value("Service/Port", 8090).toUInt());
+
+    ChatService service(&controller);
+    if (!service.listen(QHostAddress(address), port))
+    {
+        LOG_ERROR("service.listen_failed", "address", address, "port", port);
+        return 1;
+    }
+
+    LOG_INFO("service.listening", "address", address, "port", service.port());
+    return app.exec();
+}
 
 int main(int argc, char *argv[])
 {
+    // the console first, so the logger's standard error goes to it
+    const bool headless = isHeadless(argc, argv);
+    if (headless)
+        attachConsole();
+
+    // before anything that might log, and gone only after everything else
+    QSettings settings("cob_zippy_ai.ini", QSettings::IniFormat);
+    Logger logger(settings);
+
+    if (headless)
+        return runHeadless(argc, argv);
+
+    // next, so every phase counts from launch
+    StartupTrace startup;
+
     qputenv("QT_IM_MODULE", QByteArray("qtvirtualkeyboard"));
 
     QGuiApplication app(argc, argv);
+    startup.mark("application");
 
     QQmlApplicationEngine engine;
     QObject::connect(
@@ -19,8 +134,21 @@ int main(int argc, char *argv[])
 
     ProgramController controller;
     engine.rootContext()->setContextProperty("controller", &controller);
+    startup.mark("controller");
 
     engine.loadFromModule("cob_zippy_ai", "Main");
+    startup.mark("qml");
+    if (QQuickWindow *window = qobject_cast<QQuickWindow *>(engine.rootObjects().value(0)))
+    {
+        controller.watchFrames(window);
+        startup.watch(window);
+    }
+
+    QObject::connect(&startup, &StartupTrace::finished, &controller, [&startup, &controller]()
+    {
+        for (const StartupTrace::Phase &phase : startup.phases())
+            controller.recordStartup(phase.name, phase.nsecs);
+    });
 
     return app.exec();
 }
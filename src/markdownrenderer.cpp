@@ -0,0 +1,351 @@
+/*
+    markdownrenderer.cpp
+
+    Class implementation for MarkdownRenderer.
+*/
+
+#include "markdownrenderer.h"
+
+namespace
+{
+
+void appendEscaped(QString &html, QChar c)
+{
+    switch (c.unicode())
+    {
+    case '<':
+        html += QLatin1String("&lt;");
+        break;
+    case '>':
+        html += QLatin1String("&gt;");
+        break;
+    case '&':
+        html += QLatin1String("&amp;");
+        break;
+    case '"':
+        html += QLatin1String("&quot;");
+        break;
+    default:
+        html += c;
+    }
+}
+
+// "# Title" .. "###### Title"; 0 if the line is not a heading
+int headingLevel(QStringView line)
+{
+    int level = 0;
+    while (level < line.size() && level < 6 && line[level] == u'#')
+        ++level;
+    return level > 0 && level < line.size() && line[level] == u' ' ? level : 0;
+}
+
+// three or more of the same '-', '*' or '_', possibly spaced out
+bool isRule(QStringView line)
+{
+    const QChar marker = line.front();
+    if (marker != u'-' && marker != u'*' && marker != u'_')
+        return false;
+
+    int count = 0;
+    for (QChar c : line)
+    {
+        if (c == marker)
+            ++count;
+        else if (c != u' ')
+            return false;
+    }
+    return count >= 3;
+}
+
+} // namespace
+
+void MarkdownRenderer::append(const QString &text)
+{
+    source += text;
+}
+
+const QString &MarkdownRenderer::closedHtml()
+{
+    parseLines();
+    return closed;
+}
+
+QString MarkdownRenderer::openHtml()
+{
+    parseLines();
+
+    // the open block and the line being written can still change, so they are rendered from a copy
+    Block tail = open;
+    QString html;
+    if (parsed < source.size())
+        feed(tail, QStringView(source).sliced(parsed), html);
+    close(tail, html);
+    return html;
+}
+
+QString MarkdownRenderer::html()
+{
+    return closedHtml() + openHtml();
+}
+
+void MarkdownRenderer::parseLines()
+{
+    // each complete line is parsed once, and a block's HTML is kept from the moment it closes
+    for (qsizetype end; (end = source.indexOf(u'\n', parsed)) >= 0; parsed = end + 1)
+        feed(open, QStringView(source).sliced(parsed, end - parsed), closed);
+}
+
+const QString &MarkdownRenderer::text() const
+{
+    return source;
+}
+
+void MarkdownRenderer::clear()
+{
+    source.clear();
+    parsed = 0;
+    closed.clear();
+    open = Block();
+}
+
+void MarkdownRenderer::feed(Block &block, QStringView line, QString &html)
+{
+    if (line.endsWith(u'\r'))
+        line = line.chopped(1);
+    const QStringView trimmed = line.trimmed();
+
+    if (block.kind == CodeBlock)
+    {
+        if (trimmed.startsWith(u"```"))
+            close(block, html);
+        else
+            block.lines.append(line.toString());
+        return;
+    }
+
+    // a blank line ends a paragraph, but a list may carry on after one
+    if (trimmed.isEmpty())
+    {
+        if (block.kind == BulletList || block.kind == NumberedList)
+            block.blank = true;
+        else
+            close(block, html);
+        return;
+    }
+
+    if (trimmed.startsWith(u"```"))
+    {
+        close(block, html);
+        block.kind = CodeBlock;
+        return;
+    }
+
+    const int level = headingLevel(trimmed);
+    if (level > 0)
+    {
+        close(block, html);
+        const QString tag = QString::number(level);
+        html += QLatin1String("<h") + tag + u'>' + renderInline(trimmed.sliced(level).trimmed())
+                + QLatin1String("</h") + tag + u'>';
+        return;
+    }
+
+    if (isRule(trimmed))
+    {
+        close(block, html);
+        html += QLatin1String("<hr/>");
+        return;
+    }
+
+    const bool inList = block.kind == BulletList || block.kind == NumberedList;
+    const bool indented = line.startsWith(u' ') || line.startsWith(u'\t');
+
+    BlockKind item = NoBlock;
+    qsizetype marker = 0;
+    int number = 1;
+    if (trimmed.size() >= 2 && (trimmed[0] == u'-' || trimmed[0] == u'*' || trimmed[0] == u'+') && trimmed[1] == u' ')
+    {
+        item = BulletList;
+        marker = 2;
+    }
+    else
+    {
+        qsizetype digits = 0;
+        while (digits < trimmed.size() && digits < 9 && trimmed[digits].isDigit())
+            ++digits;
+        if (digits > 0 && digits + 1 < trimmed.size() && (trimmed[digits] == u'.' || trimmed[digits] == u')')
+            && trimmed[digits + 1] == u' ')
+        {
+            item = NumberedList;
+            marker = digits + 2;
+            number = trimmed.first(digits).toInt();
+        }
+    }
+
+    if (item != NoBlock)
+    {
+        // nested lists are flattened into the list they are in
+        if (block.kind != item && !(inList && indented))
+        {
+            close(block, html);
+            block.kind = item;
+            block.start = number;
+        }
+        block.blank = false;
+        block.lines.append(trimmed.sliced(marker).trimmed().toString());
+        return;
+    }
+
+    if (inList)
+    {
+        // an indented line, or one straight after an item, carries on that item
+        if (indented || !block.blank)
+        {
+            block.lines.last() += u' ';
+            block.lines.last() += trimmed;
+            block.blank = false;
+            return;
+        }
+        close(block, html);
+    }
+
+    if (trimmed.startsWith(u'>'))
+    {
+        if (block.kind != Quote)
+        {
+            close(block, html);
+            block.kind = Quote;
+        }
+        block.lines.append(trimmed.sliced(1).trimmed().toString());
+        return;
+    }
+
+    // a line without a marker carries on a quote too
+    if (block.kind != Paragraph && block.kind != Quote)
+    {
+        close(block, html);
+        block.kind = Paragraph;
+    }
+    block.lines.append(trimmed.toString());
+}
+
+void MarkdownRenderer::close(Block &block, QString &html)
+{
+    switch (block.kind)
+    {
+    case NoBlock:
+        break;
+    case Paragraph:
+        html += QLatin1String("<p>") + renderInline(block.lines.join(u' ')) + QLatin1String("</p>");
+        break;
+    case CodeBlock:
+        html += QLatin1String("<pre>") + block.lines.join(u'\n').toHtmlEscaped() + QLatin1String("</pre>");
+        break;
+    case BulletList:
+    case NumberedList:
+        if (block.kind == BulletList)
+            html += QLatin1String("<ul>");
+        else if (block.start == 1)
+            html += QLatin1String("<ol>");
+        else
+            html += QLatin1String("<ol start=\"") + QString::number(block.start) + QLatin1String("\">");
+
+        for (const QString &item : std::as_const(block.lines))
+            html += QLatin1String("<li>") + renderInline(item) + QLatin1String("</li>");
+        html += block.kind == BulletList ? QLatin1String("</ul>") : QLatin1String("</ol>");
+        break;
+    case Quote:
+        html += QLatin1String("<blockquote>") + renderInline(block.lines.join(u' ')) + QLatin1String("</blockquote>");
+        break;
+    }
+    block = Block();
+}
+
+QString MarkdownRenderer::renderInline(QStringView text)
+{
+    QString html;
+    html.reserve(text.size() + text.size() / 4);
+
+    qsizetype i = 0;
+    while (i < text.size())
+    {
+        const QChar c = text[i];
+
+        if (c == u'\\' && i + 1 < text.size() && text[i + 1].isPunct())
+        {
+            appendEscaped(html, text[i + 1]);
+            i += 2;
+            continue;
+        }
+
+        if (c == u'`')
+        {
+            const qsizetype end = text.indexOf(u'`', i + 1);
+            if (end > i + 1)
+            {
+                html += QLatin1String("<code>") + text.sliced(i + 1, end - i - 1).toString().toHtmlEscaped()
+                        + QLatin1String("</code>");
+                i = end + 1;
+                continue;
+            }
+        }
+        else if (c == u'*' || c == u'_' || c == u'~')
+        {
+            const qsizetype width = i + 1 < text.size() && text[i + 1] == c ? 2 : 1;
+            const qsizetype from = i + width;
+
+            // an opener has to touch what it emphasizes, and an underscore inside a word is just an underscore
+            const bool opens = (c != u'~' || width == 2) && from < text.size() && !text[from].isSpace()
+                               && (c != u'_' || i == 0 || !text[i - 1].isLetterOrNumber());
+
+            qsizetype end = from;
+            while (opens && (end = text.indexOf(QStringView(text).sliced(i, width), end)) > from)
+            {
+                const bool touches = !text[end - 1].isSpace() && text[end - 1] != c;
+                const bool alone = end + width >= text.size() || text[end + width] != c;
+                const bool wordEnd = c != u'_' || end + width >= text.size() || !text[end + width].isLetterOrNumber();
+                if (touches && alone && wordEnd)
+                    break;
+                ++end;
+            }
+
+            if (opens && end > from)
+            {
+                const char *tag = c == u'~' ? "s>" : width == 2 ? "b>" : "i>";
+                html += u'<';
+                html += QLatin1String(tag);
+                html += renderInline(text.sliced(from, end - from));
+                html += QLatin1String("</");
+                html += QLatin1String(tag);
+                i = end + width;
+                continue;
+            }
+
+            // a run of markers that opens nothing is plain text
+            for (qsizetype k = 0; k < width; ++k)
+                html += c;
+            i += width;
+            continue;
+        }
+        else if (c == u'[')
+        {
+            const qsizetype close = text.indexOf(u']', i + 1);
+            if (close > i && close + 1 < text.size() && text[close + 1] == u'(')
+            {
+                const qsizetype paren = text.indexOf(u')', close + 2);
+                if (paren > close)
+                {
+                    const QString href = text.sliced(close + 2, paren - close - 2).trimmed().toString();
+                    html += QLatin1String("<a href=\"") + href.toHtmlEscaped() + QLatin1String("\">")
+                            + renderInline(text.sliced(i + 1, close - i - 1)) + QLatin1String("</a>");
+                    i = paren + 1;
+                    continue;
+                }
+            }
+        }
+
+        appendEscaped(html, c);
+        ++i;
+    }
+    return html;
+}
@@ -0,0 +1,98 @@
+/*
+    modelkeeper.cpp
+
+    Class implementation for ModelKeeper.
+*/
+
+#include "modelkeeper.h"
+#include "logger.h"
+#include "ollamainterface.h"
+#include <QDateTime>
+
+ModelKeeper::ModelKeeper(OllamaInterface *ollama, QSettings &settings, QObject *parent)
+    : QObject(parent), ollama(ollama), unloaded(false)
+{
+    const int idleMinutes = settings.value("Ollama/IdleUnloadMinutes", 0).toInt();
+    idleTimer.setSingleShot(true);
+    idleTimer.setTimerType(Qt::VeryCoarseTimer);
+    idleTimer.setInterval(idleMinutes * 60 * 1000);
+    connect(&idleTimer, &QTimer::timeout, this, &ModelKeeper::onIdle);
+
+    const QString opening = settings.value("Ollama/OpeningTime", "").toString();
+    if (!opening.isEmpty())
+    {
+        openingTime = QTime::fromString(opening, "HH:mm");
+        if (!openingTime.isValid())
+            LOG_WARNING("settings.invalid", "key", "Ollama/OpeningTime", "value", opening);
+    }
+    openingTimer.setSingleShot(true);
+    openingTimer.setTimerType(Qt::VeryCoarseTimer);
+    connect(&openingTimer, &QTimer::timeout, this, &ModelKeeper::onOpeningTime);
+
+    connect(ollama, &OllamaInterface::connectedChanged, this, &ModelKeeper::onConnectedChanged);
+}
+
+void ModelKeeper::start()
+{
+    // our own idle timer decides when to unload, so the server must not unload on its own before that
+    if (idleTimer.interval() > 0)
+        ollama->setKeepAlive("-1");
+
+    // the model itself is loaded as soon as the health monitor reaches the server
+    unloaded = false;
+
+    if (idleTimer.interval() > 0)
+        idleTimer.start();
+    scheduleOpeningTime();
+}
+
+void ModelKeeper::notifyActivity()
+{
+    // the prompt itself loads the model again, there's no need for a separate preload
+    unloaded = false;
+
+    if (idleTimer.interval() > 0)
+        idleTimer.start();
+}
+
+bool ModelKeeper::isUnloaded() const
+{
+    return unloaded;
+}
+
+void ModelKeeper::onIdle()
+{
+    ollama->unloadModel();
+    unloaded = true;
+}
+
+void ModelKeeper::onConnectedChanged(bool connected)
+{
+    // a server that has just started (or restarted) has nothing loaded
+    if (connected && !unloaded)
+        ollama->preloadModel();
+}
+
+void ModelKeeper::onOpeningTime()
+{
+    ollama->preloadModel();
+    unloaded = false;
+
+    if (idleTimer.interval() > 0)
+        idleTimer.start();
+    scheduleOpeningTime();
+}
+
+void ModelKeeper::scheduleOpeningTime()
+{
+    if (!openingTime.isValid())
+        return;
+
+    const QDateTime now = QDateTime::currentDateTime();
+    QDateTime next(now.date(), openingTime);
+    if (next <= now)
+        next = next.addDays(1);
+
+    // timers drift over a whole night, so this is recomputed from the wall clock every day
+    openingTimer.start(int(now.msecsTo(next)));
+}
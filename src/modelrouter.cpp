@@ -0,0 +1,139 @@
+/*
+    modelrouter.cpp
+
+    Class implementation for ModelRouter.
+*/
+
+#include "modelrouter.h"
+#include <QStringList>
+#include <algorithm>
+
+namespace
+{
+
+// whole prompts a small model answers as well as a large one
+const QStringList smallTalk = { "hi", "hello", "hey", "thanks", "thank you", "thank you so much", "bye", "goodbye",
+                                "good morning", "good afternoon", "good evening", "who are you", "what is your name",
+                                "what's your name", "how are you", "what can you do", "ok", "okay", "cool", "great" };
+
+// words that ask for reasoning or an opinion rather than a fact
+const QStringList openEnded = { "why", "explain", "compare", "difference", "versus", "vs", "recommend", "should",
+                                "advice", "plan", "pros", "cons", "describe", "summarize", "analyze", "better",
+                                "best", "opinion", "if" };
+
+// words that only make sense with what was said before
+const QStringList referringBack = { "it", "that", "this", "those", "these", "they", "them", "there", "he", "she",
+                                    "him", "her", "one", "else", "again", "more" };
+const QStringList followUpOpeners = { "and", "but", "also", "so", "what about", "how about", "then" };
+
+// phrases of an answer that didn't know, or passed the question on (as the system prompt asks it to when unsure)
+const QStringList unsurePhrases = { "i don't know", "i do not know", "i'm not sure", "i am not sure", "not certain",
+                                    "i don't have", "i do not have", "i can't help", "i cannot help", "unable to",
+                                    "no information", "contact the college" };
+
+// lowercased, with punctuation other than apostrophes turned into spaces
+QString normalized(const QString &text)
+{
+    QString result = text.toLower();
+    for (QChar &c : result)
+    {
+        if (c == QChar(0x2019))
+            c = '\'';
+        else if (!c.isLetterOrNumber() && c != '\'')
+            c = ' ';
+    }
+    return result.simplified();
+}
+
+bool startsWithAny(const QString &text, const QStringList &openers)
+{
+    return std::any_of(openers.cbegin(), openers.cend(),
+                       [&text](const QString &opener) { return text == opener || text.startsWith(opener + ' '); });
+}
+
+} // namespace
+
+ModelRouter::ModelRouter(QSettings &settings)
+    : fastModel(settings.value("Routing/FastModel", "").toString().trimmed()),
+      maxFastWords(settings.value("Routing/MaxFastWords", 12).toInt()),
+      escalate(settings.value("Routing/Escalate", true).toBool())
+{
+}
+
+bool ModelRouter::isEnabled() const
+{
+    return !fastModel.isEmpty();
+}
+
+bool ModelRouter::escalates() const
+{
+    return escalate;
+}
+
+ModelRouter::Route ModelRouter::route(const QString &prompt, bool midConversation) const
+{
+    Route route = classify(prompt, midConversation);
+    if (isEnabled() && (route.intent == SmallTalk || route.intent == Question))
+    {
+        route.tier = Fast;
+        route.model = fastModel;
+    }
+    return route;
+}
+
+ModelRouter::Route ModelRouter::classify(const QString &prompt, bool midConversation) const
+{
+    const QString text = normalized(prompt);
+    const QStringList words = text.split(' ', Qt::SkipEmptyParts);
+    auto hasAny = [&words](const QStringList &list)
+    {
+        return std::any_of(words.cbegin(), words.cend(), [&list](const QString &word) { return list.contains(word); });
+    };
+
+    if (smallTalk.contains(text))
+        return { Large, SmallTalk, QString(), "small talk" };
+
+    if (words.size() > maxFastWords)
+        return { Large, OpenEnded, QString(), "long" };
+
+    if (prompt.count('?') > 1)
+        return { Large, OpenEnded, QString(), "several questions" };
+
+    if (hasAny(openEnded) || text.startsWith("how do") || text.startsWith("how can"))
+        return { Large, OpenEnded, QString(), "open-ended" };
+
+    // a small model keeps track of a conversation less well than of a single question
+    if (midConversation && (startsWithAny(text, followUpOpeners) || hasAny(referringBack)))
+        return { Large, FollowUp, QString(), "follow-up" };
+
+    return { Large, Question, QString(), "short question" };
+}
+
+bool ModelRouter::looksUnsure(const QString &answer)
+{
+    const QString text = normalized(answer);
+    if (text.isEmpty())
+        return true;
+    return std::any_of(unsurePhrases.cbegin(), unsurePhrases.cend(),
+                       [&text](const QString &phrase) { return text.contains(phrase); });
+}
+
+QString ModelRouter::tierName(Tier tier)
+{
+    return tier == Fast ? "fast" : "large";
+}
+
+QString ModelRouter::intentName(Intent intent)
+{
+    switch (intent)
+    {
+    case SmallTalk:
+        return "SmallTalk";
+    case Question:
+        return "Question";
+    case FollowUp:
+        return "FollowUp";
+    default:
+        return "OpenEnded";
+    }
+}
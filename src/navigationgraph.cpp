@@ -0,0 +1,563 @@
+/*
+    navigationgraph.cpp
+
+    Class implementation for NavigationGraph.
+*/
+
+#include "navigationgraph.h"
+#include "campusdata.h"
+#include <QRegularExpression>
+#include <limits>
+
+namespace
+{
+
+constexpr int unreachable = std::numeric_limits<int>::max() / 2;
+constexpr int floorChangeCost = 10;
+
+// words people use for the landmarks, mapped to place keys
+const struct
+{
+    const char *word;
+    const char *key;
+} landmarkWords[] = {
+    { "bathroom", "bathroom" },
+    { "bathrooms", "bathroom" },
+    { "restroom", "bathroom" },
+    { "restrooms", "bathroom" },
+    { "toilet", "bathroom" },
+    { "toilets", "bathroom" },
+    { "washroom", "bathroom" },
+    { "stairs", "stairs" },
+    { "stair", "stairs" },
+    { "stairwell", "stairs" },
+    { "staircase", "stairs" },
+    { "exit", "exit" },
+    { "exits", "exit" },
+    { "way out", "exit" },
+    { "elevator", "elevator" },
+    { "elevators", "elevator" },
+    { "lift", "elevator" },
+};
+
+// any of the landmark words, as a whole word
+QRegularExpression landmarkPattern()
+{
+    QStringList words;
+    for (const auto &landmark : landmarkWords)
+        words.append(QRegularExpression::escape(landmark.word));
+    return QRegularExpression(QString(R"(\b(%1)\b)").arg(words.join('|')));
+}
+
+QString landmarkKey(const QString &word)
+{
+    for (const auto &landmark : landmarkWords)
+    {
+        if (word == landmark.word)
+            return landmark.key;
+    }
+    return QString();
+}
+
+} // namespace
+
+NavigationGraph::NavigationGraph()
+    : startNode(0)
+{
+    load();
+    computeShortestPaths();
+    renderAllRoutes();
+}
+
+QString NavigationGraph::answer(const QString &prompt) const
+{
+    // only an explicit request for a route; "where" or a landmark word on its own is too common in other questions
+    static const QRegularExpression intentPattern(
+        R"(\b(how (do|can|would|should) i (get|go) to|how to (get|go) to|)"
+        R"((how|where) (do|can) i find (the|a|an|room|rm|\d{3})|where ?('s|is|are) (the|a|an|room|rm|\d{3})|)"
+        R"(directions? to|take me to|(the )?way to|navigate to)\b)",
+        QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression originPattern(
+        R"(\b(?:from|i'?m (?:in|at)|i am (?:in|at))\s+(?:the\s+)?(?:(?:room|rm\.?)\s*#?\s*(\d{3})|(\w+))\b)",
+        QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression roomPattern(R"(\b(?:(?:room|rm\.?)\s*#?\s*)?(\d{3})\b)",
+                                                QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression landmarks = landmarkPattern();
+
+    if (!prompt.contains(intentPattern))
+        return QString();
+
+    QString text = prompt.toLower();
+
+    // work out where the visitor is starting from, if they said, and take it out of the text so it can't be
+    // mistaken for the destination
+    int origin = -1;
+    QRegularExpressionMatch originMatch = originPattern.match(text);
+    if (originMatch.hasMatch())
+    {
+        QString originKey = originMatch.captured(1);
+        if (originKey.isEmpty())
+            originKey = landmarkKey(originMatch.captured(2));
+
+        origin = findPlace(originKey);
+        if (origin >= 0)
+            text.remove(originMatch.capturedStart(), originMatch.capturedLength());
+    }
+
+    int destination = -1;
+    QRegularExpressionMatch roomMatch = roomPattern.match(text);
+    if (roomMatch.hasMatch())
+    {
+        // a room number that isn't on the map is left to the model rather than guessed at
+        destination = findPlace(roomMatch.captured(1));
+        if (destination < 0)
+            return QString();
+    }
+    else
+    {
+        const QRegularExpressionMatch landmarkMatch = landmarks.match(text);
+        if (landmarkMatch.hasMatch())
+            destination = findPlace(landmarkKey(landmarkMatch.captured(1)));
+    }
+
+    if (destination < 0 || destination == origin)
+        return QString();
+
+    return routes.value(routeKey(origin, destination));
+}
+
+QString NavigationGraph::directions(const QString &destination, const QString &origin) const
+{
+    const int to = findPlace(destination);
+    const int from = origin.isEmpty() ? -1 : findPlace(origin);
+    if (to < 0 || (!origin.isEmpty() && from < 0) || to == from)
+        return QString();
+
+    return routes.value(routeKey(from, to));
+}
+
+QStringList NavigationGraph::places() const
+{
+    QStringList names;
+    for (const Place &place : placeList)
+        names.append(capitalized(place.name));
+    return names;
+}
+
+QString NavigationGraph::overview() const
+{
+    QStringList lines;
+    for (int place = 0; place < placeList.size(); ++place)
+        lines.append(routes.value(routeKey(-1, place)));
+    return lines.join('\n');
+}
+
+void NavigationGraph::load()
+{
+    // the tables refer to nodes and places by index already, checked when they were generated
+    for (const CampusData::Node &data : CampusData::nodes)
+        nodes.append({ data.floor, data.x, data.y, {}, {} });
+    startNode = CampusData::startNode;
+
+    for (const CampusData::Edge &data : CampusData::edges)
+    {
+        nodes[data.from].neighbours.append(data.to);
+        nodes[data.to].neighbours.append(data.from);
+    }
+
+    for (const CampusData::Place &data : CampusData::places)
+    {
+        PlaceKind kind = Room;
+        switch (data.kind)
+        {
+        case 'B': kind = Bathroom; break;
+        case 'S': kind = Stairs; break;
+        case 'X': kind = Exit; break;
+        case 'E': kind = Elevator; break;
+        }
+
+        placeIndex.insert(data.key, int(placeList.size()));
+        placeList.append({ data.name, data.key, kind, {} });
+    }
+
+    for (const CampusData::Door &data : CampusData::doors)
+    {
+        Direction side = North;
+        switch (data.side)
+        {
+        case 'E': side = East; break;
+        case 'S': side = South; break;
+        case 'W': side = West; break;
+        }
+
+        const Door door{ data.place, data.node, side };
+        placeList[door.place].doors.append(door);
+        nodes[door.node].doors.append(door);
+    }
+}
+
+void NavigationGraph::computeShortestPaths()
+{
+    const qsizetype count = nodes.size();
+    distances = QList<int>(count * count, unreachable);
+    nextHop = QList<int>(count * count, -1);
+
+    for (int node = 0; node < count; ++node)
+    {
+        distances[node * count + node] = 0;
+        nextHop[node * count + node] = node;
+    }
+
+    for (const CampusData::Edge &data : CampusData::edges)
+    {
+        const int from = data.from;
+        const int to = data.to;
+        const Node &a = nodes[from];
+        const Node &b = nodes[to];
+        const int cost = a.floor != b.floor ? floorChangeCost : qAbs(a.x - b.x) + qAbs(a.y - b.y) + data.penalty;
+
+        distances[from * count + to] = distances[to * count + from] = cost;
+        nextHop[from * count + to] = to;
+        nextHop[to * count + from] = from;
+    }
+
+    // Floyd-Warshall. a floor of the building is a few dozen waypoints, so this is instant
+    for (qsizetype via = 0; via < count; ++via)
+    {
+        for (qsizetype from = 0; from < count; ++from)
+        {
+            const int toVia = distances[from * count + via];
+            if (toVia >= unreachable)
+                continue;
+
+            for (qsizetype to = 0; to < count; ++to)
+            {
+                const int candidate = toVia + distances[via * count + to];
+                if (candidate < distances[from * count + to])
+                {
+                    distances[from * count + to] = candidate;
+                    nextHop[from * count + to] = nextHop[from * count + via];
+                }
+            }
+        }
+    }
+}
+
+void NavigationGraph::renderAllRoutes()
+{
+    for (int origin = -1; origin < placeList.size(); ++origin)
+    {
+        for (int destination = 0; destination < placeList.size(); ++destination)
+        {
+            if (origin == destination)
+                continue;
+
+            const QString text = render(origin, destination);
+            if (!text.isEmpty())
+                routes.insert(routeKey(origin, destination), text);
+        }
+    }
+}
+
+QString NavigationGraph::render(int origin, int destination) const
+{
+    const qsizetype count = nodes.size();
+
+    int from = startNode;
+    Direction heading = North;
+    if (origin >= 0)
+    {
+        // stepping out of a room you face the opposite side of the hallway
+        const Door &door = placeList[origin].doors.first();
+        from = door.node;
+        heading = rotate(door.side, Back);
+    }
+
+    // use whichever door of the destination is closest
+    const Place &place = placeList[destination];
+    const Door *target = nullptr;
+    for (const Door &door : place.doors)
+    {
+        if (!target || distances[from * count + door.node] < distances[from * count + target->node])
+            target = &door;
+    }
+    if (!target || distances[from * count + target->node] >= unreachable)
+        return QString();
+
+    const QList<int> path = shortestPath(from, target->node);
+
+    QList<Run> runs;
+    for (qsizetype i = 0; i + 1 < path.size(); ++i)
+    {
+        const Direction direction = directionBetween(path[i], path[i + 1]);
+        if (runs.isEmpty() || runs.last().heading != direction)
+            runs.append({ i, i + 1, direction });
+        else
+            runs.last().end = i + 1;
+    }
+
+    QStringList sentences;
+    if (runs.isEmpty())
+    {
+        // the destination is right here
+        const Turn side = turnBetween(heading, target->side);
+        const QString where = side == Straight ? "straight ahead"
+                              : side == Back   ? "behind you"
+                                               : "on your " + turnName(side);
+        sentences.append(QString("%1 %2 %3.").arg(capitalized(place.name), verbFor(place), where));
+    }
+
+    for (qsizetype k = 0; k < runs.size(); ++k)
+    {
+        const Run &run = runs[k];
+        const bool lastRun = (k + 1 == runs.size());
+
+        if (run.heading == Up || run.heading == Down)
+        {
+            sentences.append(QString("Take the stairs %1 to floor %2.")
+                                 .arg(run.heading == Up ? "up" : "down")
+                                 .arg(nodes[path[run.end]].floor));
+            continue;
+        }
+
+        // every turn after the first is described at the end of the run before it
+        if (k == 0)
+            sentences.append(openingSentence(origin, turnBetween(heading, run.heading)));
+        else if (runs[k - 1].heading == Up || runs[k - 1].heading == Down)
+        {
+            const Turn turn = turnBetween(heading, run.heading);
+            if (turn != Straight)
+                sentences.append(QString("At the %1 of the stairs, turn %2.")
+                                     .arg(runs[k - 1].heading == Up ? "top" : "bottom")
+                                     .arg(turnName(turn)));
+        }
+        heading = run.heading;
+
+        if (lastRun)
+            sentences.append(arrivalSentence(path, run, *target, k == 0));
+        else if (runs[k + 1].heading == Up || runs[k + 1].heading == Down)
+            sentences.append(QString("Walk down the hallway to the stairs%1.")
+                                 .arg(passingPhrase(path, run, destination)));
+        else
+            sentences.append(turnSentence(path, run, runs[k + 1].heading, destination));
+    }
+
+    return capitalized(place.name) + ": " + sentences.join(' ');
+}
+
+QString NavigationGraph::openingSentence(int origin, Turn turn) const
+{
+    if (origin < 0)
+    {
+        switch (turn)
+        {
+        case Back:
+            return "Turn around from the big screen.";
+        case Straight:
+            return "Walk towards the big screen.";
+        default:
+            return QString("Facing the big screen, turn %1.").arg(turnName(turn));
+        }
+    }
+
+    const QString name = capitalized(placeList[origin].name);
+    if (turn == Straight)
+        return QString("Leave %1 and walk straight ahead.").arg(name);
+    return QString("Leave %1 and turn %2.").arg(name, turnName(turn));
+}
+
+QString NavigationGraph::turnSentence(const QList<int> &path, const Run &run, Direction nextHeading,
+                                      int destination) const
+{
+    const int junction = path[run.end];
+    const Turn turn = turnBetween(run.heading, nextHeading);
+    const QString direction = turnName(turn);
+    QString passing = passingPhrase(path, run, destination);
+    if (!passing.isEmpty())
+        passing += ",";
+
+    const bool straightOn = hasNeighbour(junction, run.heading);
+    const bool leftOpen = hasNeighbour(junction, rotate(run.heading, Left));
+    const bool rightOpen = hasNeighbour(junction, rotate(run.heading, Right));
+
+    if (!straightOn && leftOpen && rightOpen)
+        return QString("Walk to the T-junction%1 and turn %2.").arg(passing, direction);
+    if (straightOn && leftOpen && rightOpen)
+        return QString("Walk to the plus (+) junction%1 and turn %2.").arg(passing, direction);
+    if (!straightOn)
+        return QString("Follow the hallway%1 as it turns %2.").arg(passing, direction);
+
+    // a hallway branching off to the side: name it after the room just before it if there is one, otherwise count
+    // the openings on that side
+    for (qsizetype i = run.end - 1; i > run.start; --i)
+    {
+        for (const Door &door : nodes[path[i]].doors)
+        {
+            if (door.side == nextHeading)
+                return QString("Turn %1 into the hallway after %2.")
+                    .arg(direction, capitalized(placeList[door.place].name));
+        }
+        if (hasNeighbour(path[i], nextHeading))
+            break;
+    }
+
+    int opening = 0;
+    for (qsizetype i = run.start + 1; i <= run.end; ++i)
+    {
+        if (hasNeighbour(path[i], nextHeading))
+            ++opening;
+    }
+    return QString("Walk down the hallway%1 and take the %2 hallway on your %3.")
+        .arg(passing, ordinal(opening), direction);
+}
+
+QString NavigationGraph::arrivalSentence(const QList<int> &path, const Run &run, const Door &door, bool firstRun) const
+{
+    const Place &place = placeList[door.place];
+    const Turn side = turnBetween(run.heading, door.side);
+
+    QString walk;
+    if (firstRun || run.end - run.start > 1)
+        walk = QString("Walk down the hallway%1. ").arg(passingPhrase(path, run, door.place));
+
+    if (side == Straight)
+        return walk + QString("%1 %2 straight ahead at the end of the hallway.")
+                          .arg(capitalized(place.name), verbFor(place));
+    if (side == Back)
+        return walk + QString("%1 %2 behind you.").arg(capitalized(place.name), verbFor(place));
+
+    // doors are easy to count, so say which one it is when it's near the start of the hallway
+    if (place.kind == Room || place.kind == Bathroom)
+    {
+        int position = 0;
+        for (qsizetype i = run.start + 1; i <= run.end; ++i)
+        {
+            for (const Door &other : nodes[path[i]].doors)
+            {
+                if (other.side == door.side)
+                    ++position;
+            }
+        }
+
+        if (position <= 3)
+            return walk + QString("%1 is the %2 door on your %3.")
+                              .arg(capitalized(place.name), ordinal(position), turnName(side));
+    }
+
+    return walk + QString("%1 %2 on your %3.").arg(capitalized(place.name), verbFor(place), turnName(side));
+}
+
+QString NavigationGraph::passingPhrase(const QList<int> &path, const Run &run, int destination) const
+{
+    // bathrooms and stairs are what people notice on the way; rooms would make the directions too long
+    QStringList landmarks;
+    for (qsizetype i = run.start + 1; i < run.end && landmarks.size() < 2; ++i)
+    {
+        for (const Door &door : nodes[path[i]].doors)
+        {
+            const Place &place = placeList[door.place];
+            if (door.place != destination && (place.kind == Bathroom || place.kind == Stairs))
+            {
+                const Turn side = turnBetween(run.heading, door.side);
+                landmarks.append(QString("%1 on your %2").arg(place.name, turnName(side)));
+            }
+        }
+    }
+
+    if (landmarks.isEmpty())
+        return QString();
+    return ", passing " + landmarks.join(" and ");
+}
+
+QList<int> NavigationGraph::shortestPath(int from, int to) const
+{
+    const qsizetype count = nodes.size();
+
+    QList<int> path{ from };
+    while (from != to)
+    {
+        from = nextHop[from * count + to];
+        if (from < 0)
+            return {};
+        path.append(from);
+    }
+    return path;
+}
+
+NavigationGraph::Direction NavigationGraph::directionBetween(int from, int to) const
+{
+    const Node &a = nodes[from];
+    const Node &b = nodes[to];
+
+    if (a.floor != b.floor)
+        return b.floor > a.floor ? Up : Down;
+    if (qAbs(b.x - a.x) > qAbs(b.y - a.y))
+        return b.x > a.x ? East : West;
+    return b.y > a.y ? North : South;
+}
+
+bool NavigationGraph::hasNeighbour(int node, Direction direction) const
+{
+    for (int neighbour : nodes[node].neighbours)
+    {
+        if (directionBetween(node, neighbour) == direction)
+            return true;
+    }
+    return false;
+}
+
+int NavigationGraph::findPlace(const QString &key) const
+{
+    return placeIndex.value(key, -1);
+}
+
+int NavigationGraph::routeKey(int origin, int destination) const
+{
+    // origin -1 is the default position in front of the big screen
+    return (origin + 1) * int(placeList.size()) + destination;
+}
+
+NavigationGraph::Turn NavigationGraph::turnBetween(Direction from, Direction to)
+{
+    return Turn((int(to) - int(from) + 4) % 4);
+}
+
+NavigationGraph::Direction NavigationGraph::rotate(Direction heading, Turn turn)
+{
+    return Direction((int(heading) + int(turn)) % 4);
+}
+
+QString NavigationGraph::turnName(Turn turn)
+{
+    switch (turn)
+    {
+    case Left:
+        return "left";
+    case Right:
+        return "right";
+    case Back:
+        return "around";
+    default:
+        return "straight";
+    }
+}
+
+QString NavigationGraph::ordinal(int n)
+{
+    static const char *const names[] = { "first", "second", "third", "fourth", "fifth", "sixth" };
+    if (n >= 1 && n <= 6)
+        return names[n - 1];
+    return QString::number(n) + "th";
+}
+
+QString NavigationGraph::capitalized(const QString &text)
+{
+    if (text.isEmpty())
+        return text;
+    return text.at(0).toUpper() + text.mid(1);
+}
+
+QString NavigationGraph::verbFor(const Place &place)
+{
+    return place.kind == Stairs ? "are" : "is";
+}
@@ -1,230 +1,1279 @@
 #include "ollamainterface.h"
-#include <iostream>
-#include <QEventLoop>
+#include "logger.h"
+#include "modelrouter.h"
+#include <QMetaEnum>
 #include <QNetworkRequest>
 #include <QNetworkReply>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <qjsonarray.h>
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+
+constexpr int pingTimeout = 5000; // ms
+constexpr int evictionInterval = 30000; // ms
+
+// the vectors of an /api/embed response; returns an error message if there aren't the expected number of them
+QString decodeEmbeddings(const QByteArray &data, qsizetype expected, QList<QList<float>> &vectors)
+{
+    const QJsonObject response = QJsonDocument::fromJson(data).object();
+    if (response.contains("error"))
+        return response["error"].toString();
+
+    const QJsonArray embeddings = response["embeddings"].toArray();
+    if (embeddings.size() != expected)
+        return "Unexpected number of embeddings in the response.";
+
+    vectors.reserve(embeddings.size());
+    for (const QJsonValue &embedding : embeddings)
+    {
+        const QJsonArray values = embedding.toArray();
+        QList<float> &vector = vectors.emplaceBack();
+        vector.reserve(values.size());
+        for (const QJsonValue &value : values)
+            vector.append(float(value.toDouble()));
+    }
+    return QString();
+}
+
+} // namespace
 
 OllamaInterface::OllamaInterface(string url, string model, int contextSize, int timeout)
-    : connected(false), url(url), model(model), contextSize(contextSize), timeout(timeout)
+    : connected(false), model(model), timeout(timeout), idleTimeout(0), contextSize(contextSize), nextSession(0),
+      maxConcurrent(0), running(0), sessionIdleLimit(0), sessionMemoryBudget(0), prefillInterval(2000),
+      tools(nullptr), maxToolRounds(0), coalescedCount(0), nextStream(0), hedgedCount(0), healthInterval(0)
 {
+    // decoding replies happens here, away from the thread that draws the UI
+    worker.moveToThread(&requestThread);
+    requestThread.start();
+    updateRequestHeads();
+
     networkManager = new QNetworkAccessManager(this);
+    backends.setPrimary(QString::fromStdString(url));
+    probeDue.fill(-1, backends.size());
+    clock.start();
+
+    healthTimer.setSingleShot(true);
+    connect(&healthTimer, &QTimer::timeout, this, &OllamaInterface::onProbesDue);
+    connect(&evictionTimer, &QTimer::timeout, this, &OllamaInterface::evictSessions);
 }
 
 OllamaInterface::~OllamaInterface()
 {
+    // what the worker still sends back is dropped along with this object
     requestThread.quit();
     requestThread.wait();
     delete networkManager;
 }
 
-bool OllamaInterface::ping()
+void OllamaInterface::ping()
 {
-    QUrl pingUrl(QString::fromStdString(url + "/ping"));
-    QNetworkRequest request(pingUrl);
-    QNetworkReply *reply = networkManager->get(request);
+    for (int backend = 0; backend < backends.size(); ++backend)
+        probe(backend);
+}
 
-    QEventLoop loop;
-    connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-    loop.exec();
+void OllamaInterface::startHealthMonitor(int intervalSeconds)
+{
+    healthInterval = qMax(0, intervalSeconds) * 1000;
+    for (int backend = 0; backend < backends.size(); ++backend)
+        warmConnection(backend);
+    ping();
+}
 
-    bool success = (reply->error() == QNetworkReply::NoError || reply->error() == QNetworkReply::ContentNotFoundError);
-    connected = success;
-    emit pingFinished(success);
+void OllamaInterface::addBackends(const QStringList &urls)
+{
+    QStringList all{ backends.url(0) };
+    all.append(urls);
+    backends.setBackends(all);
+    probeDue.fill(-1, backends.size());
 
-    if (!success)
-        emit requestError(reply->errorString());
+    // only the primary keeps its place in the new list, so other probes in flight no longer match a backend
+    for (auto it = probes.begin(); it != probes.end(); ++it)
+    {
+        if (it.value() != 0)
+            it.value() = -1;
+    }
+}
 
-    reply->deleteLater();
-    return success;
+void OllamaInterface::setRouting(BackendPool::Routing routing)
+{
+    backends.setRouting(routing);
+}
+
+void OllamaInterface::setHedgePercentile(int percentile)
+{
+    backends.setHedgePercentile(percentile);
+}
+
+int OllamaInterface::hedgedRequests() const
+{
+    return hedgedCount;
 }
 
-void OllamaInterface::sendPrompt(const QString &systemPrompt, const QString &userPrompt)
+int OllamaInterface::openSession()
 {
-    if (!connected)
+    const int session = nextSession++;
+    sessions.insert(session, Session(contextSize));
+    sessions[session].lastActive = clock.elapsed();
+    evictSessions();
+    return session;
+}
+
+void OllamaInterface::closeSession(int session)
+{
+    cancel(session);
+    if (sessions.contains(session))
     {
-        emit requestError("Not connected to Ollama server.");
+        if (QNetworkReply *prefilling = std::exchange(sessions[session].prefillReply, nullptr))
+            prefilling->abort();
+    }
+
+    // an aborted request normally reports back within cancel(); if not, what it reports later is dropped
+    auto current = sessions.find(session);
+    if (current == sessions.end())
+        return;
+    if (current->state == Session::Running)
+        --running;
+    sessions.erase(current);
+    dispatch();
+}
+
+void OllamaInterface::setMaxConcurrentRequests(int requests)
+{
+    maxConcurrent = qMax(0, requests);
+    dispatch();
+}
+
+void OllamaInterface::setSessionLimits(int idleMinutes, qint64 memoryBudget)
+{
+    sessionIdleLimit = qint64(qMax(0, idleMinutes)) * 60 * 1000;
+    sessionMemoryBudget = qMax<qint64>(0, memoryBudget);
+
+    if (sessionIdleLimit > 0 || sessionMemoryBudget > 0)
+        evictionTimer.start(evictionInterval);
+    else
+        evictionTimer.stop();
+}
+
+OllamaInterface::Session &OllamaInterface::sessionFor(int session)
+{
+    auto found = sessions.find(session);
+    if (found == sessions.end())
+        found = sessions.insert(session, Session(contextSize));
+    found->lastActive = clock.elapsed();
+    return *found;
+}
+
+void OllamaInterface::sendPrompt(int session, const QString &systemPrompt, const QString &userPrompt,
+                                 const QString &reference, const PromptOptions &options)
+{
+    Session &current = sessionFor(session);
+    if (current.state != Session::Idle)
+    {
+        emit requestError(session, "A prompt is already being answered in this conversation.");
         return;
     }
 
-    QUrl endpoint(QString::fromStdString(url + "/api/chat"));
-    QNetworkRequest request(endpoint);
-    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    // the system prompt replaces the one at the head of the history rather than being appended again
+    current.setSystemPrompt(systemPrompt);
 
-    // build the chat message JSON objects
-    if (!systemPrompt.isEmpty())
+    // the prefill only helps if it finished with the same history in time
+    if (current.prefillPending)
     {
-        addMessageToHistory("system", systemPrompt);
+        current.prefillPending = false;
+        emit prefillUsed(current.prefilledVersion == qint64(current.historyVersion));
     }
-    addMessageToHistory("user", userPrompt);
 
-    // build the final JSON object to send in the request
-    QJsonObject json;
-    json["model"] = QString::fromStdString(model);
-    json["messages"] = messageHistory;
-    json["stream"] = true;
+    // cached answers don't need the server, so they are served even while it is unreachable
+    QByteArray cacheKey;
+    if (responseCache.isOpen())
+    {
+        QByteArray conversation;
+        conversation.reserve(current.context.encodedSize());
+        current.context.appendMessages(conversation);
+        cacheKey = ResponseCache::makeKey(options.model.isEmpty() ? QString::fromStdString(model) : options.model,
+                                          generationKey(options), conversation, userPrompt);
 
-    // send the POST request to the ollama server and wait for the reply
-    QNetworkReply *reply = networkManager->post(request, QJsonDocument(json).toJson());
-    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() { onPromptReply(reply); });
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() { reply->deleteLater(); });
+        QString cached;
+        if (responseCache.lookup(cacheKey, cached))
+        {
+            emit cacheStatsChanged();
+            addMessageToHistory(session, "user", userPrompt);
+            replayResponse(session, cached);
+            return;
+        }
+
+        // the same prompt in the same conversation is already being generated, so wait for that answer
+        auto waiting = inFlight.find(cacheKey);
+        if (waiting != inFlight.end())
+        {
+            waiting->append(session);
+            current.state = Session::Waiting;
+            ++coalescedCount;
+            emit cacheStatsChanged();
+            addMessageToHistory(session, "user", userPrompt);
+            return;
+        }
+        emit cacheStatsChanged();
+        inFlight.insert(cacheKey, {});
+    }
+
+    // looked-up material rides along with the question rather than in the system prompt, which would otherwise
+    // change on every turn and throw away the server's cached evaluation of it
+    if (reference.isEmpty())
+        addMessageToHistory(session, "user", userPrompt);
+    else
+        addMessageToHistory(session, "user", "Reference information:\n" + reference + "\n\nQuestion: " + userPrompt);
+
+    // the request itself is built when a slot is free, from the history as it is then
+    current.state = Session::Queued;
+    current.cacheKey = cacheKey;
+    current.toolRounds = 0;
+    current.options = options;
+    current.options.escalate = options.escalate && !options.model.isEmpty();
+    current.head = options.isDefault() ? QByteArray() : encodeHead(options, false);
+    queue.append(session);
+    dispatch();
+}
+
+void OllamaInterface::setTools(ToolRegistry *registry, int maxRounds)
+{
+    tools = registry;
+    maxToolRounds = qMax(0, maxRounds);
+}
+
+void OllamaInterface::callTools(int session, const QString &content, const QJsonArray &calls)
+{
+    auto current = sessions.find(session);
+    if (current == sessions.end())
+        return;
+
+    // the request slot is free while the tools run; the follow-up queues for one like any prompt. the cache key stays
+    // with the session, so the final answer is cached under the prompt that started it
+    if (current->state == Session::Running)
+        --running;
+    current->state = Session::Calling;
+    const quint64 ticket = ++current->ticket;
+    ++current->toolRounds;
+
+    // the model has to see its own calls in the history for the results to make sense to it. neither these nor the
+    // results are announced through historyAppended, so a restored conversation has only the answer
+    QJsonObject message;
+    message["role"] = "assistant";
+    message["content"] = content;
+    message["tool_calls"] = calls;
+    current->context.addMessage(message);
+    ++current->historyVersion;
+
+    QList<ToolRegistry::Call> toolCalls;
+    for (const QJsonValue &call : calls)
+    {
+        const QJsonObject function = call["function"].toObject();
+        const QJsonValue arguments = function["arguments"];
+
+        // some models send the arguments as a JSON string rather than an object
+        toolCalls.append({ function["name"].toString(),
+                           arguments.isString() ? QJsonDocument::fromJson(arguments.toString().toUtf8()).object()
+                                                : arguments.toObject() });
+    }
+
+    tools->run(toolCalls, [this, session, ticket, toolCalls](const QStringList &results)
+    {
+        // the prompt may have been stopped while the tools were running
+        auto current = sessions.find(session);
+        if (current == sessions.end() || current->state != Session::Calling || current->ticket != ticket)
+            return;
+
+        for (qsizetype i = 0; i < toolCalls.size(); ++i)
+        {
+            QJsonObject result;
+            result["role"] = "tool";
+            result["tool_name"] = toolCalls[i].name;
+            result["content"] = results.value(i);
+            current->context.addMessage(result);
+        }
+        ++current->historyVersion;
+
+        current->state = Session::Queued;
+        queue.append(session);
+        dispatch();
+    });
+    dispatch();
 }
 
+void OllamaInterface::escalatePrompt(int session)
+{
+    auto current = sessions.find(session);
+    if (current == sessions.end())
+        return;
+
+    // the prompt waits its turn again, like a follow-up after tool calls. the cache key stays with the session, so the
+    // configured model's answer is cached for the prompt and the unsure one never is
+    if (current->state == Session::Running)
+        --running;
+    current->state = Session::Queued;
+    current->options.model.clear();
+    current->options.escalate = false;
+    current->head = current->options.isDefault() ? QByteArray() : encodeHead(current->options, false);
+    queue.append(session);
+
+    emit responseEscalated(session);
+    dispatch();
+}
 
-void OllamaInterface::sendToolPrompt(const QString &toolResponse)
+void OllamaInterface::dispatch()
 {
-    if (!connected)
+    // each session has at most one prompt in the queue, so serving it in order takes the sessions in turn
+    while (!queue.isEmpty() && (maxConcurrent == 0 || running < maxConcurrent))
     {
-        emit requestError("Not connected to Ollama server.");
+        const int session = queue.takeFirst();
+        auto current = sessions.find(session);
+        if (current == sessions.end() || current->state != Session::Queued)
+            continue;
+
+        current->state = Session::Running;
+        ++running;
+        sendChat(*current, session);
+    }
+}
+
+void OllamaInterface::sendChat(Session &current, int session)
+{
+    // the history is kept as JSON text already, so putting the request together is a copy and it goes out straight
+    // away, to the server that has the prefix cached, or else the least busy one
+    const int backend = backends.isHealthy(current.prefillBackend) ? current.prefillBackend : backends.pick();
+    current.prefillBackend = -1;
+    QNetworkReply *reply = postChat(session, chatRequest(current), backend, 0, true);
+    if (!current.cacheKey.isEmpty())
+        replyKeys.insert(reply, current.cacheKey);
+}
+
+void OllamaInterface::prefill(int session, const QString &systemPrompt, const QString &draft)
+{
+    // a prefill competes with real prompts for the server, so it only runs while the session has none
+    Session &current = sessionFor(session);
+    if (current.state != Session::Idle || !connected)
+        return;
+
+    const qint64 now = clock.elapsed();
+    if (current.lastPrefill >= 0 && now - current.lastPrefill < prefillInterval)
         return;
+    current.lastPrefill = now;
+    current.setSystemPrompt(systemPrompt);
+
+    // the draft is evaluated too; the server reuses as much of it as the prompt turns out to start with
+    QByteArray draftMessage;
+    if (!draft.trimmed().isEmpty())
+    {
+        QJsonObject message;
+        message["role"] = "user";
+        message["content"] = draft;
+        draftMessage = ContextManager::encode(message);
     }
 
-    QUrl endpoint(QString::fromStdString(url + "/api/chat"));
+    QByteArray body;
+    body.reserve(prefillHead.size() + current.context.encodedSize() + draftMessage.size() + 2);
+    body += prefillHead;
+    current.context.appendMessages(body, draftMessage);
+    body += '}';
+
+    sendPrefill(session, current.historyVersion, body);
+}
+
+void OllamaInterface::sendPrefill(int session, quint64 version, const QByteArray &body)
+{
+    auto current = sessions.find(session);
+    if (current == sessions.end())
+        return;
+
+    // the text changed since the last prefill, so that one is no use any more
+    if (QNetworkReply *stale = std::exchange(current->prefillReply, nullptr))
+        stale->abort();
+
+    const int backend = backends.pick();
+    QNetworkRequest request(QUrl(backends.url(backend) + "/api/chat"));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+
+    QNetworkReply *reply = networkManager->post(request, body);
+    backends.requestStarted(backend);
+    current->prefillReply = reply;
+    current->prefillBackend = backend;
+    current->prefillPending = true;
+    LOG_DEBUG("prefill.sent", "session", session, "backend", backends.url(backend), "bytes", body.size());
+    emit prefillSent();
+
+    connect(reply, &QNetworkReply::finished, this, [this, reply, session, backend, version]()
+    {
+        reply->deleteLater();
+        backends.requestFinished(backend);
+
+        // replaced by a newer one, or the session is gone
+        auto current = sessions.find(session);
+        if (current == sessions.end() || current->prefillReply != reply)
+            return;
+
+        current->prefillReply = nullptr;
+        if (reply->error() == QNetworkReply::NoError)
+            current->prefilledVersion = qint64(version);
+    });
+}
+
+void OllamaInterface::setPrefillInterval(int msec)
+{
+    prefillInterval = qMax(0, msec);
+}
+
+void OllamaInterface::endRequest(int session)
+{
+    auto current = sessions.find(session);
+    if (current == sessions.end())
+        return;
+
+    if (current->state == Session::Running)
+        --running;
+    current->state = Session::Idle;
+    current->cacheKey.clear();
+    current->options = PromptOptions();
+    current->head.clear();
+    current->lastActive = clock.elapsed();
+
+    dispatch();
+}
+
+void OllamaInterface::stopUnsent(int session, StopReason reason)
+{
+    auto current = sessions.find(session);
+    if (current == sessions.end())
+        return;
+
+    // a queued prompt that owned its cache key leaves nothing behind for the sessions waiting on it
+    const bool ownsKey = current->state == Session::Queued || current->state == Session::Calling;
+    const QByteArray cacheKey = ownsKey ? current->cacheKey : QByteArray();
+    queue.removeAll(session);
+    for (QList<int> &waiting : inFlight)
+        waiting.removeAll(session);
+    endRequest(session);
+
+    addMessageToHistory(session, "assistant", truncationMarker(reason).trimmed());
+    emit responseStopped(session, reason);
+
+    if (!cacheKey.isEmpty())
+        releaseWaiters(cacheKey, QString(), "The request for an identical prompt was stopped.");
+}
+
+void OllamaInterface::evictSessions()
+{
+    if (sessionIdleLimit == 0 && sessionMemoryBudget == 0)
+        return;
+
+    const qint64 now = clock.elapsed();
+    qint64 total = 0;
+    QList<int> idle;
+    for (auto session = sessions.cbegin(); session != sessions.cend(); ++session)
+    {
+        total += session->context.memoryUsage();
+        if (session->state == Session::Idle)
+            idle.append(session.key());
+    }
+
+    // the longest idle go first; a session that is busy is never evicted
+    std::sort(idle.begin(), idle.end(),
+              [this](int a, int b) { return sessions[a].lastActive < sessions[b].lastActive; });
+
+    for (int session : std::as_const(idle))
+    {
+        const Session &candidate = sessions[session];
+        const bool expired = sessionIdleLimit > 0 && now - candidate.lastActive > sessionIdleLimit;
+        const bool overBudget = sessionMemoryBudget > 0 && total > sessionMemoryBudget;
+        if (!expired && !overBudget)
+            continue;
+
+        total -= candidate.context.memoryUsage();
+        if (QNetworkReply *prefilling = std::exchange(sessions[session].prefillReply, nullptr))
+            prefilling->abort();
+        sessions.remove(session);
+        emit sessionEvicted(session);
+    }
+}
+
+void OllamaInterface::requestEmbeddings(const QString &embedModel, const QStringList &input,
+                                        std::function<void(const QList<QList<float>> &, const QString &)> onFinished)
+{
+    QUrl endpoint(backends.url(backends.pick()) + "/api/embed");
     QNetworkRequest request(endpoint);
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
 
-    // Add tool response as a user message
-    addMessageToHistory("tool", toolResponse);
+    QJsonObject json;
+    json["model"] = embedModel;
+    json["input"] = QJsonArray::fromStringList(input);
+    json["keep_alive"] = keepAliveValue();
+
+    QNetworkReply *reply = networkManager->post(request, QJsonDocument(json).toJson());
+    connect(reply, &QNetworkReply::finished, this, [this, reply, onFinished, expected = input.size()]()
+    {
+        reply->deleteLater();
+        if (reply->error() != QNetworkReply::NoError)
+        {
+            onFinished({}, reply->errorString());
+            return;
+        }
+
+        // a batch of embeddings is a lot of numbers to parse, so that happens on the worker as well
+        QMetaObject::invokeMethod(&worker, [this, data = reply->readAll(), onFinished, expected]()
+        {
+            QList<QList<float>> vectors;
+            const QString error = decodeEmbeddings(data, expected, vectors);
+            QMetaObject::invokeMethod(this, [onFinished, vectors, error]() { onFinished(vectors, error); },
+                                      Qt::QueuedConnection);
+        });
+    });
+}
+
+void OllamaInterface::requestWebSearch(const QString &endpoint, const QString &query, const QString &apiKey,
+                                       std::function<void(const QString &, const QString &)> onFinished)
+{
+    QNetworkRequest request((QUrl(endpoint)));
+    request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+    if (!apiKey.isEmpty())
+        request.setRawHeader("Authorization", "Bearer " + apiKey.toUtf8());
+
+    QJsonObject json;
+    json["query"] = query;
+
+    // the results are only complete once the whole reply is in, however many reads it arrives in
+    QNetworkReply *reply = networkManager->post(request, QJsonDocument(json).toJson(QJsonDocument::Compact));
+    connect(reply, &QNetworkReply::finished, this, [reply, onFinished]()
+    {
+        reply->deleteLater();
+        if (reply->error() != QNetworkReply::NoError)
+        {
+            onFinished(QString(), reply->errorString());
+            return;
+        }
+
+        // the model gets the title, address and text of each result rather than the JSON around them
+        const QJsonArray results = QJsonDocument::fromJson(reply->readAll()).object()["results"].toArray();
+        QString text;
+        for (const QJsonValue &result : results)
+        {
+            text += result["title"].toString() + " (" + result["url"].toString() + ")\n"
+                    + result["content"].toString() + "\n\n";
+        }
+        onFinished(text.isEmpty() ? "No results." : text.trimmed(), QString());
+    });
+}
 
+void OllamaInterface::preloadModel()
+{
     QJsonObject json;
     json["model"] = QString::fromStdString(model);
-    json["messages"] = messageHistory;
+    json["keep_alive"] = keepAliveValue();
+
+    if (warmupPrompt.isEmpty())
+    {
+        // a chat request without messages only loads the model
+        json["messages"] = QJsonArray();
+        postControlRequest(json, "Preloading model");
+        return;
+    }
+
+    // evaluating the system prompt on its own leaves it in the server's prompt cache, so the first real request only
+    // has to process the user's message. one token is the least the server will generate
+    QJsonObject systemMessage;
+    systemMessage["role"] = "system";
+    systemMessage["content"] = warmupPrompt;
+
+    QJsonObject options = requestOptions();
+    options["num_predict"] = 1;
+
+    json["messages"] = QJsonArray{ systemMessage };
     json["stream"] = false;
+    json["options"] = options;
+    postControlRequest(json, "Warming up model");
+}
 
-    // send the POST request to the ollama server and wait for the reply
-    QNetworkReply *reply = networkManager->post(request, QJsonDocument(json).toJson());
-    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() { onPromptReply(reply); });
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() { reply->deleteLater(); });
+void OllamaInterface::unloadModel()
+{
+    QJsonObject json;
+    json["model"] = QString::fromStdString(model);
+    json["messages"] = QJsonArray();
+    json["keep_alive"] = 0;
+    postControlRequest(json, "Unloading model");
+}
+
+bool OllamaInterface::openResponseCache(const QString &path, qint64 maxBytes, int maxAgeHours)
+{
+    return responseCache.open(path, maxBytes, maxAgeHours);
+}
+
+int OllamaInterface::cacheHits() const
+{
+    return responseCache.hits();
+}
+
+int OllamaInterface::cacheMisses() const
+{
+    return responseCache.misses();
+}
+
+int OllamaInterface::coalescedRequests() const
+{
+    return coalescedCount;
+}
+
+void OllamaInterface::replayResponse(int session, const QString &response)
+{
+    // queued, so a cached answer arrives after sendPrompt() has returned just like a streamed one
+    QMetaObject::invokeMethod(this, [this, session, response]()
+    {
+        emit responseReceived(session, response);
+        addMessageToHistory(session, "assistant", response);
+        emit responseFinished(session);
+    }, Qt::QueuedConnection);
 }
 
-void OllamaInterface::requestWebSearch(const QString &query, const QString &apiKey)
+void OllamaInterface::releaseWaiters(const QByteArray &key, const QString &response, const QString &error)
 {
-    if (!connected)
+    const QList<int> waiting = inFlight.take(key);
+    for (int session : waiting)
     {
-        emit requestError("Not connected to Ollama server.");
+        endRequest(session);
+        if (!error.isEmpty())
+        {
+            emit requestError(session, error);
+            continue;
+        }
+
+        addMessageToHistory(session, "assistant", response);
+        emit responseReceived(session, response);
+        emit responseFinished(session);
+    }
+}
+
+void OllamaInterface::recordExchange(int session, const QString &userPrompt, const QString &response)
+{
+    addMessageToHistory(session, "user", userPrompt);
+    addMessageToHistory(session, "assistant", response);
+}
+
+bool OllamaInterface::hasHistory(int session) const
+{
+    auto current = sessions.find(session);
+    return current != sessions.end() && current->context.messageCount() > 0;
+}
+
+void OllamaInterface::clearHistory(int session)
+{
+    Session &current = sessionFor(session);
+    current.context.clear();
+    ++current.historyVersion;
+}
+
+void OllamaInterface::restoreMessage(int session, const QString &role, const QString &content)
+{
+    Session &current = sessionFor(session);
+    current.context.addMessage(role, content);
+    ++current.historyVersion;
+}
+
+void OllamaInterface::postControlRequest(const QJsonObject &json, const char *description)
+{
+    // every server needs the model loaded (or unloaded), not just the one the next prompt happens to go to
+    const QByteArray body = QJsonDocument(json).toJson();
+    for (int backend = 0; backend < backends.size(); ++backend)
+    {
+        QUrl endpoint(backends.url(backend) + "/api/chat");
+        QNetworkRequest request(endpoint);
+        request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
+
+        QNetworkReply *reply = networkManager->post(request, body);
+        connect(reply, &QNetworkReply::finished, this, [reply, description]()
+        {
+            // nobody is waiting on these, so a failure is only worth a log line
+            if (reply->error() != QNetworkReply::NoError)
+                LOG_WARNING("control.failed", "request", description, "url", reply->url().toString(), "error",
+                            reply->errorString());
+            reply->deleteLater();
+        });
+    }
+}
+
+void OllamaInterface::onPingReply(QNetworkReply *reply)
+{
+    reply->deleteLater();
+
+    // a probe of a URL that has since been replaced says nothing about the current one
+    const int backend = probes.take(reply);
+    if (backend < 0 || backend >= backends.size())
         return;
+
+    const bool success = (reply->error() == QNetworkReply::NoError);
+    LOG_DEBUG("backend.probed", "url", backends.url(backend), "ok", success);
+    if (success)
+        backends.recordSuccess(backend);
+    else
+        backends.markUnreachable(backend);
+
+    setConnected(backends.anyHealthy());
+    if (backend == 0)
+        emit pingFinished(success);
+
+    if (healthInterval > 0)
+        probeDue[backend] = clock.elapsed() + backends.nextProbeDelay(backend, success, healthInterval);
+    scheduleProbes();
+}
+
+void OllamaInterface::probe(int backend)
+{
+    // one probe per server at a time; the one in flight will report back
+    for (int probing : std::as_const(probes))
+    {
+        if (probing == backend)
+            return;
+    }
+    probeDue[backend] = -1;
+
+    QUrl pingUrl(backends.url(backend) + "/api/version");
+    QNetworkRequest request(pingUrl);
+
+    // an unreachable host would otherwise only give up after the TCP timeout
+    request.setTransferTimeout(pingTimeout);
+
+    QNetworkReply *reply = networkManager->get(request);
+    probes.insert(reply, backend);
+    connect(reply, &QNetworkReply::finished, this, [this, reply]() { onPingReply(reply); });
+}
+
+void OllamaInterface::scheduleProbes()
+{
+    qint64 next = -1;
+    for (qint64 due : std::as_const(probeDue))
+    {
+        if (due >= 0 && (next < 0 || due < next))
+            next = due;
     }
 
-    QUrl endpoint("https://ollama.com/api/web_search");
+    if (next < 0)
+        healthTimer.stop();
+    else
+        healthTimer.start(int(qMax<qint64>(0, next - clock.elapsed())));
+}
+
+void OllamaInterface::onProbesDue()
+{
+    const qint64 now = clock.elapsed();
+    for (int backend = 0; backend < backends.size(); ++backend)
+    {
+        if (probeDue[backend] >= 0 && probeDue[backend] <= now)
+            probe(backend);
+    }
+    scheduleProbes();
+}
+
+void OllamaInterface::setConnected(bool isConnected)
+{
+    if (connected == isConnected)
+        return;
+
+    connected = isConnected;
+    emit connectedChanged(connected);
+}
+
+void OllamaInterface::warmConnection(int backend)
+{
+    // the handshake is then already done when the first prompt goes out, and the regular probes keep the connection
+    // from going idle. the servers are normally on the local network and plain HTTP
+    const QUrl server(backends.url(backend));
+    if (server.scheme() == "http")
+        networkManager->connectToHost(server.host(), quint16(server.port(80)));
+}
+
+QNetworkReply *OllamaInterface::postChat(int session, const QByteArray &body, int backend, int failovers,
+                                         bool allowHedge)
+{
+    QUrl endpoint(backends.url(backend) + "/api/chat");
     QNetworkRequest request(endpoint);
     request.setHeader(QNetworkRequest::ContentTypeHeader, "application/json");
 
-    // build api key header
-    QString bearerKey = "Bearer " + apiKey;
-    request.setRawHeader("Authorization", bearerKey.toUtf8());
+    QNetworkReply *reply = networkManager->post(request, body);
+    backends.requestStarted(backend);
 
-    // build the final JSON object to send in the request
-    QJsonObject json;
-    json["query"] = query;
+    // the idle timer only starts once the answer does; until then the model may still be loading
+    QTimer *idleTimer = new QTimer(reply);
+    idleTimer->setSingleShot(true);
+    connect(idleTimer, &QTimer::timeout, this, [this, reply]() { stopReply(reply, TimedOut); });
 
-    // send the POST request to the ollama server and wait for the reply
-    QNetworkReply *reply = networkManager->post(request, QJsonDocument(json).toJson());
-    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() { receiveWebSearch(reply); });
-    connect(reply, &QNetworkReply::finished, this, [this, reply]() { reply->deleteLater(); });
+    const quint64 stream = ++nextStream;
+    ChatAttempt attempt{ session, backend, body, QElapsedTimer(), false, failovers, nullptr, -1, -1, -1, -1, QString(),
+                         NotStopped, idleTimer, stream, false, QJsonArray() };
+    attempt.sent.start();
+    chatAttempts.insert(reply, attempt);
+    streams.insert(stream, reply);
+    watchPromptReply(reply);
+    LOG_INFO("request.sent", "session", session, "stream", stream, "backend", backends.url(backend), "bytes",
+             body.size(), "failovers", failovers);
+
+    if (timeout > 0)
+        QTimer::singleShot(timeout * 1000, reply, [this, reply]() { stopReply(reply, TimedOut); });
+
+    // the timer belongs to the reply, so it goes away with it
+    const qint64 hedgeAfter = allowHedge ? backends.hedgeDelay(backend) : 0;
+    if (hedgeAfter > 0)
+        QTimer::singleShot(int(hedgeAfter), reply, [this, reply]() { hedge(reply); });
+
+    return reply;
 }
 
-void OllamaInterface::onPingReply(QNetworkReply *reply)
+void OllamaInterface::hedge(QNetworkReply *reply)
 {
-    connected = (reply->error() == QNetworkReply::NoError);
+    auto attempt = chatAttempts.find(reply);
+    if (attempt == chatAttempts.end() || attempt->receivedData || attempt->rival)
+        return;
+
+    const int other = backends.pick(attempt->backend);
+    if (other < 0 || !backends.isHealthy(other))
+        return;
+
+    // whichever server starts answering first carries on; the other request is dropped
+    const QByteArray body = attempt->body;
+    QNetworkReply *rival = postChat(attempt->session, body, other, attempt->failovers, false);
+    chatAttempts[reply].rival = rival;
+    chatAttempts[rival].rival = reply;
+    ++hedgedCount;
+    LOG_INFO("request.hedged", "session", attempt->session, "backend", backends.url(other));
+}
+
+void OllamaInterface::discardReply(QNetworkReply *reply)
+{
+    auto attempt = chatAttempts.find(reply);
+    if (attempt == chatAttempts.end())
+        return;
+
+    backends.requestFinished(attempt->backend);
+    const quint64 stream = attempt->stream;
+    chatAttempts.erase(attempt);
+    streams.remove(stream);
+    replyKeys.remove(reply);
+
+    // its finished handler won't send a last chunk, so the worker is told to let go of the rest
+    QMetaObject::invokeMethod(&worker, [this, stream]() { decoders.remove(stream); });
+
+    // with its bookkeeping gone, the finished handler only deletes it
+    reply->abort();
+}
+
+void OllamaInterface::cancel(int session)
+{
+    auto current = sessions.find(session);
+    if (current == sessions.end())
+        return;
 
-    if (connected)
+    if (current->state == Session::Queued || current->state == Session::Waiting
+        || current->state == Session::Calling)
     {
-        std::cout << "Ping successful." << std::endl;
+        stopUnsent(session, Cancelled);
+        return;
     }
-    else
+
+    // stopping one half of a hedged request discards the other, which then no longer shows up here
+    const QList<QNetworkReply *> replies = chatAttempts.keys();
+    for (QNetworkReply *reply : replies)
     {
-        std::cerr << "Ping failed: " << reply->errorString().toStdString() << std::endl;
-        emit requestError(reply->errorString());
+        auto attempt = chatAttempts.constFind(reply);
+        if (attempt != chatAttempts.constEnd() && attempt->session == session)
+            stopReply(reply, Cancelled);
     }
+}
 
-    emit pingFinished(connected);
-    reply->deleteLater();
+void OllamaInterface::stopReply(QNetworkReply *reply, StopReason reason)
+{
+    auto attempt = chatAttempts.find(reply);
+    if (attempt == chatAttempts.end())
+        return;
+
+    // only one half of a hedged request gets to report
+    if (QNetworkReply *rival = attempt->rival)
+    {
+        attempt->rival = nullptr;
+        discardReply(rival);
+    }
+
+    attempt->stopped = reason;
+    LOG_INFO("request.stopped", "session", attempt->session, "stream", attempt->stream, "reason",
+             QMetaEnum::fromType<StopReason>().valueToKey(reason), "ended", attempt->ended);
+    if (attempt->ended)
+    {
+        reply->abort();
+        return;
+    }
+
+    // wrapped up right away with what has been decoded so far; whatever is still with the worker is dropped
+    attempt->ended = true;
+    attempt->idleTimer->stop();
+    const int session = attempt->session;
+    const QString partial = attempt->response;
+
+    // aborting frees the server for the next request straight away; the finished handler does the rest
+    reply->abort();
+    endTruncated(reply, session, partial, reason);
+}
+
+void OllamaInterface::endTruncated(QNetworkReply *reply, int session, const QString &partial, StopReason reason)
+{
+    endRequest(session);
+
+    // the model sees on the next turn that its answer was cut off rather than complete
+    addMessageToHistory(session, "assistant", partial + truncationMarker(reason));
+    emit responseStopped(session, reason);
+
+    // a cut-short answer is neither cached nor passed on to identical prompts waiting on it
+    const QByteArray cacheKey = replyKeys.take(reply);
+    if (!cacheKey.isEmpty())
+        releaseWaiters(cacheKey, QString(), "The request for an identical prompt was stopped.");
+}
+
+QString OllamaInterface::truncationMarker(StopReason reason)
+{
+    switch (reason)
+    {
+    case Cancelled:
+        return " [stopped by the user]";
+    case TimedOut:
+        return " [timed out]";
+    case Interrupted:
+        return " [connection lost]";
+    default:
+        return QString();
+    }
+}
+
+void OllamaInterface::moveCacheKey(QNetworkReply *from, QNetworkReply *to)
+{
+    auto key = replyKeys.find(from);
+    if (key == replyKeys.end())
+        return;
+
+    replyKeys.insert(to, key.value());
+    replyKeys.erase(key);
+}
+
+bool OllamaInterface::isConnectionError(QNetworkReply::NetworkError error)
+{
+    switch (error)
+    {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::UnknownNetworkError:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void OllamaInterface::watchPromptReply(QNetworkReply *reply)
+{
+    connect(reply, &QNetworkReply::readyRead, this, [this, reply]() { onPromptReply(reply); });
+    connect(reply, &QNetworkReply::finished, this, [this, reply]()
+    {
+        // the loser of a hedge has already been written off
+        auto attempt = chatAttempts.constFind(reply);
+        if (attempt == chatAttempts.constEnd())
+        {
+            reply->deleteLater();
+            return;
+        }
+
+        // a last line without a trailing newline can only be decoded now. the reply is wrapped up once the worker
+        // is through with everything before it
+        const QByteArray tail = reply->error() == QNetworkReply::NoError ? reply->readAll() : QByteArray();
+        decode(attempt->stream, tail, true);
+    });
 }
 
 void OllamaInterface::onPromptReply(QNetworkReply *reply)
 {
-    if (reply->error() == QNetworkReply::NoError)
+    auto attempt = chatAttempts.find(reply);
+    if (attempt == chatAttempts.end() || attempt->ended)
+        return;
+
+    // the bytes are only copied off the socket here; decoding them is the worker's job
+    const QByteArray data = reply->readAll();
+    if (data.isEmpty())
+        return;
+
+    // the first bytes decide a hedge race and give the server's time to first token
+    if (!attempt->receivedData)
     {
-        QByteArray responseData = reply->readAll();
-        QString text;
-        static QString totalMessage;
+        attempt->receivedData = true;
+        attempt->firstByte = attempt->sent.nsecsElapsed();
+        backends.recordFirstToken(attempt->backend, attempt->firstByte / 1000000);
+
+        if (QNetworkReply *rival = attempt->rival)
+        {
+            attempt->rival = nullptr;
+            moveCacheKey(rival, reply);
+            discardReply(rival);
+        }
+    }
 
-        // The response can contain multiple JSON objects separated by newlines
-        QList<QByteArray> jsonLines = responseData.split('\n');
+    // every piece of the answer restarts the clock on the next one
+    if (idleTimeout > 0)
+        attempt->idleTimer->start(idleTimeout * 1000);
+
+    decode(attempt->stream, data, false);
+}
+
+void OllamaInterface::decode(quint64 stream, const QByteArray &data, bool last)
+{
+    // the worker handles one chunk at a time, so chunks are decoded (and come back) in the order they arrived
+    QMetaObject::invokeMethod(&worker, [this, stream, data, last]()
+    {
+        // only the newly arrived bytes get scanned, and a line split across reads waits in the parser for the rest
+        StreamDecoder &decoder = decoders[stream];
+        StreamParser &parser = decoder.parser;
+        parser.append(data);
 
-        for (const QByteArray &line : jsonLines)
+        // once the reply has finished, a last line without a trailing newline is decoded as well
+        DecodedChunk chunk;
+        while (parser.next(streamEvent) || (last && parser.flush(streamEvent)))
         {
-            if (line.trimmed().isEmpty())
+            if (!streamEvent.valid)
+            {
+                LOG_WARNING("stream.malformed", "stream", stream);
                 continue;
+            }
+
+            // Only use assistant message content. A model asked to think sends its reasoning apart from the answer;
+            // one that wasn't may still wrap it in think tags in the answer, each tag a token of its own
+            if (streamEvent.isAssistant)
+            {
+                chunk.thinking += streamEvent.thinking;
+                if (streamEvent.content == "<think>")
+                    decoder.inThinkTag = true;
+                else if (streamEvent.content == "</think>")
+                    decoder.inThinkTag = false;
+                else if (decoder.inThinkTag)
+                    chunk.thinking += streamEvent.content;
+                else
+                    chunk.content += streamEvent.content;
+            }
 
-            QJsonParseError parseError;
-            QJsonDocument jsonResponse = QJsonDocument::fromJson(line, &parseError);
+            // usually all in one line, but nothing says they can't be spread out
+            if (!streamEvent.toolCalls.isEmpty())
+            {
+                const QJsonArray calls = QJsonDocument::fromJson(streamEvent.toolCalls).array();
+                for (const QJsonValue &call : calls)
+                    chunk.toolCalls.append(call);
+            }
 
-            if (parseError.error != QJsonParseError::NoError || !jsonResponse.isObject())
+            // the server gives up on the request after an error line, and nothing follows the done line
+            if (!streamEvent.error.isEmpty() || streamEvent.done)
             {
-                // If not valid JSON, emit raw data for debugging
-                // NOTE: THIS IS TEMPORARY, this should be handled properly
-                text = QString::fromUtf8(line);
-                emit responseReceived(text);
-                continue;
+                chunk.end = streamEvent;
+                break;
             }
+        }
+
+        if (last || chunk.end.done || !chunk.end.error.isEmpty())
+            decoders.remove(stream);
+
+        // everything the chunk held crosses over in one go, rather than as one signal per token
+        QMetaObject::invokeMethod(this, [this, stream, chunk, last]() { onDecoded(stream, chunk, last); },
+                                  Qt::QueuedConnection);
+    });
+}
+
+void OllamaInterface::onDecoded(quint64 stream, const DecodedChunk &chunk, bool last)
+{
+    QNetworkReply *reply = streams.value(stream);
+    auto attempt = reply ? chatAttempts.find(reply) : chatAttempts.end();
+    if (attempt != chatAttempts.end() && !attempt->ended)
+    {
+        const int session = attempt->session;
+        LOG_DEBUG("stream.chunk", "session", session, "stream", stream, "chars", chunk.content.size(), "thinking",
+                  chunk.thinking.size(), "last", last);
+
+        if (!chunk.thinking.isEmpty())
+        {
+            if (attempt->firstThought < 0)
+                attempt->firstThought = attempt->sent.nsecsElapsed();
+            emit thinkingReceived(session, chunk.thinking);
+
+            // whoever got the text may have stopped the request
+            attempt = chatAttempts.find(reply);
+        }
+
+        if (attempt != chatAttempts.end() && !attempt->ended && !chunk.content.isEmpty())
+        {
+            attempt->lastToken = attempt->sent.nsecsElapsed();
+            if (attempt->firstToken < 0)
+                attempt->firstToken = attempt->lastToken;
+            attempt->response += chunk.content;
+            emit responseReceived(session, chunk.content);
+
+            // whoever got the text may have stopped the request
+            attempt = chatAttempts.find(reply);
+        }
+
+        if (attempt != chatAttempts.end())
+        {
+            for (const QJsonValue &call : chunk.toolCalls)
+                attempt->toolCalls.append(call);
+        }
+
+        if (attempt != chatAttempts.end() && !chunk.end.error.isEmpty())
+        {
+            attempt->idleTimer->stop();
+            attempt->ended = true;
+            LOG_WARNING("request.failed", "session", session, "stream", stream, "error", chunk.end.error);
+            endRequest(session);
+            emit requestError(session, chunk.end.error);
+        }
+        else if (attempt != chatAttempts.end() && chunk.end.done)
+        {
+            const QString response = attempt->response;
+            attempt->idleTimer->stop();
+            attempt->ended = true;
 
-            QJsonObject obj = jsonResponse.object();
+            // the server's own account of where the time went comes with the done line
+            RequestTimings timings;
+            timings.firstByte = attempt->firstByte;
+            timings.firstThought = attempt->firstThought;
+            timings.firstToken = attempt->firstToken;
+            timings.lastToken = attempt->lastToken;
+            timings.finished = attempt->sent.nsecsElapsed();
+            timings.loadDuration = chunk.end.loadDuration;
+            timings.promptEvalDuration = chunk.end.promptEvalDuration;
+            timings.promptEvalCount = chunk.end.promptEvalCount;
+            timings.evalDuration = chunk.end.evalDuration;
+            timings.evalCount = chunk.end.evalCount;
+            emit requestMeasured(timings);
+            LOG_INFO("request.finished", "session", session, "stream", stream, "first_token_ms",
+                     timings.firstToken < 0 ? -1 : timings.firstToken / 1000000, "ms", timings.finished / 1000000,
+                     "tokens", timings.evalCount, "chars", response.size(), "tool_calls", attempt->toolCalls.size());
 
-            if (obj.contains("message"))
+            // the answer comes from a follow-up request once the tools have run
+            if (!attempt->toolCalls.isEmpty() && tools)
             {
-                QJsonObject messageObj = obj["message"].toObject();
-                QString role = messageObj["role"].toString();
-                QString content = messageObj["content"].toString();
-
-                // Only use assistant message content
-                if (role == "assistant")
-                {
-                    text = content;
-                    totalMessage += text;
-                    emit responseReceived(text);
-                }
+                const QJsonArray calls = attempt->toolCalls;
+                replyKeys.remove(reply);
+                callTools(session, response, calls);
+                if (last)
+                    finishReply(reply);
+                return;
             }
-            else
+
+            // an unsure answer from the prompt's own model is not the last word
+            auto current = sessions.find(session);
+            if (current != sessions.end() && current->options.escalate && ModelRouter::looksUnsure(response))
             {
-                // If something unexpected, emit full JSON line
-                // NOTE: THIS IS TEMPORARY, this should be handled properly
-                text = QString::fromUtf8(line);
-                emit responseReceived(text);
+                replyKeys.remove(reply);
+                escalatePrompt(session);
+                if (last)
+                    finishReply(reply);
+                return;
             }
 
-            if (obj.contains("done") && obj["done"].toBool())
+            endRequest(session);
+            addMessageToHistory(session, "assistant", response);
+            emit responseFinished(session);
+
+            const QByteArray cacheKey = replyKeys.take(reply);
+            if (!cacheKey.isEmpty())
             {
-                reply->deleteLater();
-                addMessageToHistory("assistant", totalMessage);
-                emit responseFinished();
-                totalMessage.clear();
-                return; // Stop processing once done is true
+                if (!response.isEmpty())
+                    responseCache.insert(cacheKey, response);
+                releaseWaiters(cacheKey, response, QString());
             }
         }
     }
-    else
-    {
-        emit requestError(reply->errorString());
-        reply->deleteLater();
-    }
+
+    if (last && reply)
+        finishReply(reply);
 }
 
-void OllamaInterface::receiveWebSearch(QNetworkReply *reply)
+void OllamaInterface::finishReply(QNetworkReply *reply)
 {
-    if (reply->error() != QNetworkReply::NoError)
+    reply->deleteLater();
+
+    auto attempt = chatAttempts.find(reply);
+    if (attempt == chatAttempts.end())
+        return;
+
+    const QNetworkReply::NetworkError error = reply->error();
+    const ChatAttempt finished = *attempt;
+    chatAttempts.erase(attempt);
+    streams.remove(finished.stream);
+    backends.requestFinished(finished.backend);
+
+    // a request getting through is as good as a probe, and one that can't reach its server gets that server
+    // probed again straight away. the user stopping a request says nothing about the server
+    if (error == QNetworkReply::NoError)
     {
-        emit requestError(reply->errorString());
-        reply->deleteLater();
+        backends.recordSuccess(finished.backend);
     }
+    else if (finished.stopped == NotStopped && isConnectionError(error))
+    {
+        backends.markUnreachable(finished.backend);
+        probe(finished.backend);
+    }
+    else if (finished.stopped != Cancelled)
+    {
+        backends.recordError(finished.backend);
+    }
+    setConnected(backends.anyHealthy());
+
+    // a stopped request has already been wrapped up
+    if (finished.stopped != NotStopped)
+        return;
+
+    // as long as nothing has reached the user, a failed request can quietly move to another server
+    if (error != QNetworkReply::NoError && !finished.receivedData)
+    {
+        if (finished.rival)
+        {
+            chatAttempts[finished.rival].rival = nullptr;
+            moveCacheKey(reply, finished.rival);
+            return;
+        }
+
+        const int other = backends.pick(finished.backend);
+        if (isConnectionError(error) && other >= 0 && finished.failovers + 1 < backends.size())
+        {
+            LOG_WARNING("request.retried", "session", finished.session, "backend", backends.url(other), "error",
+                        reply->errorString());
+            QNetworkReply *retry = postChat(finished.session, finished.body, other, finished.failovers + 1, false);
+            moveCacheKey(reply, retry);
+            return;
+        }
+    }
+
+    // a reply that never got to its done (or error) line ended early
+    if (!finished.ended)
+    {
+        if (finished.receivedData)
+        {
+            endTruncated(reply, finished.session, finished.response, Interrupted);
+            return;
+        }
 
-    QByteArray responseData = reply->readAll();
-    // do we need to parse this and make it pretty for the model? were gonna say no for now
-    QString text = QString::fromUtf8(responseData);
+        endRequest(finished.session);
+        emit requestError(finished.session, error != QNetworkReply::NoError
+                                                ? reply->errorString()
+                                                : "The server closed the connection without answering.");
+    }
 
-    sendToolPrompt(text);
+    // still set if the reply never got to its done line
+    const QByteArray cacheKey = replyKeys.take(reply);
+    if (!cacheKey.isEmpty())
+        releaseWaiters(cacheKey, QString(), "The request for an identical prompt failed.");
 }
 
 bool OllamaInterface::isConnected() const
@@ -234,17 +1283,37 @@ bool OllamaInterface::isConnected() const
 
 void OllamaInterface::setURL(string newUrl)
 {
-    url = std::move(newUrl);
+    const QString primary = QString::fromStdString(newUrl);
+    if (primary == backends.url(0))
+        return;
+
+    backends.setPrimary(primary);
+
+    // forget the probe of the old URL and check the new one straight away
+    for (auto it = probes.begin(); it != probes.end(); ++it)
+    {
+        if (it.value() == 0)
+            it.value() = -1;
+    }
+    warmConnection(0);
+    probe(0);
 }
 
 string OllamaInterface::getURL() const
 {
-    return url;
+    return backends.url(0).toStdString();
 }
 
 void OllamaInterface::setModel(string newModel)
 {
+    if (newModel == model)
+        return;
+
     model = std::move(newModel);
+    updateRequestHeads();
+
+    // load the new model now rather than on the first prompt
+    preloadModel();
 }
 
 string OllamaInterface::getModel() const
@@ -255,6 +1324,9 @@ string OllamaInterface::getModel() const
 void OllamaInterface::setContextSize(int tokens)
 {
     contextSize = tokens;
+    updateRequestHeads();
+    for (Session &session : sessions)
+        session.context.setContextSize(tokens);
 }
 
 int OllamaInterface::getContextSize() const
@@ -272,10 +1344,132 @@ int OllamaInterface::getTimeout() const
     return timeout;
 }
 
-void OllamaInterface::addMessageToHistory(QString role, QString content)
+void OllamaInterface::setIdleTimeout(int seconds)
 {
-    QJsonObject message;
-    message["role"] = role;
-    message["content"] = content;
-    messageHistory.append(message);
+    idleTimeout = seconds;
+}
+
+int OllamaInterface::getIdleTimeout() const
+{
+    return idleTimeout;
+}
+
+void OllamaInterface::setKeepAlive(string newKeepAlive)
+{
+    keepAlive = std::move(newKeepAlive);
+    updateRequestHeads();
+}
+
+string OllamaInterface::getKeepAlive() const
+{
+    return keepAlive;
+}
+
+void OllamaInterface::setWarmupPrompt(const QString &systemPrompt)
+{
+    warmupPrompt = systemPrompt;
+}
+
+void OllamaInterface::addMessageToHistory(int session, QString role, QString content)
+{
+    // the session may have been closed while its answer was still coming in
+    auto current = sessions.find(session);
+    if (current == sessions.end())
+        return;
+
+    current->context.addMessage(role, content);
+    ++current->historyVersion;
+    current->lastActive = clock.elapsed();
+    emit historyAppended(session, role, content);
+}
+
+QJsonValue OllamaInterface::keepAliveValue() const
+{
+    // null leaves it at the server's default
+    if (keepAlive.empty())
+        return QJsonValue(QJsonValue::Null);
+
+    // plain numbers are seconds and have to go out as JSON numbers; anything else is a duration string
+    bool isNumber = false;
+    const int seconds = QString::fromStdString(keepAlive).toInt(&isNumber);
+    if (isNumber)
+        return seconds;
+    return QString::fromStdString(keepAlive);
+}
+
+QJsonObject OllamaInterface::requestOptions() const
+{
+    // without num_ctx the server falls back to its own default window and silently drops the start of the prompt
+    QJsonObject options;
+    options["num_ctx"] = contextSize;
+    return options;
+}
+
+void OllamaInterface::updateRequestHeads()
+{
+    // everything but the messages is the same for every request until a setting changes
+    chatHead = encodeHead(PromptOptions(), false);
+    prefillHead = encodeHead(PromptOptions(), true);
+    for (Session &session : sessions)
+    {
+        if (!session.head.isEmpty())
+            session.head = encodeHead(session.options, false);
+    }
+}
+
+QByteArray OllamaInterface::encodeHead(const PromptOptions &prompt, bool prefill) const
+{
+    QJsonObject options = requestOptions();
+    if (prompt.numPredict > 0)
+        options["num_predict"] = prompt.numPredict;
+    if (prompt.temperature >= 0)
+        options["temperature"] = prompt.temperature;
+    if (!prompt.stop.isEmpty())
+        options["stop"] = QJsonArray::fromStringList(prompt.stop);
+
+    // one token is the least the server will generate
+    if (prefill)
+        options["num_predict"] = 1;
+
+    QJsonObject json;
+    json["model"] = prompt.model.isEmpty() ? QString::fromStdString(model) : prompt.model;
+    json["stream"] = !prefill;
+    json["options"] = options;
+    json["keep_alive"] = keepAliveValue();
+    if (prompt.think >= 0)
+        json["think"] = prompt.think > 0;
+
+    // the object is cut open before its closing brace, so the messages (and tools) can follow
+    QByteArray head = QJsonDocument(json).toJson(QJsonDocument::Compact);
+    head.chop(1);
+    head += ",\"messages\":";
+    return head;
+}
+
+QByteArray OllamaInterface::generationKey(const PromptOptions &options)
+{
+    // only what changes the answer; the defaults all encode the same, however the caller spelled them
+    QJsonObject json;
+    json["think"] = qMax(-1, options.think);
+    json["num_predict"] = qMax(0, options.numPredict);
+    json["temperature"] = options.temperature < 0 ? -1.0 : options.temperature;
+    json["stop"] = QJsonArray::fromStringList(options.stop);
+    return QJsonDocument(json).toJson(QJsonDocument::Compact);
+}
+
+QByteArray OllamaInterface::chatRequest(const Session &session) const
+{
+    // past the last round the model has nothing left to call and has to answer
+    const bool withTools = tools && !tools->isEmpty() && session.toolRounds < maxToolRounds;
+    const QByteArray toolsField = withTools ? ",\"tools\":" + tools->definitions() : QByteArray();
+
+    // every piece is JSON text already, so the body is put together with one allocation
+    QByteArray body;
+    const QByteArray &head = session.head.isEmpty() ? chatHead : session.head;
+    body.reserve(head.size() + session.context.encodedSize() + toolsField.size() + 1);
+    body += head;
+    session.context.appendMessages(body);
+    body += toolsField;
+    body += '}';
+    return body;
 }
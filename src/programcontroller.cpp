@@ -1,5 +1,9 @@
 #include "programcontroller.h"
-#include <iostream>
+#include "campusdata.h"
+#include "logger.h"
+#include <QJsonArray>
+#include <QQuickWindow>
+#include <algorithm>
 
 ProgramController::ProgramController(QObject *parent)
     : QObject(parent),
@@ -8,10 +12,115 @@ ProgramController::ProgramController(QObject *parent)
            settings.value("Ollama/Model", "qwen3:4b").toString().toStdString(),
            settings.value("Ollama/ContextSize", 32000).toInt(),
            settings.value("Ollama/Timeout", 120).toInt()),
-    currentGenerateStatus(Error)
+    modelKeeper(&ollama, settings),
+    retriever(&ollama, settings),
+    router(settings),
+    chatSession(ollama.openSession()),
+    currentGenerateStatus(Error),
+    generation(0),
+    lastAsk(0),
+    showThinking(settings.value("UI/ShowThinking", false).toBool())
 {
+    // with tools the model looks directions up itself; without, it is given all of them up front
+    const bool useTools = settings.value("Tools/Enabled", true).toBool();
+    systemPrompt = composeSystemPrompt(useTools);
+
+    chatModel.setFlushInterval(settings.value("UI/TokenFlushInterval", 16).toInt());
+    loadGenerationOptions();
+
+    // further servers to spread prompts over, next to the one in Ollama/URL
+    ollama.addBackends(settings.value("Ollama/Backends").toStringList());
+    ollama.setRouting(settings.value("Ollama/Routing", "least-loaded").toString() == "latency"
+                          ? BackendPool::LatencyAware
+                          : BackendPool::LeastLoaded);
+    ollama.setHedgePercentile(settings.value("Ollama/HedgePercentile", 0).toInt());
+    ollama.setMaxConcurrentRequests(settings.value("Ollama/MaxConcurrentRequests", 0).toInt());
+
+    // a visitor who walks away leaves the next one a fresh conversation
+    ollama.setSessionLimits(settings.value("Ollama/SessionIdleMinutes", 0).toInt(),
+                            settings.value("Ollama/SessionMemoryMB", 0).toLongLong() * 1024 * 1024);
+
+    ollama.setIdleTimeout(settings.value("Ollama/IdleTimeout", 30).toInt());
+    ollama.setKeepAlive(settings.value("Ollama/KeepAlive", "30m").toString().toStdString());
+    if (settings.value("Ollama/WarmSystemPrompt", true).toBool())
+        ollama.setWarmupPrompt(systemPrompt);
+
+    if (settings.value("Cache/Enabled", true).toBool())
+    {
+        ollama.openResponseCache(settings.value("Cache/Path", "cob_zippy_ai_responses.cache").toString(),
+                                 settings.value("Cache/MaxSizeMB", 16).toLongLong() * 1024 * 1024,
+                                 settings.value("Cache/MaxAgeHours", 168).toInt());
+    }
+
+    // the model can look things up itself when the question calls for it
+    if (useTools)
+    {
+        registerTools();
+        tools.setTimeout(settings.value("Tools/TimeoutMs", 10000).toInt());
+        ollama.setTools(&tools, settings.value("Tools/MaxRounds", 3).toInt());
+        connect(&tools, &ToolRegistry::callFinished, &telemetry, &Telemetry::recordToolCall);
+    }
+
     connect(&ollama, &OllamaInterface::responseReceived, this, &ProgramController::onGenerateFinished);
     connect(&ollama, &OllamaInterface::responseFinished, this, &ProgramController::onStreamFinished);
+    connect(&ollama, &OllamaInterface::cacheStatsChanged, this, &ProgramController::cacheStatsChanged);
+    connect(&ollama, &OllamaInterface::requestError, this, &ProgramController::onRequestError);
+    connect(&ollama, &OllamaInterface::responseStopped, this, &ProgramController::onResponseStopped);
+    connect(&ollama, &OllamaInterface::sessionEvicted, this, &ProgramController::onSessionEvicted);
+    connect(&ollama, &OllamaInterface::responseEscalated, this, &ProgramController::onResponseEscalated);
+    connect(&ollama, &OllamaInterface::thinkingReceived, this, &ProgramController::onThinkingReceived);
+
+    // where the time goes, for the diagnostics overlay and for scraping
+    connect(&ollama, &OllamaInterface::requestMeasured, &telemetry, &Telemetry::recordRequest);
+    connect(&chatModel, &ChatModel::published, &telemetry, &Telemetry::recordPublished);
+    connect(&telemetry, &Telemetry::updated, this, &ProgramController::diagnosticsChanged);
+    telemetry.startExport(settings.value("Telemetry/MetricsPath", "cob_zippy_ai_metrics.prom").toString(),
+                          settings.value("Telemetry/WriteInterval", 15).toInt());
+
+    // the conversation is saved as it happens, and put back once the window is up
+    if (settings.value("Conversations/Enabled", true).toBool()
+        && conversations.open(settings.value("Conversations/Path", "cob_zippy_ai_conversations.log").toString(),
+                              settings.value("Conversations/KeepSessions", 20).toInt()))
+    {
+        connect(&ollama, &OllamaInterface::historyAppended, this,
+                [this](int session, const QString &role, const QString &content)
+        {
+            if (session == chatSession)
+                conversations.append(role, content, ConversationStore::InHistory);
+        });
+        if (settings.value("Conversations/RestoreOnStart", true).toBool())
+            QTimer::singleShot(0, this, &ProgramController::restoreConversation);
+        else
+            conversations.startSession();
+    }
+
+    // opt-in, since most prefills are thrown away as the text changes
+    if (settings.value("Speculation/Enabled", false).toBool())
+    {
+        ollama.setPrefillInterval(settings.value("Speculation/MinIntervalMs", 2000).toInt());
+        draftTimer.setSingleShot(true);
+        draftTimer.setInterval(settings.value("Speculation/PauseMs", 700).toInt());
+        connect(&draftTimer, &QTimer::timeout, this, [this]()
+        {
+            if (currentGenerateStatus != Generating)
+                ollama.prefill(chatSession, systemPrompt, draft);
+        });
+    }
+    connect(&ollama, &OllamaInterface::prefillSent, &telemetry, &Telemetry::recordPrefill);
+    connect(&ollama, &OllamaInterface::prefillUsed, &telemetry, &Telemetry::recordPrefillOutcome);
+
+    connect(&ollama, &OllamaInterface::pingFinished, this, &ProgramController::pingFinished);
+    connect(&ollama, &OllamaInterface::connectedChanged, this, &ProgramController::connectedChanged);
+
+    // the model is loaded once the monitor finds the server, which is right away if it is already running
+    ollama.startHealthMonitor(settings.value("Ollama/HealthCheckInterval", 30).toInt());
+
+    modelKeeper.start();
+
+    // embed any content that changed since the last run
+    retriever.addDocument(QString::fromUtf8(CampusData::eventsDocument));
+    retriever.addDocument(QString::fromUtf8(CampusData::contactsDocument));
+    retriever.rebuild();
 }
 
 /*
@@ -83,11 +192,11 @@ int ProgramController::getTimeout() const
 }
 
 /*
-    Pings the Ollama server and returns the status.
+    Checks the connection to the Ollama server in the background.
 */
-bool ProgramController::pingOllama()
+void ProgramController::pingOllama()
 {
-    return ollama.ping();
+    ollama.ping();
 }
 
 /*
@@ -103,98 +212,198 @@ bool ProgramController::getOllamaStatus()
 */
 void ProgramController::generate(const QString& prompt)
 {
-    QString systemPrompt = R"(You are Zippy, a helpful AI assistant for the University of Akron College of Business.
-You provide detailed navigation assistance for the College of Business building.
-
-=== FLOOR 1 NAVIGATION MAP ===
-
-DEFAULT STARTING POSITION: You are facing the big screen/elevator area.
-
-MAIN HALLWAY (Turn around so screen is behind you):
-
-LEFT SIDE (walking down the hallway):
-1. Room 125 - first door on your left
-2. Room 126 - second door on your left
-3. Bathroom - on your left
-4. Room 131 - on your left
-5. Stairs - on your left
-6. Room 132 - on your left
-7. Room 133 - on your left
-8. Room 134 - on your left
-9. Exit - straight ahead at the end
-
-RIGHT SIDE (walking down the same hallway):
-1. Room 121 - first room on your right
-2. Hallway entrance - on your right (after room 121)
-   - Note: Bathroom is on your left at this junction
-3. Room 130 - on your right (if you continue straight past the hallway)
-4. Another hallway entrance - on your right (after room 130)
-5. Exit - straight ahead (same exit as left side)
-
-SECONDARY HALLWAY (the hallway after room 121):
-Turn right into the hallway after room 121:
-- Immediately on LEFT: Another entrance to Room 130
-- On RIGHT: Back wall of Room 121
-- Walk forward, on LEFT: Room 149
-- On RIGHT: Room 120
-- Continue to T-junction:
-  - On LEFT before junction: Room 148
-  - Turn LEFT at T-junction, then Room 147 is straight ahead
-  - Turn RIGHT at T-junction returns you to the big screen/elevator area
-
-FROM T-JUNCTION (after turning LEFT, Room 147 is now behind you):
-- On your RIGHT: Room 147
-- Walk forward, on RIGHT: Room 146
-- Continue forward:
-  - On LEFT: Room 145
-  - On RIGHT: Room 144
-- You've reached a PLUS (+) JUNCTION
-
-AT THE PLUS (+) JUNCTION (near rooms 145/144):
-Option 1 - Turn RIGHT:
-  - Small hallway
-  - Room 143 on your right before the exit
-  - Exit at the end
-
-Option 2 - Go STRAIGHT:
-  - Small hallway
-  - Stairs on your LEFT
-  - Room 142 straight ahead
-
-Option 3 - Turn LEFT:
-  - Long hallway
-  - Bathrooms on your RIGHT
-  - Walk forward, Room 148 on LEFT
-  - Room 139 on RIGHT
-  - Room 130 on LEFT (you've made a loop back to the main hallway area)
-  - At the end: Turn RIGHT for exit, or go STRAIGHT to reach Room 133
-
-=== NAVIGATION RULES ===
-When someone asks for directions to a room:
-1. ALWAYS assume they start facing the big screen (unless they say otherwise)
-2. Give turn-by-turn directions
-3. Mention landmarks they'll pass (bathrooms, stairs, other rooms)
-4. Use clear "left/right/straight" language
-5. Give them confirmation of what they should see
-
-Example responses:
-"Room 125: Turn around from the big screen. Walk down the hallway. It's the first door on your left."
-
-"Room 147: Turn around from the big screen. Turn right into the hallway after Room 121. Walk to the T-junction and turn left. Room 147 is straight ahead."
-
-If you are not sure about something unrelated to navigation, say you don't know and suggest they contact the College directly.
-)";
-
-    ollama.sendPrompt(systemPrompt, prompt);
+    modelKeeper.notifyActivity();
+
+    chatModel.appendMessage(prompt, true);
+    conversations.append("user", prompt, ConversationStore::InView);
+
+    // directions come straight from the map; only questions it can't answer go to the model
+    const QString directions = navigation.answer(prompt);
+    if (!directions.isEmpty())
+    {
+        chatModel.appendMessage(directions, false);
+        conversations.append("assistant", directions, ConversationStore::InView);
+        ollama.recordExchange(chatSession, prompt, directions);
+        setGenerateStatus(Finished);
+        emit generateFinished(directions);
+        emit streamFinished();
+        return;
+    }
+
+    chatModel.appendMessage("", false);
+    setGenerateStatus(Generating);
+
+    // the prompt goes out once the relevant content has been looked up, or straight away if there is no index
+    retriever.retrieve(prompt, [this, prompt, current = ++generation](const QString &reference)
+    {
+        if (current == generation && currentGenerateStatus == Generating)
+            sendPrompt(chatSession, prompt, reference);
+    });
+}
+
+/*
+    Tells the controller what is in the input field.
+*/
+void ProgramController::updateDraft(const QString &text)
+{
+    if (draftTimer.interval() == 0)
+        return;
+
+    // an emptied field is usually a prompt that has just been sent
+    draft = text;
+    if (text.trimmed().isEmpty())
+        draftTimer.stop();
+    else
+        draftTimer.start();
+}
+
+/*
+    Stops the answer being generated.
+*/
+void ProgramController::cancel()
+{
+    if (currentGenerateStatus != Generating)
+        return;
+
+    // the aborted request reports back through onResponseStopped() before this returns
+    ++generation;
+    ollama.cancel(chatSession);
+
+    // stopped while the content lookup was still running, so there was no request to abort yet
+    if (currentGenerateStatus == Generating)
+        onResponseStopped(chatSession, OllamaInterface::Cancelled);
+}
+
+/*
+    Offers the model the map, the events list and, if it is set up, a web search as tools.
+*/
+void ProgramController::registerTools()
+{
+    auto parameters = [](const QJsonObject &properties, const QStringList &required)
+    {
+        QJsonObject schema;
+        schema["type"] = "object";
+        schema["properties"] = properties;
+        schema["required"] = QJsonArray::fromStringList(required);
+        return schema;
+    };
+    auto text = [](const QString &description)
+    {
+        QJsonObject property;
+        property["type"] = "string";
+        property["description"] = description;
+        return property;
+    };
+
+    QJsonObject route;
+    route["destination"] = text("Room number or kind of place, such as \"147\", \"bathroom\" or \"elevator\"");
+    route["origin"] = text("Where to start from; leave out to start at the kiosk");
+    tools.add("find_route", "Turn-by-turn directions to a place in the College of Business building.",
+              parameters(route, { "destination" }), [this](const QJsonObject &arguments, ToolRegistry::Done done)
+    {
+        const QString directions = navigation.directions(arguments["destination"].toString(),
+                                                         arguments["origin"].toString());
+        if (directions.isEmpty())
+            done(false, "That place is not on the map. Places on the map: " + navigation.places().join(", "));
+        else
+            done(true, directions);
+    });
+
+    QJsonObject events;
+    events["query"] = text("Words to look for, such as \"career\" or \"November\"; leave out for all events");
+    tools.add("find_events", "Upcoming events at the college, optionally only those matching a search.",
+              parameters(events, {}), [](const QJsonObject &arguments, ToolRegistry::Done done)
+    {
+        const QString query = arguments["query"].toString();
+        const QStringList words = query.split(' ', Qt::SkipEmptyParts);
+
+        QStringList all;
+        QStringList matching;
+        for (const CampusData::Event &event : CampusData::events)
+        {
+            const QString summary = QString::fromUtf8(event.summary);
+            all.append(summary);
+            if (std::any_of(words.cbegin(), words.cend(),
+                            [&summary](const QString &word) { return summary.contains(word, Qt::CaseInsensitive); }))
+                matching.append(summary);
+        }
+
+        if (all.isEmpty())
+            done(true, "There are no upcoming events.");
+        else if (words.isEmpty())
+            done(true, all.join('\n'));
+        else if (matching.isEmpty())
+            done(true, "No events match \"" + query + "\". These are all upcoming events:\n" + all.join('\n'));
+        else
+            done(true, matching.join('\n'));
+    });
+
+    // Ollama's search needs an API key; a local stand-in set as the URL doesn't
+    const QString searchKey = settings.value("Tools/WebSearchKey").toString();
+    const QString searchUrl = settings.value("Tools/WebSearchURL", "https://ollama.com/api/web_search").toString();
+    if (searchKey.isEmpty() && !settings.contains("Tools/WebSearchURL"))
+        return;
+
+    QJsonObject search;
+    search["query"] = text("What to search for");
+    tools.add("web_search", "Search the web for current information that is not about the college.",
+              parameters(search, { "query" }),
+              [this, searchUrl, searchKey](const QJsonObject &arguments, ToolRegistry::Done done)
+    {
+        ollama.requestWebSearch(searchUrl, arguments["query"].toString(), searchKey,
+                                [done](const QString &results, const QString &error)
+        {
+            if (error.isEmpty())
+                done(true, results);
+            else
+                done(false, error);
+        });
+    });
+}
+
+/*
+    Composes the system prompt from the campus data.
+*/
+QString ProgramController::composeSystemPrompt(bool withTools) const
+{
+    // built from the compiled-in tables only, so it is the same on every start and the server's cached prefix holds
+    QString prompt = "You are Zippy, a helpful AI assistant for the University of Akron College of Business. "
+                     "You help visitors find their way around the College of Business building.\n\n";
+
+    if (withTools)
+    {
+        prompt += "Use the find_route tool for directions. Places on the map: " + navigation.places().join(", ")
+                  + ".\n\n";
+    }
+    else
+    {
+        prompt += "Directions from the kiosk, where visitors stand facing the big screen:\n" + navigation.overview()
+                  + "\n\n";
+    }
+
+    prompt += "Give directions turn by turn from the kiosk unless the visitor says where they are. If you are not sure "
+              "about something, say you don't know and suggest they contact the College directly.\n\n";
+    prompt += QString::fromUtf8(CampusData::contactsDocument);
+    return prompt;
 }
 
 /*
     Slot to be called when Ollama finishes generating a response.
     Decodes the output and then invokes abc2midi to convert the output to a MIDI file.
 */
-void ProgramController::onGenerateFinished(QString response)
+void ProgramController::onGenerateFinished(int session, QString response)
 {
-    // connect this in QML to get the response
+    if (otherConversations.value(session) != 0)
+    {
+        emit answerReceived(session, response);
+        return;
+    }
+
+    // a cached answer is replayed a moment later, and may arrive after the prompt was stopped
+    if (session != chatSession || currentGenerateStatus != Generating)
+        return;
+
+    chatModel.appendToken(response);
     emit generateFinished(response);
 }
 
@@ -202,11 +411,393 @@ ProgramController::GenerateStatus ProgramController::getGenerateStatus() const
 {
     return currentGenerateStatus;
 }
-void ProgramController::onStreamFinished()
+void ProgramController::onStreamFinished(int session)
 {
+    finishRoute(session);
+    if (otherConversations.value(session) != 0)
+    {
+        finishAnswer(session, Finished);
+        return;
+    }
+
+    if (session != chatSession || currentGenerateStatus != Generating)
+        return;
+
+    // make sure the tail of the answer is on screen before QML re-enables input
+    chatModel.flush();
+    saveAnswer();
+    setGenerateStatus(Finished);
+
     // This emits the new signal for QML to hear
     emit streamFinished();
 }
+
+void ProgramController::onRequestError(int session, const QString &error)
+{
+    LOG_WARNING("prompt.failed", "session", session, "error", error);
+    routedPrompts.remove(session);
+    if (otherConversations.value(session) != 0)
+    {
+        finishAnswer(session, Error);
+        return;
+    }
+
+    if (session != chatSession || currentGenerateStatus != Generating)
+        return;
+    setGenerateStatus(Error);
+
+    // prompts go out without waiting for a connection check, so this is where an unreachable server shows up. the
+    // apology gets a paragraph of its own after whatever part of the answer had arrived
+    const QString apology = ollama.isConnected()
+                                ? "Sorry, something went wrong while answering. Please try again."
+                                : "Sorry, I can't reach the assistant right now. Please try again in a moment.";
+    chatModel.appendToken(chatModel.lastMessage().isEmpty() ? apology : "\n\n" + apology);
+    chatModel.flush();
+    saveAnswer();
+    emit streamFinished();
+}
+
+void ProgramController::onResponseStopped(int session, OllamaInterface::StopReason reason)
+{
+    routedPrompts.remove(session);
+    if (otherConversations.value(session) != 0)
+    {
+        finishAnswer(session, reason == OllamaInterface::Cancelled  ? Cancelled
+                              : reason == OllamaInterface::TimedOut ? TimedOut
+                                                                    : Error);
+        return;
+    }
+
+    if (session != chatSession || currentGenerateStatus != Generating)
+        return;
+
+    switch (reason)
+    {
+    case OllamaInterface::Cancelled:
+        setGenerateStatus(Cancelled);
+        break;
+    case OllamaInterface::TimedOut:
+        setGenerateStatus(TimedOut);
+        break;
+    default:
+        setGenerateStatus(Error);
+        break;
+    }
+
+    // the partial answer stays on screen, marked the same way as in the history the model sees
+    chatModel.appendToken(OllamaInterface::truncationMarker(reason));
+    chatModel.flush();
+    saveAnswer();
+    emit streamFinished();
+}
+
+/*
+    The fast model's answer looked unsure, so the configured model answers instead.
+*/
+void ProgramController::onResponseEscalated(int session)
+{
+    auto routed = routedPrompts.find(session);
+    if (routed != routedPrompts.end())
+    {
+        routed->tier = "escalated";
+        LOG_INFO("prompt.escalated", "session", session, "ms", routed->sent.elapsed());
+    }
+
+    if (otherConversations.value(session) != 0)
+    {
+        emit answerRestarted(session);
+        return;
+    }
+
+    // what was shown of the unsure answer makes way for the new one
+    if (session == chatSession && currentGenerateStatus == Generating)
+        chatModel.clearLastMessage();
+}
+
+/*
+    A thinking model's reasoning, which only the screen shows, and only when asked to.
+*/
+void ProgramController::onThinkingReceived(int session, const QString &thinking)
+{
+    if (showThinking && session == chatSession && currentGenerateStatus == Generating)
+        chatModel.appendThinking(thinking);
+}
+
+/*
+    Returns the model holding the chat messages shown in the chat view.
+*/
+ChatModel *ProgramController::getChatModel()
+{
+    return &chatModel;
+}
+
+/*
+    Starts a new conversation.
+*/
+void ProgramController::clearChat()
+{
+    // the stopped answer is saved to the old session before the new one starts
+    cancel();
+
+    chatModel.clear();
+    ollama.clearHistory(chatSession);
+    conversations.startSession();
+}
+
+/*
+    The conversation was idle long enough to be dropped; the screen follows suit.
+*/
+void ProgramController::onSessionEvicted(int session)
+{
+    if (session != chatSession)
+        return;
+
+    chatModel.clear();
+    conversations.startSession();
+}
+
+/*
+    Response cache counters, for tuning the cache settings.
+*/
+int ProgramController::getCacheHits() const
+{
+    return ollama.cacheHits();
+}
+
+int ProgramController::getCacheMisses() const
+{
+    return ollama.cacheMisses();
+}
+
+int ProgramController::getCoalescedRequests() const
+{
+    return ollama.coalescedRequests();
+}
+
+/*
+    The events and contacts for their pages.
+*/
+QVariantList ProgramController::getEvents() const
+{
+    QVariantList events;
+    for (const CampusData::Event &event : CampusData::events)
+    {
+        QVariantMap entry;
+        entry["title"] = QString::fromUtf8(event.title);
+        entry["month"] = QString::fromUtf8(event.month);
+        entry["day"] = QString::fromUtf8(event.day);
+        entry["time"] = QString::fromUtf8(event.time);
+        entry["location"] = QString::fromUtf8(event.location);
+        events.append(entry);
+    }
+    return events;
+}
+
+QVariantList ProgramController::getContacts() const
+{
+    QVariantList contacts;
+    for (const CampusData::Contact &contact : CampusData::contacts)
+    {
+        QVariantMap entry;
+        entry["name"] = QString::fromUtf8(contact.name);
+        entry["email"] = QString::fromUtf8(contact.email);
+        entry["phone"] = QString::fromUtf8(contact.phone);
+        entry["room"] = QString::fromUtf8(contact.room);
+        contacts.append(entry);
+    }
+    return contacts;
+}
+
+/*
+    Request timings for the diagnostics overlay.
+*/
+QVariantMap ProgramController::getDiagnostics() const
+{
+    return telemetry.summary();
+}
+
+/*
+    Measures how long streamed tokens take to show up in frames of this window.
+*/
+void ProgramController::watchFrames(QQuickWindow *window)
+{
+    // frameSwapped comes from the render thread; queued, the measurement includes getting back to this thread, which
+    // is when the next token could be handled anyway
+    connect(window, &QQuickWindow::frameSwapped, &telemetry, &Telemetry::recordFrame, Qt::QueuedConnection);
+}
+
+/*
+    Passes on how long a phase of starting up took.
+*/
+void ProgramController::recordStartup(const QString &phase, qint64 nsecs)
+{
+    telemetry.recordStartup(phase, nsecs);
+}
+
+/*
+    Conversations for clients other than this screen.
+*/
+int ProgramController::openConversation()
+{
+    const int session = ollama.openSession();
+    otherConversations.insert(session, 0);
+    return session;
+}
+
+void ProgramController::closeConversation(int session)
+{
+    if (!otherConversations.contains(session))
+        return;
+
+    cancelAnswer(session);
+    otherConversations.remove(session);
+    ollama.closeSession(session);
+}
+
+/*
+    Sends a prompt in a conversation opened with openConversation().
+*/
+bool ProgramController::ask(int session, const QString &prompt)
+{
+    auto conversation = otherConversations.find(session);
+    if (conversation == otherConversations.end() || *conversation != 0)
+        return false;
+
+    modelKeeper.notifyActivity();
+    const quint64 current = ++lastAsk;
+    *conversation = current;
+
+    const QString directions = navigation.answer(prompt);
+    if (!directions.isEmpty())
+    {
+        ollama.recordExchange(session, prompt, directions);
+        emit answerReceived(session, directions);
+        finishAnswer(session, Finished);
+        return true;
+    }
+
+    retriever.retrieve(prompt, [this, session, prompt, current](const QString &reference)
+    {
+        if (otherConversations.value(session) == current)
+            sendPrompt(session, prompt, reference);
+    });
+    return true;
+}
+
+/*
+    Sends a prompt to the model the router picks for it.
+*/
+void ProgramController::sendPrompt(int session, const QString &prompt, const QString &reference)
+{
+    const ModelRouter::Route route = router.route(prompt, ollama.hasHistory(session));
+    OllamaInterface::PromptOptions options = intentOptions[route.intent];
+    options.model = route.model;
+    options.escalate = router.escalates();
+
+    const QString tier = ModelRouter::tierName(route.tier);
+    LOG_INFO("prompt.routed", "session", session, "intent", ModelRouter::intentName(route.intent), "tier", tier,
+             "model", route.model.isEmpty() ? getModel() : route.model, "reason", route.reason);
+
+    if (router.isEnabled())
+    {
+        RoutedPrompt &routed = routedPrompts[session];
+        routed.tier = tier;
+        routed.sent.start();
+    }
+    ollama.sendPrompt(session, systemPrompt, prompt, reference, options);
+}
+
+/*
+    Reads the generation options for each intent.
+*/
+void ProgramController::loadGenerationOptions()
+{
+    // reasoning costs the visitor seconds of waiting for text they never see, so by default only open-ended questions
+    // leave it to the model; "auto" does the same for any intent
+    for (int intent = 0; intent < ModelRouter::IntentCount; ++intent)
+    {
+        const QString group = "Generation/" + ModelRouter::intentName(ModelRouter::Intent(intent)) + "/";
+        const QString think = settings.value(group + "Think", intent == ModelRouter::OpenEnded ? "auto" : "false")
+                                  .toString();
+
+        OllamaInterface::PromptOptions options;
+        options.think = think == "auto" ? -1 : (QVariant(think).toBool() ? 1 : 0);
+        options.numPredict = settings.value(group + "NumPredict", intent == ModelRouter::SmallTalk ? 200 : 0).toInt();
+        options.temperature = settings.value(group + "Temperature", -1).toDouble();
+        options.stop = settings.value(group + "Stop").toStringList();
+        intentOptions.append(options);
+    }
+}
+
+/*
+    Records how long the session's routed prompt took.
+*/
+void ProgramController::finishRoute(int session)
+{
+    auto routed = routedPrompts.find(session);
+    if (routed == routedPrompts.end())
+        return;
+
+    const qint64 nsecs = routed->sent.nsecsElapsed();
+    LOG_INFO("prompt.answered", "session", session, "tier", routed->tier, "ms", nsecs / 1000000);
+    telemetry.recordRoutedAnswer(routed->tier, nsecs);
+    routedPrompts.erase(routed);
+}
+
+/*
+    Stops the answer in one of the other conversations.
+*/
+void ProgramController::cancelAnswer(int session)
+{
+    if (otherConversations.value(session) == 0)
+        return;
+
+    // as with cancel(): the request reports back before this returns, unless the lookup hadn't finished yet
+    ollama.cancel(session);
+    if (otherConversations.value(session) != 0)
+        finishAnswer(session, Cancelled);
+}
+
+void ProgramController::finishAnswer(int session, GenerateStatus status)
+{
+    otherConversations[session] = 0;
+    emit answerFinished(session, status);
+}
+
+/*
+    The request timings in the Prometheus text format.
+*/
+QByteArray ProgramController::metrics() const
+{
+    return telemetry.prometheusText();
+}
+
+/*
+    Puts the last conversation back in the chat view and the model's history.
+*/
+void ProgramController::restoreConversation()
+{
+    const QList<ConversationStore::Message> messages = conversations.lastSession();
+    for (const ConversationStore::Message &message : messages)
+    {
+        if (message.placement & ConversationStore::InView)
+            chatModel.appendMessage(message.text, message.role == "user");
+        if (message.placement & ConversationStore::InHistory)
+            ollama.restoreMessage(chatSession, message.role, message.text);
+    }
+
+    if (!messages.isEmpty())
+        LOG_INFO("conversations.restored", "messages", messages.size());
+}
+
+/*
+    Saves the answer in the last chat message once it is complete.
+*/
+void ProgramController::saveAnswer()
+{
+    conversations.append("assistant", chatModel.lastMessage(), ConversationStore::InView);
+}
+
 void ProgramController::setGenerateStatus(GenerateStatus newStatus)
 {
     if (currentGenerateStatus != newStatus)
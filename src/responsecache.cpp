@@ -0,0 +1,341 @@
+/*
+    responsecache.cpp
+
+    Class implementation for ResponseCache.
+*/
+
+#include "responsecache.h"
+#include "logger.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QList>
+#include <QSaveFile>
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace
+{
+
+/*
+    File layout: a FileHeader, then records back to back. Each record is a RecordHeader followed by the response as
+    UTF-8, padded so the next header is 8-byte aligned. Replaced and expired records are only flagged dead; they are
+    dropped the next time the file is compacted.
+*/
+constexpr char fileMagic[8] = { 'Z', 'I', 'P', 'P', 'Y', 'R', 'C', '1' };
+constexpr quint32 recordMagic = 0x5a524543; // "ZREC"
+constexpr quint32 deadFlag = 0x1;
+constexpr int keySize = 20; // SHA-1
+
+struct RecordHeader
+{
+    quint32 magic;
+    quint32 flags;
+    quint32 length; // of the response in bytes, without padding
+    quint32 reserved;
+    qint64 created;  // ms since epoch
+    qint64 lastUsed; // ms since epoch, updated in place on every hit
+    char key[keySize];
+    char padding[4];
+};
+
+qint64 recordSize(quint32 length)
+{
+    return qint64(sizeof(RecordHeader)) + ((qint64(length) + 7) & ~qint64(7));
+}
+
+} // namespace
+
+ResponseCache::ResponseCache()
+    : mapped(nullptr), mappedSize(0), maxBytes(0), maxAge(0), hitCount(0), missCount(0)
+{
+}
+
+ResponseCache::~ResponseCache()
+{
+    close();
+}
+
+bool ResponseCache::open(const QString &path, qint64 maxBytes, int maxAgeHours)
+{
+    close();
+
+    this->maxBytes = maxBytes;
+    maxAge = qint64(qMax(0, maxAgeHours)) * 60 * 60 * 1000;
+
+    // unbuffered, so appended records are in the file (and visible through the mapping) as soon as write() returns
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered))
+    {
+        LOG_ERROR("cache.open_failed", "path", path, "error", file.errorString());
+        return false;
+    }
+
+    if (file.size() == 0)
+        file.write(fileMagic, sizeof(fileMagic));
+
+    if (!load())
+    {
+        close();
+        return false;
+    }
+
+    // a cap lowered since the last run takes effect straight away
+    if (file.size() > maxBytes)
+        compact();
+
+    return isOpen();
+}
+
+void ResponseCache::close()
+{
+    if (mapped)
+        file.unmap(mapped);
+    mapped = nullptr;
+    mappedSize = 0;
+
+    if (file.isOpen())
+        file.close();
+    index.clear();
+}
+
+bool ResponseCache::isOpen() const
+{
+    return mapped != nullptr;
+}
+
+bool ResponseCache::lookup(const QByteArray &key, QString &response)
+{
+    auto entry = index.constFind(key);
+    if (!mapped || entry == index.constEnd())
+    {
+        ++missCount;
+        return false;
+    }
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    const qint64 offset = entry->offset;
+    if (maxAge > 0 && now - entry->created > maxAge)
+    {
+        markDead(offset);
+        index.erase(entry);
+        ++missCount;
+        return false;
+    }
+
+    RecordHeader header;
+    std::memcpy(&header, mapped + offset, sizeof(header));
+    response = QString::fromUtf8(reinterpret_cast<const char *>(mapped + offset + sizeof(header)), header.length);
+
+    // the recency survives a restart because it lives in the file rather than in the index
+    std::memcpy(mapped + offset + offsetof(RecordHeader, lastUsed), &now, sizeof(now));
+
+    ++hitCount;
+    return true;
+}
+
+void ResponseCache::insert(const QByteArray &key, const QString &response)
+{
+    if (!mapped || key.size() != keySize)
+        return;
+
+    auto existing = index.constFind(key);
+    if (existing != index.constEnd())
+        markDead(existing->offset);
+
+    const QByteArray text = response.toUtf8();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    RecordHeader header = {};
+    header.magic = recordMagic;
+    header.length = quint32(text.size());
+    header.created = now;
+    header.lastUsed = now;
+    std::memcpy(header.key, key.constData(), keySize);
+
+    QByteArray record(recordSize(header.length), '\0');
+    std::memcpy(record.data(), &header, sizeof(header));
+    std::memcpy(record.data() + sizeof(header), text.constData(), text.size());
+
+    const qint64 offset = file.size();
+    if (!file.seek(offset) || file.write(record) != record.size())
+    {
+        LOG_ERROR("cache.write_failed", "path", file.fileName(), "error", file.errorString());
+
+        // a mapped file can't be shrunk on Windows
+        file.unmap(mapped);
+        mapped = nullptr;
+        mappedSize = 0;
+        if (!file.resize(offset) || !map())
+            close();
+        return;
+    }
+    index.insert(key, { offset, now });
+
+    // the new record lies past the end of the old mapping, and compact() copies it from the mapping like any other
+    if (!map())
+        close();
+    else if (file.size() > maxBytes)
+        compact();
+}
+
+QByteArray ResponseCache::makeKey(const QString &model, const QByteArray &options, const QByteArray &conversation,
+                                  const QString &prompt)
+{
+    QString normalized = prompt.simplified().toLower();
+    while (!normalized.isEmpty() && QString("?!.").contains(normalized.back()))
+        normalized.chop(1);
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(model.toUtf8());
+    hash.addData(QByteArrayView("\0", 1));
+    hash.addData(options);
+    hash.addData(QByteArrayView("\0", 1));
+    hash.addData(conversation);
+    hash.addData(QByteArrayView("\0", 1));
+    hash.addData(normalized.trimmed().toUtf8());
+    return hash.result();
+}
+
+int ResponseCache::hits() const
+{
+    return hitCount;
+}
+
+int ResponseCache::misses() const
+{
+    return missCount;
+}
+
+int ResponseCache::entries() const
+{
+    return int(index.size());
+}
+
+bool ResponseCache::map()
+{
+    if (mapped)
+        file.unmap(mapped);
+
+    mappedSize = file.size();
+    mapped = file.map(0, mappedSize);
+    if (!mapped)
+    {
+        LOG_ERROR("cache.map_failed", "path", file.fileName(), "error", file.errorString());
+        mappedSize = 0;
+        return false;
+    }
+    return true;
+}
+
+bool ResponseCache::load()
+{
+    index.clear();
+    if (!map())
+        return false;
+
+    if (mappedSize < qint64(sizeof(fileMagic)) || std::memcmp(mapped, fileMagic, sizeof(fileMagic)) != 0)
+    {
+        LOG_WARNING("cache.ignored", "path", file.fileName(), "reason", "not a cache file");
+        file.unmap(mapped);
+        mapped = nullptr;
+        return false;
+    }
+
+    qint64 pos = sizeof(fileMagic);
+    while (pos + qint64(sizeof(RecordHeader)) <= mappedSize)
+    {
+        RecordHeader header;
+        std::memcpy(&header, mapped + pos, sizeof(header));
+        if (header.magic != recordMagic || pos + recordSize(header.length) > mappedSize)
+            break;
+
+        if (!(header.flags & deadFlag))
+            index.insert(QByteArray(header.key, keySize), { pos, header.created });
+        pos += recordSize(header.length);
+    }
+
+    // whatever follows the last complete record was cut off by a crash mid-write
+    if (pos < mappedSize)
+    {
+        LOG_WARNING("cache.truncated", "path", file.fileName(), "bytes", mappedSize - pos);
+        file.unmap(mapped);
+        mapped = nullptr;
+        if (!file.resize(pos))
+            return false;
+        return map();
+    }
+
+    return true;
+}
+
+void ResponseCache::compact()
+{
+    struct Live
+    {
+        qint64 offset;
+        qint64 lastUsed;
+        qint64 size;
+    };
+
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    QList<Live> live;
+    live.reserve(index.size());
+    for (auto entry = index.constBegin(); entry != index.constEnd(); ++entry)
+    {
+        if (maxAge > 0 && now - entry->created > maxAge)
+            continue;
+
+        RecordHeader header;
+        std::memcpy(&header, mapped + entry->offset, sizeof(header));
+        live.append({ entry->offset, header.lastUsed, recordSize(header.length) });
+    }
+
+    // keep the most recently used entries, leaving a quarter of the cap free so this doesn't run on every insert. of
+    // entries used within the same millisecond, the one written last counts as the more recent
+    std::sort(live.begin(), live.end(), [](const Live &a, const Live &b)
+    {
+        return a.lastUsed != b.lastUsed ? a.lastUsed > b.lastUsed : a.offset > b.offset;
+    });
+
+    const qint64 target = maxBytes - maxBytes / 4 - qint64(sizeof(fileMagic));
+    qint64 total = 0;
+    qsizetype kept = 0;
+    while (kept < live.size() && total + live[kept].size <= target)
+        total += live[kept++].size;
+
+    QSaveFile output(file.fileName());
+    if (!output.open(QIODevice::WriteOnly))
+    {
+        LOG_ERROR("cache.compact_failed", "path", file.fileName(), "error", output.errorString());
+        return;
+    }
+
+    output.write(fileMagic, sizeof(fileMagic));
+    for (qsizetype i = 0; i < kept; ++i)
+        output.write(reinterpret_cast<const char *>(mapped + live[i].offset), live[i].size);
+
+    // the old file has to be released before it can be replaced on every platform
+    const QString path = file.fileName();
+    file.unmap(mapped);
+    mapped = nullptr;
+    file.close();
+
+    if (!output.commit())
+        LOG_ERROR("cache.compact_failed", "path", path, "error", output.errorString());
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadWrite | QIODevice::Unbuffered) || !load())
+    {
+        LOG_ERROR("cache.reopen_failed", "path", path, "error", file.errorString());
+        close();
+    }
+}
+
+void ResponseCache::markDead(qint64 offset)
+{
+    RecordHeader header;
+    std::memcpy(&header, mapped + offset, sizeof(header));
+    header.flags |= deadFlag;
+    std::memcpy(mapped + offset + offsetof(RecordHeader, flags), &header.flags, sizeof(header.flags));
+}
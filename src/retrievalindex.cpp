@@ -0,0 +1,368 @@
+/*
+    retrievalindex.cpp
+
+    Class implementation for RetrievalIndex.
+*/
+
+#include "retrievalindex.h"
+#include "logger.h"
+#include <QSaveFile>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define RETRIEVAL_X86
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define RETRIEVAL_NEON
+#endif
+
+namespace
+{
+
+/*
+    File layout: a FileHeader, the vectors (count * dimension floats, starting on a 64-byte boundary), one ChunkRecord
+    per chunk, then the chunk texts as UTF-8.
+*/
+constexpr char fileMagic[8] = { 'Z', 'I', 'P', 'P', 'Y', 'R', 'X', '1' };
+constexpr int hashSize = 20; // SHA-1
+
+struct FileHeader
+{
+    char magic[8];
+    quint32 dimension;
+    quint32 count;
+    quint64 vectorsOffset;
+    quint64 chunksOffset;
+    quint64 textsOffset;
+    quint64 fileSize;
+    char reserved[16];
+};
+
+struct ChunkRecord
+{
+    char hash[hashSize];
+    quint32 textLength;
+    quint64 textOffset; // relative to the start of the texts
+};
+
+qint64 alignedTo64(qint64 offset)
+{
+    return (offset + 63) & ~qint64(63);
+}
+
+float dotScalar(const float *a, const float *b, int n)
+{
+    // four independent sums, so the compiler can keep several multiplies in flight
+    float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        s0 += a[i] * b[i];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    for (; i < n; ++i)
+        s0 += a[i] * b[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+#if defined(RETRIEVAL_X86)
+float dotSse(const float *a, const float *b, int n)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(acc0, acc1));
+    float sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+#define RETRIEVAL_AVX2
+__attribute__((target("avx2,fma"))) float dotAvx2(const float *a, const float *b, int n)
+{
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+    }
+
+    const __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 sum4 = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum4 = _mm_add_ps(sum4, _mm_movehl_ps(sum4, sum4));
+    sum4 = _mm_add_ss(sum4, _mm_shuffle_ps(sum4, sum4, 1));
+    float sum = _mm_cvtss_f32(sum4);
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+#endif
+#endif
+
+#if defined(RETRIEVAL_NEON)
+float dotNeon(const float *a, const float *b, int n)
+{
+    float32x4_t acc0 = vdupq_n_f32(0);
+    float32x4_t acc1 = vdupq_n_f32(0);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; ++i)
+        sum += a[i] * b[i];
+    return sum;
+}
+#endif
+
+using DotProduct = float (*)(const float *, const float *, int);
+
+DotProduct bestDotProduct()
+{
+#if defined(RETRIEVAL_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+        return dotAvx2;
+#endif
+#if defined(RETRIEVAL_X86)
+    return dotSse;
+#elif defined(RETRIEVAL_NEON)
+    return dotNeon;
+#else
+    return dotScalar;
+#endif
+}
+
+const DotProduct dot = bestDotProduct();
+
+void normalize(float *vector, int n)
+{
+    const float length = std::sqrt(dotScalar(vector, vector, n));
+    if (length <= 0)
+        return;
+    for (int i = 0; i < n; ++i)
+        vector[i] /= length;
+}
+
+} // namespace
+
+RetrievalIndex::RetrievalIndex()
+    : mapped(nullptr), mappedSize(0), count(0), dims(0), vectors(nullptr), chunks(nullptr), texts(nullptr)
+{
+}
+
+RetrievalIndex::~RetrievalIndex()
+{
+    close();
+}
+
+bool RetrievalIndex::open(const QString &path)
+{
+    close();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    mappedSize = file.size();
+    mapped = mappedSize >= qint64(sizeof(FileHeader)) ? file.map(0, mappedSize) : nullptr;
+    if (!mapped)
+    {
+        close();
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(&header, mapped, sizeof(header));
+
+    const quint64 vectorBytes = quint64(header.count) * header.dimension * sizeof(float);
+    const bool valid = std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) == 0
+                       && header.fileSize == quint64(mappedSize) && header.vectorsOffset % 64 == 0
+                       && header.vectorsOffset + vectorBytes <= header.chunksOffset
+                       && header.chunksOffset + quint64(header.count) * sizeof(ChunkRecord) <= header.textsOffset
+                       && header.textsOffset <= header.fileSize;
+    if (!valid)
+    {
+        LOG_WARNING("index.ignored", "path", path, "reason", "not a valid index file");
+        close();
+        return false;
+    }
+
+    count = int(header.count);
+    dims = int(header.dimension);
+    vectors = reinterpret_cast<const float *>(mapped + header.vectorsOffset);
+    chunks = mapped + header.chunksOffset;
+    texts = reinterpret_cast<const char *>(mapped + header.textsOffset);
+    return true;
+}
+
+void RetrievalIndex::close()
+{
+    if (mapped)
+        file.unmap(const_cast<uchar *>(mapped));
+    if (file.isOpen())
+        file.close();
+
+    mapped = nullptr;
+    mappedSize = 0;
+    count = 0;
+    dims = 0;
+    vectors = nullptr;
+    chunks = nullptr;
+    texts = nullptr;
+}
+
+bool RetrievalIndex::isOpen() const
+{
+    return mapped != nullptr;
+}
+
+int RetrievalIndex::size() const
+{
+    return count;
+}
+
+int RetrievalIndex::dimension() const
+{
+    return dims;
+}
+
+QList<RetrievalIndex::Match> RetrievalIndex::search(const float *query, int k) const
+{
+    QList<Match> best;
+    if (!mapped || k <= 0 || count == 0)
+        return best;
+
+    // with both sides normalized the dot product is the cosine similarity
+    QList<float> normalized(query, query + dims);
+    normalize(normalized.data(), dims);
+
+    // k is small, so an insertion-sorted list beats a heap
+    k = qMin(k, count);
+    best.reserve(k + 1);
+    const float *vector = vectors;
+    for (int chunk = 0; chunk < count; ++chunk, vector += dims)
+    {
+        const float score = dot(normalized.constData(), vector, dims);
+        if (best.size() == k && score <= best.last().score)
+            continue;
+
+        qsizetype at = best.size();
+        while (at > 0 && best[at - 1].score < score)
+            --at;
+        best.insert(at, { chunk, score });
+        if (best.size() > k)
+            best.removeLast();
+    }
+    return best;
+}
+
+QString RetrievalIndex::text(int chunk) const
+{
+    if (chunk < 0 || chunk >= count)
+        return QString();
+
+    ChunkRecord record;
+    std::memcpy(&record, chunks + qsizetype(chunk) * sizeof(ChunkRecord), sizeof(record));
+    return QString::fromUtf8(texts + record.textOffset, record.textLength);
+}
+
+QByteArray RetrievalIndex::hash(int chunk) const
+{
+    if (chunk < 0 || chunk >= count)
+        return QByteArray();
+
+    ChunkRecord record;
+    std::memcpy(&record, chunks + qsizetype(chunk) * sizeof(ChunkRecord), sizeof(record));
+    return QByteArray(record.hash, hashSize);
+}
+
+const float *RetrievalIndex::vector(int chunk) const
+{
+    if (chunk < 0 || chunk >= count)
+        return nullptr;
+    return vectors + qsizetype(chunk) * dims;
+}
+
+bool RetrievalIndex::write(const QString &path, int dimension, const QList<Entry> &entries)
+{
+    QList<QByteArray> encoded;
+    encoded.reserve(entries.size());
+    qint64 textBytes = 0;
+    for (const Entry &entry : entries)
+    {
+        if (entry.vector.size() != dimension || entry.hash.size() != hashSize)
+        {
+            LOG_ERROR("index.write_failed", "path", path, "error", "a chunk has the wrong vector size or hash");
+            return false;
+        }
+        encoded.append(entry.text.toUtf8());
+        textBytes += encoded.last().size();
+    }
+
+    FileHeader header = {};
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.dimension = quint32(dimension);
+    header.count = quint32(entries.size());
+    header.vectorsOffset = alignedTo64(sizeof(FileHeader));
+    header.chunksOffset = header.vectorsOffset + quint64(entries.size()) * dimension * sizeof(float);
+    header.textsOffset = header.chunksOffset + quint64(entries.size()) * sizeof(ChunkRecord);
+    header.fileSize = header.textsOffset + textBytes;
+
+    QSaveFile output(path);
+    if (!output.open(QIODevice::WriteOnly))
+    {
+        LOG_ERROR("index.write_failed", "path", path, "error", output.errorString());
+        return false;
+    }
+
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(QByteArray(header.vectorsOffset - sizeof(header), '\0'));
+
+    QList<float> vector(dimension);
+    for (const Entry &entry : entries)
+    {
+        std::memcpy(vector.data(), entry.vector.constData(), dimension * sizeof(float));
+        normalize(vector.data(), dimension);
+        output.write(reinterpret_cast<const char *>(vector.constData()), dimension * sizeof(float));
+    }
+
+    quint64 textOffset = 0;
+    for (qsizetype i = 0; i < entries.size(); ++i)
+    {
+        ChunkRecord record = {};
+        std::memcpy(record.hash, entries[i].hash.constData(), hashSize);
+        record.textLength = quint32(encoded[i].size());
+        record.textOffset = textOffset;
+        textOffset += record.textLength;
+        output.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    }
+
+    for (const QByteArray &text : encoded)
+        output.write(text);
+
+    if (!output.commit())
+    {
+        LOG_ERROR("index.write_failed", "path", path, "error", output.errorString());
+        return false;
+    }
+    return true;
+}
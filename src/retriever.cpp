@@ -0,0 +1,273 @@
+/*
+    retriever.cpp
+
+    Class implementation for Retriever.
+*/
+
+#include "retriever.h"
+#include "logger.h"
+#include "ollamainterface.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QHash>
+#include <QPointer>
+#include <QRegularExpression>
+
+namespace
+{
+
+constexpr int chunkChars = 800;
+constexpr int embedBatchSize = 32;
+
+} // namespace
+
+Retriever::Retriever(OllamaInterface *ollama, QSettings &settings, QObject *parent)
+    : QObject(parent), ollama(ollama), building(false), stale(false), dimension(0)
+{
+    enabled = settings.value("Retrieval/Enabled", true).toBool();
+    contentPath = settings.value("Retrieval/ContentPath", "content").toString();
+    indexPath = settings.value("Retrieval/IndexPath", "cob_zippy_ai_retrieval.index").toString();
+    embedModel = settings.value("Retrieval/EmbedModel", "nomic-embed-text").toString();
+    topK = settings.value("Retrieval/TopK", 3).toInt();
+    minScore = settings.value("Retrieval/MinScore", 0.5).toFloat();
+
+    // the index from the last run can answer queries straight away, before any rebuild has finished
+    if (enabled)
+        index.open(indexPath);
+
+    // a rebuild that failed because the server was down is retried as soon as it is back
+    connect(ollama, &OllamaInterface::connectedChanged, this, [this](bool connected)
+    {
+        if (connected && stale)
+            rebuild();
+    });
+}
+
+void Retriever::addDocument(const QString &text)
+{
+    documents.append(text);
+}
+
+void Retriever::rebuild()
+{
+    if (!enabled || building)
+        return;
+
+    // vectors already in the index are reused for chunks whose text hasn't changed
+    QHash<QByteArray, int> known;
+    for (int chunk = 0; chunk < index.size(); ++chunk)
+        known.insert(index.hash(chunk), chunk);
+
+    entries.clear();
+    pending.clear();
+    dimension = index.isOpen() ? index.dimension() : 0;
+
+    // the documents come first, so their chunks keep their place when files are added
+    QStringList texts = documents;
+    QDir content(contentPath);
+    if (content.exists())
+    {
+        const QStringList files = content.entryList({ "*.md", "*.txt" }, QDir::Files, QDir::Name);
+        for (const QString &name : files)
+        {
+            QFile file(content.filePath(name));
+            if (file.open(QIODevice::ReadOnly | QIODevice::Text))
+                texts.append(QString::fromUtf8(file.readAll()));
+            else
+                LOG_WARNING("retrieval.read_failed", "path", file.fileName(), "error", file.errorString());
+        }
+    }
+    else if (documents.isEmpty())
+    {
+        LOG_WARNING("retrieval.no_content", "path", contentPath);
+        return;
+    }
+
+    for (const QString &text : std::as_const(texts))
+    {
+        for (const QString &chunk : chunkText(text, chunkChars))
+        {
+            QCryptographicHash hash(QCryptographicHash::Sha1);
+            hash.addData(embedModel.toUtf8());
+            hash.addData(QByteArrayView("\0", 1));
+            hash.addData(chunk.toUtf8());
+
+            RetrievalIndex::Entry entry{ hash.result(), chunk, {} };
+            auto existing = known.constFind(entry.hash);
+            if (existing != known.constEnd())
+            {
+                const float *vector = index.vector(*existing);
+                entry.vector = QList<float>(vector, vector + dimension);
+            }
+            else
+            {
+                pending.append(entries.size());
+            }
+            entries.append(entry);
+        }
+    }
+
+    bool changed = !pending.isEmpty() || entries.size() != index.size();
+    for (qsizetype i = 0; !changed && i < entries.size(); ++i)
+        changed = entries[i].hash != index.hash(int(i));
+
+    if (!changed)
+    {
+        entries.clear();
+        stale = false;
+        return;
+    }
+
+    // with no old vectors kept, as after a change of embedding model, the size comes from the new ones
+    if (pending.size() == entries.size())
+        dimension = 0;
+
+    LOG_INFO("index.updating", "pending", pending.size(), "chunks", entries.size());
+    building = true;
+    embedNextBatch();
+}
+
+bool Retriever::isReady() const
+{
+    return enabled && index.isOpen() && index.size() > 0;
+}
+
+void Retriever::retrieve(const QString &query, std::function<void(const QString &)> onFinished)
+{
+    if (!isReady())
+    {
+        onFinished(QString());
+        return;
+    }
+
+    if (stale)
+        rebuild();
+
+    QPointer<Retriever> self(this);
+    ollama->requestEmbeddings(embedModel, { query }, [self, onFinished](const QList<QList<float>> &embeddings,
+                                                                         const QString &error)
+    {
+        // without a lookup the prompt still goes out, just without reference material
+        if (!self || !error.isEmpty() || embeddings.isEmpty()
+            || embeddings.first().size() != self->index.dimension())
+        {
+            if (!error.isEmpty())
+                LOG_WARNING("retrieval.lookup_failed", "error", error);
+            onFinished(QString());
+            return;
+        }
+
+        QStringList relevant;
+        for (const RetrievalIndex::Match &match : self->index.search(embeddings.first().constData(), self->topK))
+        {
+            if (match.score >= self->minScore)
+                relevant.append(self->index.text(match.chunk));
+        }
+        onFinished(relevant.join("\n\n"));
+    });
+}
+
+QStringList Retriever::chunkText(const QString &text, int maxChars)
+{
+    static const QRegularExpression paragraphBreak(R"(\n\s*\n)");
+    static const QRegularExpression headingMarker(R"(^#+\s*)");
+
+    QStringList chunks;
+    QString heading;
+    QString current;
+
+    auto flush = [&]()
+    {
+        if (!current.isEmpty())
+            chunks.append(heading.isEmpty() ? current : heading + "\n" + current);
+        current.clear();
+    };
+
+    for (const QString &block : text.split(paragraphBreak, Qt::SkipEmptyParts))
+    {
+        const QString paragraph = block.trimmed();
+        if (paragraph.isEmpty())
+            continue;
+
+        // a heading starts a new chunk and is repeated at the top of every chunk under it
+        if (paragraph.startsWith('#') && !paragraph.contains('\n'))
+        {
+            flush();
+            heading = paragraph;
+            heading.remove(headingMarker);
+            continue;
+        }
+
+        if (!current.isEmpty() && current.size() + 1 + paragraph.size() > maxChars)
+            flush();
+        current += current.isEmpty() ? paragraph : "\n" + paragraph;
+    }
+    flush();
+
+    return chunks;
+}
+
+void Retriever::embedNextBatch()
+{
+    if (pending.isEmpty())
+    {
+        finishRebuild();
+        return;
+    }
+
+    const QList<qsizetype> batch = pending.mid(0, embedBatchSize);
+    QStringList input;
+    for (qsizetype entry : batch)
+        input.append(entries[entry].text);
+
+    QPointer<Retriever> self(this);
+    ollama->requestEmbeddings(embedModel, input, [self, batch](const QList<QList<float>> &embeddings,
+                                                               const QString &error)
+    {
+        if (!self)
+            return;
+
+        if (!error.isEmpty())
+        {
+            LOG_ERROR("index.update_failed", "error", error);
+            self->building = false;
+            self->stale = true;
+            self->entries.clear();
+            return;
+        }
+
+        for (qsizetype i = 0; i < batch.size(); ++i)
+        {
+            if (self->dimension == 0)
+                self->dimension = int(embeddings[i].size());
+
+            if (embeddings[i].size() != self->dimension)
+            {
+                LOG_ERROR("index.update_failed", "error", "embedding size changed", "from", self->dimension, "to",
+                          embeddings[i].size());
+                self->building = false;
+                self->stale = true;
+                self->entries.clear();
+                return;
+            }
+            self->entries[batch[i]].vector = embeddings[i];
+        }
+
+        self->pending.remove(0, batch.size());
+        self->embedNextBatch();
+    });
+}
+
+void Retriever::finishRebuild()
+{
+    // the file can't be replaced while it is mapped
+    index.close();
+    const bool written = RetrievalIndex::write(indexPath, dimension, entries);
+    index.open(indexPath);
+
+    building = false;
+    stale = !written;
+    entries.clear();
+    emit indexRebuilt(index.size());
+}
@@ -0,0 +1,52 @@
+/*
+    startuptrace.cpp
+
+    Class implementation for StartupTrace.
+*/
+
+#include "startuptrace.h"
+#include "logger.h"
+#include <QQuickWindow>
+#include <QTimer>
+#include <memory>
+
+StartupTrace::StartupTrace(QObject *parent)
+    : QObject(parent)
+{
+    clock.start();
+}
+
+void StartupTrace::mark(const QString &phase)
+{
+    recorded.append({ phase, clock.nsecsElapsed() });
+}
+
+void StartupTrace::watch(QQuickWindow *window)
+{
+    // frameSwapped comes from the render thread; only the first one matters
+    auto connection = std::make_shared<QMetaObject::Connection>();
+    *connection = connect(window, &QQuickWindow::frameSwapped, this, [this, connection]()
+    {
+        if (!*connection)
+            return;
+        disconnect(*connection);
+        *connection = QMetaObject::Connection();
+        mark("firstFrame");
+
+        // whatever was queued while the first frame was drawn runs before this does
+        QTimer::singleShot(0, this, [this]()
+        {
+            mark("interactive");
+
+            for (const Phase &phase : std::as_const(recorded))
+                LOG_INFO("startup.phase", "name", phase.name, "ms", phase.nsecs / 1000000);
+
+            emit finished();
+        });
+    }, Qt::QueuedConnection);
+}
+
+QList<StartupTrace::Phase> StartupTrace::phases() const
+{
+    return recorded;
+}
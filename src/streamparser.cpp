@@ -0,0 +1,506 @@
+/*
+    streamparser.cpp
+
+    Class implementation for StreamParser.
+*/
+
+#include "streamparser.h"
+#include <cstring>
+
+namespace
+{
+
+/*
+    JsonCursor
+
+    Forward-only cursor over a JSON text. It never allocates: strings are handed back as views into the underlying
+    buffer along with a flag saying whether they still contain escape sequences.
+*/
+class JsonCursor
+{
+public:
+    explicit JsonCursor(QByteArrayView data) : pos(data.data()), end(data.data() + data.size()) {}
+
+    void skipWhitespace()
+    {
+        while (pos < end && (*pos == ' ' || *pos == '\t' || *pos == '\r' || *pos == '\n'))
+            ++pos;
+    }
+
+    char peek()
+    {
+        skipWhitespace();
+        return pos < end ? *pos : '\0';
+    }
+
+    bool consume(char c)
+    {
+        if (peek() != c)
+            return false;
+        ++pos;
+        return true;
+    }
+
+    bool atEnd()
+    {
+        skipWhitespace();
+        return pos == end;
+    }
+
+    // reads a string value, leaving raw pointing at the bytes between the quotes
+    bool readString(QByteArrayView &raw, bool &escaped)
+    {
+        if (!consume('"'))
+            return false;
+
+        const char *start = pos;
+        escaped = false;
+        while (pos < end)
+        {
+            if (*pos == '"')
+            {
+                raw = QByteArrayView(start, pos - start);
+                ++pos;
+                return true;
+            }
+            if (*pos == '\\')
+            {
+                if (end - pos < 2)
+                    return false;
+                escaped = true;
+                pos += 2;
+                continue;
+            }
+            ++pos;
+        }
+        return false;
+    }
+
+    bool readBool(bool &value)
+    {
+        if (matchLiteral("true"))
+            value = true;
+        else if (matchLiteral("false"))
+            value = false;
+        else
+            return false;
+        return true;
+    }
+
+    // reads the integer part of a number; any fraction or exponent is skipped
+    bool readInteger(qint64 &value)
+    {
+        skipWhitespace();
+        bool negative = false;
+        if (pos < end && *pos == '-')
+        {
+            negative = true;
+            ++pos;
+        }
+
+        const char *digits = pos;
+        qint64 result = 0;
+        while (pos < end && *pos >= '0' && *pos <= '9')
+            result = result * 10 + (*pos++ - '0');
+        if (pos == digits)
+            return false;
+
+        while (pos < end && (*pos == '.' || *pos == 'e' || *pos == 'E' || *pos == '+' || *pos == '-'
+                             || (*pos >= '0' && *pos <= '9')))
+            ++pos;
+
+        value = negative ? -result : result;
+        return true;
+    }
+
+    // reads a value of any type, leaving raw pointing at its JSON text
+    bool readRaw(QByteArrayView &raw)
+    {
+        skipWhitespace();
+        const char *start = pos;
+        if (!skipValue())
+            return false;
+        raw = QByteArrayView(start, pos - start);
+        return true;
+    }
+
+    bool skipValue()
+    {
+        QByteArrayView ignored;
+        bool escaped;
+        switch (peek())
+        {
+        case '"':
+            return readString(ignored, escaped);
+        case '{':
+        case '[':
+            return skipContainer();
+        case 't':
+        case 'f':
+        {
+            bool b;
+            return readBool(b);
+        }
+        case 'n':
+            return matchLiteral("null");
+        default:
+        {
+            qint64 n;
+            return readInteger(n);
+        }
+        }
+    }
+
+private:
+    bool matchLiteral(QByteArrayView literal)
+    {
+        skipWhitespace();
+        if (end - pos < literal.size() || std::memcmp(pos, literal.data(), literal.size()) != 0)
+            return false;
+        pos += literal.size();
+        return true;
+    }
+
+    bool skipContainer()
+    {
+        int depth = 0;
+        while (pos < end)
+        {
+            if (*pos == '"')
+            {
+                QByteArrayView ignored;
+                bool escaped;
+                if (!readString(ignored, escaped))
+                    return false;
+                continue;
+            }
+
+            const char c = *pos++;
+            if (c == '{' || c == '[')
+                ++depth;
+            else if ((c == '}' || c == ']') && --depth == 0)
+                return true;
+        }
+        return false;
+    }
+
+    const char *pos;
+    const char *end;
+};
+
+bool equals(QByteArrayView a, QByteArrayView b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+bool readHex4(const char *p, const char *end, char32_t &value)
+{
+    if (end - p < 4)
+        return false;
+
+    value = 0;
+    for (int i = 0; i < 4; ++i)
+    {
+        const char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9')
+            value |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            value |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            value |= c - 'A' + 10;
+        else
+            return false;
+    }
+    return true;
+}
+
+void appendUtf8(QByteArray &out, char32_t cp)
+{
+    if (cp < 0x80)
+    {
+        out.append(char(cp));
+    }
+    else if (cp < 0x800)
+    {
+        out.append(char(0xC0 | (cp >> 6)));
+        out.append(char(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000)
+    {
+        out.append(char(0xE0 | (cp >> 12)));
+        out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+        out.append(char(0x80 | (cp & 0x3F)));
+    }
+    else
+    {
+        out.append(char(0xF0 | (cp >> 18)));
+        out.append(char(0x80 | ((cp >> 12) & 0x3F)));
+        out.append(char(0x80 | ((cp >> 6) & 0x3F)));
+        out.append(char(0x80 | (cp & 0x3F)));
+    }
+}
+
+// resolves the escape sequences in raw into out (as UTF-8). out keeps its capacity between calls
+bool unescape(QByteArrayView raw, QByteArray &out)
+{
+    out.resize(0);
+    const char *p = raw.data();
+    const char *end = p + raw.size();
+
+    while (p < end)
+    {
+        const char *slash = static_cast<const char *>(std::memchr(p, '\\', end - p));
+        if (!slash)
+        {
+            out.append(p, end - p);
+            break;
+        }
+
+        out.append(p, slash - p);
+        p = slash + 1;
+        if (p == end)
+            return false;
+
+        switch (*p++)
+        {
+        case '"': out.append('"'); break;
+        case '\\': out.append('\\'); break;
+        case '/': out.append('/'); break;
+        case 'b': out.append('\b'); break;
+        case 'f': out.append('\f'); break;
+        case 'n': out.append('\n'); break;
+        case 'r': out.append('\r'); break;
+        case 't': out.append('\t'); break;
+        case 'u':
+        {
+            char32_t cp;
+            if (!readHex4(p, end, cp))
+                return false;
+            p += 4;
+
+            // characters outside the BMP arrive as a surrogate pair of two \u escapes
+            char32_t low;
+            if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u'
+                && readHex4(p + 2, end, low) && low >= 0xDC00 && low <= 0xDFFF)
+            {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            appendUtf8(out, cp);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readText(JsonCursor &cursor, QString &value, QByteArray &scratch)
+{
+    QByteArrayView raw;
+    bool escaped;
+    if (!cursor.readString(raw, escaped))
+        return false;
+
+    if (!escaped)
+    {
+        value = QString::fromUtf8(raw);
+        return true;
+    }
+
+    if (!unescape(raw, scratch))
+        return false;
+    value = QString::fromUtf8(scratch);
+    return true;
+}
+
+bool parseMessage(JsonCursor &cursor, StreamEvent &event, QByteArray &scratch)
+{
+    if (!cursor.consume('{'))
+        return false;
+    if (cursor.consume('}'))
+        return true;
+
+    do
+    {
+        QByteArrayView key;
+        bool escaped;
+        if (!cursor.readString(key, escaped) || !cursor.consume(':'))
+            return false;
+
+        bool ok;
+        if (equals(key, "role"))
+        {
+            QByteArrayView role;
+            ok = cursor.readString(role, escaped);
+            event.isAssistant = equals(role, "assistant");
+        }
+        else if (equals(key, "content"))
+        {
+            ok = readText(cursor, event.content, scratch);
+        }
+        else if (equals(key, "thinking"))
+        {
+            ok = readText(cursor, event.thinking, scratch);
+        }
+        else if (equals(key, "tool_calls"))
+        {
+            // rare, and nested, so it is left for QJsonDocument
+            QByteArrayView raw;
+            ok = cursor.readRaw(raw);
+            event.toolCalls = raw.toByteArray();
+        }
+        else
+        {
+            ok = cursor.skipValue();
+        }
+
+        if (!ok)
+            return false;
+    } while (cursor.consume(','));
+
+    return cursor.consume('}');
+}
+
+} // namespace
+
+void StreamEvent::clear()
+{
+    valid = false;
+    isAssistant = false;
+    done = false;
+    content.clear();
+    thinking.clear();
+    error.clear();
+    toolCalls.clear();
+    totalDuration = 0;
+    loadDuration = 0;
+    promptEvalCount = 0;
+    promptEvalDuration = 0;
+    evalCount = 0;
+    evalDuration = 0;
+}
+
+void StreamParser::append(QByteArrayView data)
+{
+    compact();
+    buffer.append(data);
+}
+
+bool StreamParser::next(StreamEvent &event)
+{
+    while (true)
+    {
+        const qsizetype newline = buffer.indexOf('\n', scanPos);
+        if (newline < 0)
+        {
+            // nothing before the end of the buffer needs to be scanned again when more data arrives
+            scanPos = buffer.size();
+            return false;
+        }
+
+        const QByteArrayView line = QByteArrayView(buffer).sliced(readPos, newline - readPos).trimmed();
+        readPos = scanPos = newline + 1;
+
+        if (line.isEmpty())
+            continue;
+
+        parseLine(line, event);
+        return true;
+    }
+}
+
+bool StreamParser::flush(StreamEvent &event)
+{
+    if (readPos >= buffer.size())
+        return false;
+
+    const QByteArrayView line = QByteArrayView(buffer).sliced(readPos).trimmed();
+    readPos = scanPos = buffer.size();
+
+    if (line.isEmpty())
+        return false;
+
+    parseLine(line, event);
+    return true;
+}
+
+bool StreamParser::hasPendingData() const
+{
+    return readPos < buffer.size();
+}
+
+void StreamParser::reset()
+{
+    buffer.clear();
+    readPos = 0;
+    scanPos = 0;
+}
+
+void StreamParser::compact()
+{
+    if (readPos == 0)
+        return;
+
+    // usually every line has been consumed, in which case this keeps the allocation and just empties it
+    if (readPos >= buffer.size())
+        buffer.resize(0);
+    else
+        buffer.remove(0, readPos);
+
+    scanPos -= readPos;
+    readPos = 0;
+}
+
+bool StreamParser::parseLine(QByteArrayView line, StreamEvent &event)
+{
+    event.clear();
+
+    JsonCursor cursor(line);
+    if (!cursor.consume('{'))
+        return false;
+
+    if (!cursor.consume('}'))
+    {
+        do
+        {
+            QByteArrayView key;
+            bool escaped;
+            if (!cursor.readString(key, escaped) || !cursor.consume(':'))
+                return false;
+
+            bool ok;
+            if (equals(key, "message"))
+                ok = parseMessage(cursor, event, scratch);
+            else if (equals(key, "done"))
+                ok = cursor.readBool(event.done);
+            else if (equals(key, "error"))
+                ok = readText(cursor, event.error, scratch);
+            else if (equals(key, "total_duration"))
+                ok = cursor.readInteger(event.totalDuration);
+            else if (equals(key, "load_duration"))
+                ok = cursor.readInteger(event.loadDuration);
+            else if (equals(key, "prompt_eval_count"))
+                ok = cursor.readInteger(event.promptEvalCount);
+            else if (equals(key, "prompt_eval_duration"))
+                ok = cursor.readInteger(event.promptEvalDuration);
+            else if (equals(key, "eval_count"))
+                ok = cursor.readInteger(event.evalCount);
+            else if (equals(key, "eval_duration"))
+                ok = cursor.readInteger(event.evalDuration);
+            else
+                ok = cursor.skipValue();
+
+            if (!ok)
+                return false;
+        } while (cursor.consume(','));
+
+        if (!cursor.consume('}'))
+            return false;
+    }
+
+    event.valid = cursor.atEnd();
+    return event.valid;
+}
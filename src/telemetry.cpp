@@ -0,0 +1,325 @@
+/*
+    telemetry.cpp
+
+    Class implementation for Telemetry.
+*/
+
+#include "telemetry.h"
+#include "logger.h"
+#include <QSaveFile>
+
+namespace
+{
+
+// upper bounds in seconds; the +Inf bucket comes after these
+constexpr double bucketBounds[] = { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+                                    1,     2.5,    5,     10,   30,    60,   120 };
+constexpr int boundCount = int(sizeof(bucketBounds) / sizeof(bucketBounds[0]));
+
+QByteArray number(double value)
+{
+    return QByteArray::number(value, 'g', 10);
+}
+
+} // namespace
+
+Telemetry::Telemetry(QObject *parent)
+    : QObject(parent), requests(0), promptTokens(0), generatedTokens(0), lastTokensPerSecond(0), prefills(0),
+      prefillHits(0), prefillMisses(0), oldestUnrendered(-1)
+{
+    histograms = {
+        { "zippy_time_to_first_byte_seconds", "firstByte",
+          "Time from sending a chat request to the first bytes of the reply.", {} },
+        { "zippy_time_to_first_token_seconds", "firstToken",
+          "Time from sending a chat request to the first visible token of the answer, after any reasoning.", {} },
+        { "zippy_generation_seconds", "generation", "Time from the first token of an answer to the last.", {} },
+        { "zippy_request_seconds", "request", "Time from sending a chat request to the end of the reply.", {} },
+        { "zippy_model_load_seconds", "modelLoad",
+          "Time the server spent loading the model, as reported by the server.", {} },
+        { "zippy_prompt_eval_seconds", "promptEval",
+          "Time the server spent evaluating the prompt, as reported by the server.", {} },
+        { "zippy_eval_seconds", "eval", "Time the server spent generating the answer, as reported by the server.", {} },
+        { "zippy_ui_render_seconds", "uiRender", "Time from a token arriving to a frame showing it.", {} },
+        { "zippy_thinking_seconds", "thinking",
+          "Time a thinking model spent reasoning, from its first reasoning token to the first visible one.", {} },
+    };
+    for (Histogram &histogram : histograms)
+        histogram.buckets.fill(0, boundCount + 1);
+
+    clock.start();
+    connect(&exportTimer, &QTimer::timeout, this, &Telemetry::writeExport);
+}
+
+void Telemetry::recordRequest(const RequestTimings &timings)
+{
+    auto seconds = [](qint64 nsecs) { return double(nsecs) / 1e9; };
+
+    if (timings.firstByte >= 0)
+        histograms[FirstByte].record(seconds(timings.firstByte));
+    if (timings.firstToken >= 0)
+        histograms[FirstToken].record(seconds(timings.firstToken));
+    if (timings.firstThought >= 0 && timings.firstToken >= timings.firstThought)
+        histograms[Thinking].record(seconds(timings.firstToken - timings.firstThought));
+    if (timings.firstToken >= 0 && timings.lastToken >= timings.firstToken)
+        histograms[Generation].record(seconds(timings.lastToken - timings.firstToken));
+    if (timings.finished >= 0)
+        histograms[Request].record(seconds(timings.finished));
+
+    // a reply served from the server's cache reports no load or evaluation at all
+    if (timings.loadDuration > 0)
+        histograms[ModelLoad].record(seconds(timings.loadDuration));
+    if (timings.promptEvalDuration > 0)
+        histograms[PromptEval].record(seconds(timings.promptEvalDuration));
+    if (timings.evalDuration > 0)
+    {
+        histograms[Eval].record(seconds(timings.evalDuration));
+        lastTokensPerSecond = timings.evalCount / seconds(timings.evalDuration);
+    }
+
+    ++requests;
+    promptTokens += quint64(qMax<qint64>(0, timings.promptEvalCount));
+    generatedTokens += quint64(qMax<qint64>(0, timings.evalCount));
+    emit updated();
+}
+
+void Telemetry::recordPublished(qint64 waitedNs)
+{
+    // a frame may cover several publishes; the oldest token is the one that waited longest
+    if (oldestUnrendered < 0)
+        oldestUnrendered = clock.nsecsElapsed() - waitedNs;
+}
+
+void Telemetry::recordFrame()
+{
+    if (oldestUnrendered < 0)
+        return;
+
+    histograms[UiRender].record(double(clock.nsecsElapsed() - oldestUnrendered) / 1e9);
+    oldestUnrendered = -1;
+}
+
+void Telemetry::recordPrefill()
+{
+    ++prefills;
+    emit updated();
+}
+
+void Telemetry::recordPrefillOutcome(bool paidOff)
+{
+    if (paidOff)
+        ++prefillHits;
+    else
+        ++prefillMisses;
+    emit updated();
+}
+
+void Telemetry::recordToolCall(const QString &tool, qint64 nsecs, bool succeeded)
+{
+    auto histogram = toolCalls.find(tool);
+    if (histogram == toolCalls.end())
+    {
+        histogram = toolCalls.insert(tool, { "zippy_tool_call_seconds", nullptr, nullptr, {} });
+        histogram->buckets.fill(0, boundCount + 1);
+    }
+    histogram->record(double(nsecs) / 1e9);
+
+    if (!succeeded)
+        ++toolFailures[tool];
+    emit updated();
+}
+
+void Telemetry::recordRoutedAnswer(const QString &tier, qint64 nsecs)
+{
+    auto histogram = routedAnswers.find(tier);
+    if (histogram == routedAnswers.end())
+    {
+        histogram = routedAnswers.insert(tier, { "zippy_tier_answer_seconds", nullptr, nullptr, {} });
+        histogram->buckets.fill(0, boundCount + 1);
+    }
+    histogram->record(double(nsecs) / 1e9);
+    emit updated();
+}
+
+void Telemetry::recordStartup(const QString &phase, qint64 nsecs)
+{
+    startupPhases.append({ phase, nsecs / 1e9 });
+    emit updated();
+}
+
+QVariantMap Telemetry::summary() const
+{
+    QVariantMap result;
+    for (const Histogram &histogram : histograms)
+        result[histogram.key] = stageSummary(histogram);
+    result["tokensPerSecond"] = lastTokensPerSecond;
+    result["prefills"] = prefills;
+    result["prefillHits"] = prefillHits;
+    result["prefillMisses"] = prefillMisses;
+
+    QVariantMap tools;
+    for (auto histogram = toolCalls.cbegin(); histogram != toolCalls.cend(); ++histogram)
+        tools[histogram.key()] = stageSummary(histogram.value());
+    result["tools"] = tools;
+
+    QVariantMap tiers;
+    for (auto histogram = routedAnswers.cbegin(); histogram != routedAnswers.cend(); ++histogram)
+        tiers[histogram.key()] = stageSummary(histogram.value());
+    result["tiers"] = tiers;
+
+    QVariantMap startup;
+    for (const StartupPhase &phase : startupPhases)
+        startup[phase.name] = phase.seconds * 1000;
+    result["startup"] = startup;
+    return result;
+}
+
+QVariantMap Telemetry::stageSummary(const Histogram &histogram)
+{
+    QVariantMap stage;
+    stage["last"] = histogram.last * 1000;
+    stage["p50"] = histogram.percentile(0.5) * 1000;
+    stage["p95"] = histogram.percentile(0.95) * 1000;
+    stage["count"] = histogram.count;
+    return stage;
+}
+
+void Telemetry::appendHistogram(QByteArray &text, const Histogram &histogram, const QByteArray &labels)
+{
+    quint64 cumulative = 0;
+    for (int bucket = 0; bucket <= boundCount; ++bucket)
+    {
+        cumulative += histogram.buckets[bucket];
+        const QByteArray bound = bucket < boundCount ? number(bucketBounds[bucket]) : QByteArray("+Inf");
+        text += QByteArray(histogram.name) + "_bucket{" + labels + "le=\"" + bound + "\"} "
+                + QByteArray::number(cumulative) + '\n';
+    }
+
+    const QByteArray braced = labels.isEmpty() ? QByteArray() : '{' + labels.chopped(1) + '}';
+    text += QByteArray(histogram.name) + "_sum" + braced + ' ' + number(histogram.sum) + '\n';
+    text += QByteArray(histogram.name) + "_count" + braced + ' ' + QByteArray::number(histogram.count) + '\n';
+}
+
+QByteArray Telemetry::prometheusText() const
+{
+    QByteArray text;
+    for (const Histogram &histogram : histograms)
+    {
+        text += QByteArray("# HELP ") + histogram.name + ' ' + histogram.help + '\n';
+        text += QByteArray("# TYPE ") + histogram.name + " histogram\n";
+        appendHistogram(text, histogram, QByteArray());
+    }
+
+    text += "# HELP zippy_requests_total Chat requests that ran to completion.\n"
+            "# TYPE zippy_requests_total counter\n"
+            "zippy_requests_total " + QByteArray::number(requests) + '\n';
+    text += "# HELP zippy_prompt_tokens_total Prompt tokens evaluated by the server.\n"
+            "# TYPE zippy_prompt_tokens_total counter\n"
+            "zippy_prompt_tokens_total " + QByteArray::number(promptTokens) + '\n';
+    text += "# HELP zippy_generated_tokens_total Tokens generated by the server.\n"
+            "# TYPE zippy_generated_tokens_total counter\n"
+            "zippy_generated_tokens_total " + QByteArray::number(generatedTokens) + '\n';
+    text += "# HELP zippy_generation_tokens_per_second Generation speed of the last answer.\n"
+            "# TYPE zippy_generation_tokens_per_second gauge\n"
+            "zippy_generation_tokens_per_second " + number(lastTokensPerSecond) + '\n';
+    text += "# HELP zippy_prefills_total Speculative prefills sent while a prompt was being typed.\n"
+            "# TYPE zippy_prefills_total counter\n"
+            "zippy_prefills_total " + QByteArray::number(prefills) + '\n';
+    text += "# HELP zippy_prefill_outcomes_total Prompts sent after prefills, by whether one was ready.\n"
+            "# TYPE zippy_prefill_outcomes_total counter\n"
+            "zippy_prefill_outcomes_total{result=\"hit\"} " + QByteArray::number(prefillHits) + '\n' +
+            "zippy_prefill_outcomes_total{result=\"miss\"} " + QByteArray::number(prefillMisses) + '\n';
+
+    // one series per tool; the names come from our own registry, so they need no escaping
+    if (!toolCalls.isEmpty())
+    {
+        text += "# HELP zippy_tool_call_seconds Time a tool called by the model took to answer.\n"
+                "# TYPE zippy_tool_call_seconds histogram\n";
+        for (auto histogram = toolCalls.cbegin(); histogram != toolCalls.cend(); ++histogram)
+            appendHistogram(text, histogram.value(), "tool=\"" + histogram.key().toUtf8() + "\",");
+
+        text += "# HELP zippy_tool_call_failures_total Tool calls that failed or timed out.\n"
+                "# TYPE zippy_tool_call_failures_total counter\n";
+        for (auto histogram = toolCalls.cbegin(); histogram != toolCalls.cend(); ++histogram)
+        {
+            text += "zippy_tool_call_failures_total{tool=\"" + histogram.key().toUtf8() + "\"} "
+                    + QByteArray::number(toolFailures.value(histogram.key())) + '\n';
+        }
+    }
+
+    if (!routedAnswers.isEmpty())
+    {
+        text += "# HELP zippy_tier_answer_seconds Time from sending a prompt to the end of its answer, by model tier.\n"
+                "# TYPE zippy_tier_answer_seconds histogram\n";
+        for (auto histogram = routedAnswers.cbegin(); histogram != routedAnswers.cend(); ++histogram)
+            appendHistogram(text, histogram.value(), "tier=\"" + histogram.key().toUtf8() + "\",");
+    }
+
+    if (!startupPhases.isEmpty())
+    {
+        text += "# HELP zippy_startup_seconds Time from launch to each phase of starting up.\n"
+                "# TYPE zippy_startup_seconds gauge\n";
+        for (const StartupPhase &phase : startupPhases)
+            text += "zippy_startup_seconds{phase=\"" + phase.name.toUtf8() + "\"} " + number(phase.seconds) + '\n';
+    }
+    return text;
+}
+
+void Telemetry::startExport(const QString &path, int intervalSeconds)
+{
+    exportPath = path;
+    if (path.isEmpty() || intervalSeconds <= 0)
+    {
+        exportTimer.stop();
+        return;
+    }
+
+    exportTimer.start(intervalSeconds * 1000);
+    writeExport();
+}
+
+void Telemetry::writeExport()
+{
+    // scrapers must never see a half-written file
+    QSaveFile file(exportPath);
+    if (!file.open(QIODevice::WriteOnly) || file.write(prometheusText()) < 0 || !file.commit())
+    {
+        LOG_ERROR("metrics.write_failed", "path", exportPath, "error", file.errorString());
+        exportTimer.stop();
+    }
+}
+
+void Telemetry::Histogram::record(double seconds)
+{
+    int bucket = 0;
+    while (bucket < boundCount && seconds > bucketBounds[bucket])
+        ++bucket;
+
+    ++buckets[bucket];
+    sum += seconds;
+    ++count;
+    last = seconds;
+}
+
+double Telemetry::Histogram::percentile(double p) const
+{
+    if (count == 0)
+        return 0;
+
+    // linear interpolation inside the bucket the percentile falls in, as Prometheus' histogram_quantile does
+    const double rank = p * double(count);
+    quint64 below = 0;
+    for (int bucket = 0; bucket <= boundCount; ++bucket)
+    {
+        if (double(below + buckets[bucket]) >= rank && buckets[bucket] > 0)
+        {
+            if (bucket == boundCount)
+                return bucketBounds[boundCount - 1];
+
+            const double lower = bucket == 0 ? 0 : bucketBounds[bucket - 1];
+            const double fraction = (rank - double(below)) / double(buckets[bucket]);
+            return lower + (bucketBounds[bucket] - lower) * fraction;
+        }
+        below += buckets[bucket];
+    }
+    return bucketBounds[boundCount - 1];
+}
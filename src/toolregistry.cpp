@@ -0,0 +1,129 @@
+/*
+    toolregistry.cpp
+
+    Class implementation for ToolRegistry.
+*/
+
+#include "toolregistry.h"
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTimer>
+#include <algorithm>
+#include <memory>
+
+namespace
+{
+
+// what is left of one run() while its calls are out
+struct Batch
+{
+    QStringList results;
+    QList<bool> finished;
+    int pending = 0;
+    std::function<void(const QStringList &results)> onFinished;
+};
+
+} // namespace
+
+ToolRegistry::ToolRegistry(QObject *parent)
+    : QObject(parent), timeout(0)
+{
+}
+
+void ToolRegistry::add(const QString &name, const QString &description, const QJsonObject &parameters,
+                       Handler handler)
+{
+    QJsonObject function;
+    function["name"] = name;
+    function["description"] = description;
+    function["parameters"] = parameters;
+
+    QJsonObject definition;
+    definition["type"] = "function";
+    definition["function"] = function;
+
+    auto existing = std::find_if(tools.begin(), tools.end(), [&name](const Tool &tool)
+    {
+        return tool.definition["function"]["name"].toString() == name;
+    });
+    if (existing != tools.end())
+        *existing = { definition, std::move(handler) };
+    else
+        tools.append({ definition, std::move(handler) });
+
+    // sent with every request, so encoded once
+    QJsonArray definitions;
+    for (const Tool &tool : std::as_const(tools))
+        definitions.append(tool.definition);
+    cachedDefinitions = QJsonDocument(definitions).toJson(QJsonDocument::Compact);
+}
+
+bool ToolRegistry::isEmpty() const
+{
+    return tools.isEmpty();
+}
+
+QByteArray ToolRegistry::definitions() const
+{
+    return cachedDefinitions;
+}
+
+void ToolRegistry::setTimeout(int msec)
+{
+    timeout = qMax(0, msec);
+}
+
+void ToolRegistry::run(const QList<Call> &calls, std::function<void(const QStringList &results)> onFinished)
+{
+    auto batch = std::make_shared<Batch>();
+    batch->results.resize(calls.size());
+    batch->finished.fill(false, calls.size());
+    batch->pending = int(calls.size());
+    batch->onFinished = std::move(onFinished);
+
+    // the results always arrive after run() has returned, even when every tool answered straight away
+    auto deliver = [this, batch]()
+    {
+        QMetaObject::invokeMethod(this, [batch]() { batch->onFinished(batch->results); }, Qt::QueuedConnection);
+    };
+    if (calls.isEmpty())
+    {
+        deliver();
+        return;
+    }
+
+    for (qsizetype i = 0; i < calls.size(); ++i)
+    {
+        const QString name = calls[i].name;
+        QElapsedTimer started;
+        started.start();
+
+        // whichever comes first of the tool's answer and the timeout counts; the other is dropped
+        auto finish = [this, batch, deliver, i, name, started](bool succeeded, const QString &result)
+        {
+            if (batch->finished[i])
+                return;
+
+            batch->finished[i] = true;
+            batch->results[i] = succeeded ? result : "Error: " + result;
+            emit callFinished(name, started.nsecsElapsed(), succeeded);
+            if (--batch->pending == 0)
+                deliver();
+        };
+
+        auto tool = std::find_if(tools.cbegin(), tools.cend(), [&name](const Tool &tool)
+        {
+            return tool.definition["function"]["name"].toString() == name;
+        });
+        if (tool == tools.cend())
+        {
+            finish(false, "There is no tool called \"" + name + "\".");
+            continue;
+        }
+
+        if (timeout > 0)
+            QTimer::singleShot(timeout, this, [finish]() { finish(false, "The tool took too long to answer."); });
+        tool->handler(calls[i].arguments, finish);
+    }
+}